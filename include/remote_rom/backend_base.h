@@ -32,12 +32,24 @@ namespace Remote_rom {
 	                                         Genode::Xml_node config);
 };
 
+/**
+ * Backend interface of the server
+ *
+ * Multiple forwarders, each providing a distinct module, may be registered
+ * at a single backend.
+ */
 struct Remote_rom::Backend_server_base : Genode::Interface
 {
-	virtual void send_update() = 0;
+	virtual void send_update(Rom_forwarder_base &forwarder) = 0;
 	virtual void register_forwarder(Rom_forwarder_base *forwarder) = 0;
 };
 
+/**
+ * Backend interface of the client
+ *
+ * Multiple receivers, each expecting a distinct module, may be registered
+ * at a single backend.
+ */
 struct Remote_rom::Backend_client_base : Genode::Interface
 {
 	virtual void register_receiver(Rom_receiver_base *receiver) = 0;
@@ -26,9 +26,27 @@ struct Remote_rom::Rom_receiver_base : Genode::Interface
 {
 	virtual const char *module_name()  const = 0;
 	virtual unsigned    content_hash() const = 0;
+
+	/**
+	 * Return hash of the content currently provided, 0 if none
+	 */
+	virtual unsigned    base_hash()    const = 0;
+
 	virtual char* start_new_content(unsigned hash,
 	                                size_t len) = 0;
-	virtual void commit_new_content(bool abort=false) = 0;
+
+	/**
+	 * Initialise new content with the current content to apply a delta
+	 */
+	virtual void start_delta() = 0;
+
+	/**
+	 * Commit the received content
+	 *
+	 * \param abort     discard the received content
+	 * \param verified  content was already verified by the backend
+	 */
+	virtual void commit_new_content(bool abort=false, bool verified=false) = 0;
 };
 
 #endif
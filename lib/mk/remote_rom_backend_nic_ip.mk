@@ -2,9 +2,10 @@
 # \date   2016-03-19
 
 SRC_CC += backend/nic_ip/base.cc backend/nic_ip/client.cc backend/nic_ip/server.cc
+SRC_CC += backend/nic_ip/compression.cc
 INC_DIR += $(REP_DIR)/src/lib/remote_rom/backend/nic_ip
 
-LIBS   += base net
+LIBS   += base net snappy nettle libc stdcxx
 
 # include less specificuration
 include $(REP_DIR)/lib/mk/remote_rom_backend.inc
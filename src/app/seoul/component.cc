@@ -31,12 +31,14 @@
 #include <rom_session/connection.h>
 #include <util/touch.h>
 #include <util/misc_math.h>
+#include <trace/timestamp.h>
 
 #include <vm_session/connection.h>
 #include <vm_session/handler.h>
 #include <cpu/vcpu_state.h>
 
 /* os includes */
+#include <os/reporter.h>
 #include <nic_session/connection.h>
 #include <nic/packet_allocator.h>
 #include <rtc_session/connection.h>
@@ -61,6 +63,7 @@
 #include "timeout_late.h"
 #include "gui.h"
 #include "audio.h"
+#include "vcpu_stats.h"
 
 
 enum { verbose_debug = false };
@@ -78,8 +81,20 @@ using Genode::Attached_rom_dataspace;
 
 typedef Genode::Synced_interface<TimeoutList<32, void> > Synced_timeout_list;
 
+/*
+ * Host timeouts are coalesced by rounding each timeout up to the next slot
+ * of a grid on the absolute clock, so that timeouts falling into the same
+ * slot expire with one host timer interrupt. The slot width is the slack
+ * of the timer, which is the configured 'timer_slack_us' for the timers of
+ * the guest devices and 'poll_slack_us' for the polling timer of the VMM.
+ * A slack of 0 leaves the timeouts unchanged.
+ */
 class Timeouts
 {
+	public:
+
+		enum { MAX_TIMERS = 32 };
+
 	private:
 
 		Timer::Connection                 _timer;
@@ -88,6 +103,16 @@ class Timeouts
 		Genode::Signal_handler<Timeouts>  _timeout_sigh;
 		Late_timeout                      _late { };
 
+		Genode::uint64_t const            _tsc_freq;
+		timevalue                         _slack[MAX_TIMERS];
+
+		/* host timeout currently programmed, 0 if none */
+		Genode::Mutex                     _programmed_mutex { };
+		timevalue                         _programmed { 0 };
+
+		timevalue _ticks(Genode::uint64_t const us) const {
+			return us * _tsc_freq / (1000 * 1000); }
+
 		Genode::uint64_t _check_and_wakeup()
 		{
 			Late_timeout::Remote const timeout_remote = _late.reset();
@@ -120,8 +145,15 @@ class Timeouts
 
 		void check_timeouts()
 		{
+			/* timeouts requested meanwhile trigger another check */
+			{
+				Genode::Mutex::Guard guard(_programmed_mutex);
+				_programmed = 0;
+			}
+
 			Genode::uint64_t const next = _check_and_wakeup();
 
+			/* tickless if no timeout is pending */
 			if (next == ~0ULL)
 				return;
 
@@ -129,28 +161,71 @@ class Timeouts
 			if (rel_timeout_us == 0)
 				rel_timeout_us = 1;
 
+			/* not nested in the motherboard lock, which 'reprogram' holds */
+			Genode::Mutex::Guard guard(_programmed_mutex);
+
+			_programmed = next;
 			_timer.trigger_once(rel_timeout_us);
 		}
 
 	public:
 
+		/**
+		 * Round timeout up to the slot of the timer
+		 */
+		timevalue coalesce(unsigned const nr, timevalue const abstime) const
+		{
+			timevalue const slack = nr < MAX_TIMERS ? _slack[nr] : 0;
+
+			if (slack <= 1 || abstime > ~0ULL - slack)
+				return abstime;
+
+			return (abstime + slack - 1) / slack * slack;
+		}
+
+		/**
+		 * Set slack of timer, e.g., of a polling timer of the VMM
+		 */
+		void slack(unsigned const nr, Genode::uint64_t const us)
+		{
+			if (nr < MAX_TIMERS)
+				_slack[nr] = _ticks(us);
+		}
+
 		void reprogram(Clock &clock, MessageTimer const &msg)
 		{
 			_late.timeout(clock, msg);
+
+			{
+				Genode::Mutex::Guard guard(_programmed_mutex);
+
+				/* the host timer fires in time for the new timeout anyway */
+				if (_programmed && msg.abstime >= _programmed)
+					return;
+			}
+
 			Genode::Signal_transmitter(_timeout_sigh).submit();
 		}
 
 		/**
 		 * Constructor
+		 *
+		 * \param tsc_freq  frequency of the clock in Hz
+		 * \param slack_us  default slack of the timers in microseconds
 		 */
 		Timeouts(Genode::Env &env, Synced_motherboard &mb,
-		             Synced_timeout_list &timeouts)
+		             Synced_timeout_list &timeouts,
+		             Genode::uint64_t tsc_freq, Genode::uint64_t slack_us)
 		:
 		  _timer(env),
 		  _motherboard(mb),
 		  _timeouts(timeouts),
-		  _timeout_sigh(env.ep(), *this, &Timeouts::check_timeouts)
+		  _timeout_sigh(env.ep(), *this, &Timeouts::check_timeouts),
+		  _tsc_freq(tsc_freq)
 		{
+			for (unsigned i = 0; i < MAX_TIMERS; i++)
+				_slack[i] = _ticks(slack_us);
+
 			_timer.sigh(_timeout_sigh);
 		}
 
@@ -176,6 +251,21 @@ class Vcpu : public StaticReceiver<Vcpu>
 		Synced_motherboard                 &_motherboard;
 		Genode::Synced_interface<VCpu>      _vcpu;
 
+		/* network backend, created on demand by the guest NIC model */
+		Seoul::Network * const             &_nic;
+
+		/* exit accounting, nullptr if disabled */
+		Seoul::Vcpu_stats * const           _stats;
+
+		void _account_mmio()
+		{
+			if (!_stats)
+				return;
+
+			_stats->mmio.count(_state.qual_secondary.value());
+			_stats->mmio_access = true;
+		}
+
 		CpuState                            _seoul_state { };
 
 		Genode::Semaphore                   _block { 0 };
@@ -187,6 +277,7 @@ class Vcpu : public StaticReceiver<Vcpu>
 		     Genode::Allocator &alloc, Genode::Env &env,
 		     Genode::Mutex &vcpu_mutex, VCpu *unsynchronized_vcpu,
 		     Seoul::Guest_memory &guest_memory, Synced_motherboard &motherboard,
+		     Seoul::Network * const &nic, Seoul::Vcpu_stats *stats,
 		     bool vmx, bool svm, bool map_small, bool rdtsc)
 		:
 			_vm_con(vm_con),
@@ -198,7 +289,8 @@ class Vcpu : public StaticReceiver<Vcpu>
 			_state(_vm_vcpu.state()),
 			_guest_memory(guest_memory),
 			_motherboard(motherboard),
-			_vcpu(vcpu_mutex, unsynchronized_vcpu)
+			_vcpu(vcpu_mutex, unsynchronized_vcpu),
+			_nic(nic), _stats(stats)
 		{
 			if (!_svm && !_vmx)
 				Logging::panic("no SVM/VMX available, sorry");
@@ -221,6 +313,8 @@ class Vcpu : public StaticReceiver<Vcpu>
 		{
 			unsigned const exit = _state.exit_reason;
 
+			Genode::Trace::Timestamp const start = _stats ? Genode::Trace::timestamp() : 0;
+
 			if (_svm) {
 				switch (exit) {
 				case 0x00 ... 0x1f: _svm_cr(); break;
@@ -267,6 +361,15 @@ class Vcpu : public StaticReceiver<Vcpu>
 				}
 			}
 
+			/* submit the frames sent by the guest during this exit at once */
+			if (_nic)
+				_nic->flush_tx();
+
+			if (_stats)
+				_stats->account(_svm ? Seoul::Vcpu_stats::svm_type(exit)
+				                     : Seoul::Vcpu_stats::vmx_type(exit),
+				                Genode::Trace::timestamp() - start);
+
 			/* resume */
 			_vm_vcpu.run();
 		}
@@ -510,6 +613,9 @@ class Vcpu : public StaticReceiver<Vcpu>
 				Logging::printf("--> I/O is_in=%d, io_order=%d, port=%x\n",
 				                is_in, io_order, port);
 
+			if (_stats)
+				_stats->io_ports.count(port);
+
 			/* convert Genode VM state to Seoul state */
 			unsigned mtd = Seoul::read_vm_state(_state, _seoul_state);
 
@@ -540,8 +646,10 @@ class Vcpu : public StaticReceiver<Vcpu>
 
 		void _svm_npt()
 		{
-			if (!_handle_map_memory(_state.qual_primary.value() & 1))
+			if (!_handle_map_memory(_state.qual_primary.value() & 1)) {
+				_account_mmio();
 				_svm_invalid();
+			}
 		}
 
 		void _svm_cr()
@@ -679,9 +787,11 @@ class Vcpu : public StaticReceiver<Vcpu>
 
 		void _vmx_ept()
 		{
-			if (!_handle_map_memory(_state.qual_primary.value() & 0x38))
+			if (!_handle_map_memory(_state.qual_primary.value() & 0x38)) {
 				/* this is an access to MMIO */
+				_account_mmio();
 				_handle_vcpu(NO_SKIP, CpuMessage::TYPE_SINGLE_STEP);
+			}
 		}
 
 		void _vmx_cpuid()
@@ -731,6 +841,7 @@ class Machine : public StaticReceiver<Machine>
 		Genode::Env           &_env;
 		Genode::Heap          &_heap;
 		Genode::Vm_connection &_vm_con;
+		Genode::uint64_t const _tsc_freq;
 		Clock                  _clock;
 		Genode::Mutex          _motherboard_mutex { };
 		Motherboard            _unsynchronized_motherboard;
@@ -740,7 +851,9 @@ class Machine : public StaticReceiver<Machine>
 		Synced_timeout_list    _timeouts;
 		Seoul::Guest_memory   &_guest_memory;
 		Boot_module_provider  &_boot_modules;
-		Timeouts               _alarm_thread = { _env, _motherboard, _timeouts };
+		Genode::uint64_t const _timer_slack_us;
+		Timeouts               _alarm_thread = { _env, _motherboard, _timeouts,
+		                                         _tsc_freq, _timer_slack_us };
 		unsigned short         _vcpus_up = 0;
 
 		bool                   _map_small    { false   };
@@ -754,12 +867,43 @@ class Machine : public StaticReceiver<Machine>
 		Vcpu *                 _vcpus[MAX_CPUS] { nullptr };
 		Genode::Bit_array<64>  _vcpus_active { };
 
+		/* periodic report of the VM exits of all vCPUs */
+		Seoul::Vcpu_stats     *_vcpu_stats[MAX_CPUS] { nullptr };
+
+		Genode::Constructible<Genode::Expanding_reporter> _exit_stats_reporter { };
+		Genode::Constructible<Timer::Connection>          _exit_stats_timer    { };
+
+		Genode::Signal_handler<Machine> _exit_stats_handler {
+			_env.ep(), *this, &Machine::_report_exit_stats };
+
+		void _report_exit_stats()
+		{
+			_exit_stats_reporter->generate([&] (Genode::Xml_generator &xml) {
+				for (unsigned i = 0; i < _vcpus_up; i++) {
+					if (!_vcpu_stats[i])
+						continue;
+
+					xml.node("vcpu", [&] () {
+						xml.attribute("id", i);
+						_vcpu_stats[i]->generate(xml);
+					});
+				}
+			});
+		}
+
 		/*
 		 * Noncopyable
 		 */
 		Machine(Machine const &);
 		Machine &operator = (Machine const &);
 
+		static Genode::uint64_t _tsc_freq_hz(Genode::Env &env)
+		{
+			Attached_rom_dataspace const info(env, "platform_info");
+			return info.xml().sub_node("hardware").sub_node("tsc")
+			                 .attribute_value("freq_khz", 0ULL) * 1000ULL;
+		}
+
 	public:
 
 		/*********************************************
@@ -856,9 +1000,13 @@ class Machine : public StaticReceiver<Machine>
 
 					_vcpus_active.set(_vcpus_up, 1);
 
+					if (_exit_stats_reporter.constructed())
+						_vcpu_stats[_vcpus_up] = new (_heap) Seoul::Vcpu_stats(_tsc_freq);
+
 					Vcpu * vcpu = new Vcpu(*ep, _vm_con, _heap, _env,
 					                       _motherboard_mutex, msg.vcpu,
-					                       _guest_memory, _motherboard,
+					                       _guest_memory, _motherboard, _nic,
+					                       _vcpu_stats[_vcpus_up],
 					                       has_vmx, has_svm, _map_small,
 					                       _rdtsc_exit);
 
@@ -1065,6 +1213,8 @@ class Machine : public StaticReceiver<Machine>
 
 			case MessageTimer::TIMER_REQUEST_TIMEOUT:
 			{
+				msg.abstime = _alarm_thread.coalesce(msg.nr, msg.abstime);
+
 				int res = _timeouts()->request(msg.nr, msg.abstime);
 
 				if (res == 0)
@@ -1144,15 +1294,18 @@ class Machine : public StaticReceiver<Machine>
 		        Genode::Vm_connection &vm_con,
 		        Boot_module_provider &boot_modules,
 		        Seoul::Guest_memory &guest_memory,
-		        bool map_small, bool rdtsc_exit, bool vmm_vcpu_same_cpu)
+		        bool map_small, bool rdtsc_exit, bool vmm_vcpu_same_cpu,
+		        Genode::uint64_t timer_slack_us, bool exit_stats)
 		:
 			_env(env), _heap(heap), _vm_con(vm_con),
-			_clock(Attached_rom_dataspace(env, "platform_info").xml().sub_node("hardware").sub_node("tsc").attribute_value("freq_khz", 0ULL) * 1000ULL),
+			_tsc_freq(_tsc_freq_hz(env)),
+			_clock(_tsc_freq),
 			_unsynchronized_motherboard(&_clock, nullptr),
 			_motherboard(_motherboard_mutex, &_unsynchronized_motherboard),
 			_timeouts(_timeouts_mutex, &_unsynchronized_timeouts),
 			_guest_memory(guest_memory),
 			_boot_modules(boot_modules),
+			_timer_slack_us(timer_slack_us),
 			_map_small(map_small),
 			_rdtsc_exit(rdtsc_exit),
 			_same_cpu(vmm_vcpu_same_cpu)
@@ -1161,6 +1314,13 @@ class Machine : public StaticReceiver<Machine>
 
 			_timeouts()->init();
 
+			if (exit_stats) {
+				_exit_stats_reporter.construct(env, "exit_stats", "exit_stats");
+				_exit_stats_timer.construct(env);
+				_exit_stats_timer->sigh(_exit_stats_handler);
+				_exit_stats_timer->trigger_periodic(1000 * 1000);
+			}
+
 			/* register host operations, called back by the VMM */
 			_unsynchronized_motherboard.bus_hostop.add  (this, receive_static<MessageHostOp>);
 			_unsynchronized_motherboard.bus_timer.add   (this, receive_static<MessageTimer>);
@@ -1295,6 +1455,15 @@ class Machine : public StaticReceiver<Machine>
 		Synced_motherboard &motherboard() { return _motherboard; }
 
 		Motherboard &unsynchronized_motherboard() { return _unsynchronized_motherboard; }
+
+		/**
+		 * Round the timeouts of the polling timer of the VMM to 'slack_us'
+		 *
+		 * This limits the polling rate to one poll per slack at the cost of
+		 * up to 'slack_us' additional latency.
+		 */
+		void poll_timer(unsigned nr, Genode::uint64_t slack_us) {
+			_alarm_thread.slack(nr, slack_us); }
 };
 
 
@@ -1321,6 +1490,12 @@ void Component::construct(Genode::Env &env)
 	bool const rdtsc_exit        = node.attribute_value("exit_on_rdtsc", false);
 	bool const vmm_vcpu_same_cpu = node.attribute_value("vmm_vcpu_same_cpu",
 	                                                    false);
+	auto const disk_buffer       = node.attribute_value("disk_buffer",
+	                                                    Genode::Number_of_bytes(2 * 1024 * 1024));
+	bool const disk_stats        = node.attribute_value("disk_stats", false);
+	auto const timer_slack_us    = node.attribute_value("timer_slack_us", 0ULL);
+	auto const poll_slack_us     = node.attribute_value("poll_slack_us", 0ULL);
+	bool const exit_stats        = node.attribute_value("exit_stats", false);
 
 	/* request max available memory */
 	auto vm_size = env.pd().avail_ram().value;
@@ -1376,7 +1551,8 @@ void Component::construct(Genode::Env &env)
 
 	/* create the PC machine based on the configuration given */
 	static Machine machine(env, heap, vm_con, boot_modules, guest_memory,
-	                       map_small, rdtsc_exit, vmm_vcpu_same_cpu);
+	                       map_small, rdtsc_exit, vmm_vcpu_same_cpu,
+	                       timer_slack_us, exit_stats);
 
 	Gui::Area const gui_area(width, height);
 
@@ -1386,12 +1562,14 @@ void Component::construct(Genode::Env &env)
 	                           gui_area, guest_memory);
 
 	vcon.register_host_operations(machine.unsynchronized_motherboard());
+	machine.poll_timer(vcon.timer(), poll_slack_us);
 
 	/* create disk thread */
 	static Seoul::Disk vdisk(env, machine.motherboard(),
 	                         machine.unsynchronized_motherboard(),
 	                         guest_memory.backing_store_local_base(),
-	                         guest_memory.backing_store_size());
+	                         guest_memory.backing_store_size(),
+	                         disk_buffer, disk_stats);
 
 	vdisk.register_host_operations(machine.unsynchronized_motherboard());
 
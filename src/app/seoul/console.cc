@@ -530,5 +530,5 @@ Seoul::Console::Console(Genode::Env &env, Genode::Allocator &alloc,
 	_memory(guest_memory),
 	_gui_vesa(area), _gui_non_vesa(area), _gui_non_vesa_ack(area),
 	_input_absolute(area),
-	_vga_vesa(_memory, _binary_mono_tff_start)
+	_vga_vesa(_alloc, _memory, _binary_mono_tff_start)
 { }
@@ -104,6 +104,9 @@ class Seoul::Console : public StaticReceiver<Seoul::Console>
 
 		enum { ID_VGA_VESA = 0 };
 
+		/* number of the polling timer for the framebuffer updates */
+		unsigned timer() const { return _timer; }
+
 		/* bus callbacks */
 		bool receive(MessageConsole &);
 		bool receive(MessageMemRegion &);
@@ -86,6 +86,8 @@ MODEL_INFO(rtl8029, "bdf", "irq", "port")
 MODEL_INFO(virtio_input, "bdf", "irq", "resolution_x", "resolution_y")
 MODEL_INFO(virtio_gpu,   "bdf", "irq")
 MODEL_INFO(virtio_sound, "bdf", "irq")
+MODEL_INFO(virtio_block, "bdf", "irq", "port", "disk")
+MODEL_INFO(virtio_net,   "bdf", "irq", "port")
 
 MODEL_INFO(ide, "port0", "port1", "irq", "bdf", "disk")
 MODEL_INFO(ahci, "mem", "irq", "bdf")
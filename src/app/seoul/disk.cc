@@ -38,32 +38,35 @@ static Genode::Heap * disk_heap_msg(Genode::Env &env)
 	static Genode::Heap heap(&env.ram(), &env.rm(), 4096);
 	return &heap;
 }
-static Genode::Heap * disk_heap_avl(Genode::Env &env)
-{
-	static Genode::Heap heap(&env.ram(), &env.rm(), 4096);
-	return &heap;
-}
 
 
 Seoul::Disk::Disk(Genode::Env &env, Synced_motherboard &mb,
                   Motherboard &unsync_mb, char * backing_store_base,
-                  Genode::size_t backing_store_size)
+                  Genode::size_t backing_store_size,
+                  Genode::size_t tx_buffer_size, bool report_stats)
 :
 	_env(env),
 	_motherboard(mb),
 	_unsynchronized_motherboard(unsync_mb),
 	_backing_store_base(backing_store_base),
 	_backing_store_size(backing_store_size),
-	_tslab_msg(disk_heap_msg(env)),
-	_tslab_avl(disk_heap_avl(env))
+	_tx_buffer_size(tx_buffer_size),
+	_tslab_request(disk_heap_msg(env))
 {
 	/* initialize disk heap */
 	disk_heap(&env.ram(), &env.rm());
 
-	/* initialize struct with 0 size */
+	/* initialize struct with 0 size and all slots free */
 	for (int i=0; i < MAX_DISKS; i++) {
 		_diskcon[i].info.block_size = 0;
+
+		for (unsigned j = 0; j < QUEUE_DEPTH; j++)
+			_diskcon[i].free_slots[j] = QUEUE_DEPTH - 1 - j;
+		_diskcon[i].free_count = QUEUE_DEPTH;
 	}
+
+	if (report_stats)
+		_stats_reporter.construct(env, "disk_stats", "disk_stats");
 }
 
 
@@ -74,82 +77,110 @@ void Seoul::Disk::register_host_operations(Motherboard &motherboard)
 
 void Seoul::Disk_signal::_signal() { _obj.handle_disk(_id); }
 
+
+void Seoul::Disk::_free_request(Request &request)
+{
+	if (request.msg.dma)
+		destroy(disk_heap(), request.msg.dma);
+	request.msg.dma = nullptr;
+
+	destroy(&_tslab_request, &request);
+}
+
+
+bool Seoul::Disk::_complete_read(struct disk_session const &disk,
+                                 Block::Packet_descriptor const &packet,
+                                 Request &request)
+{
+	Block::Session::Tx::Source &source = *disk.blk_con->tx();
+	MessageDisk const &msg = request.msg;
+
+	char * const content = source.packet_content(packet);
+	size_t offset = size_t(msg.sector - packet.block_number())
+	              * disk.info.block_size;
+
+	for (unsigned i = 0; i < msg.dmacount; i++) {
+		char * const dma_addr  = _backing_store_base +
+		                         msg.dma[i].byteoffset + msg.physoffset;
+		size_t const bytecount = msg.dma[i].bytecount;
+
+		/* the descriptors got validated on receive */
+		if (offset > packet.size() || bytecount > packet.size() - offset)
+			return false;
+
+		memcpy(dma_addr, content + offset, bytecount);
+		offset += bytecount;
+	}
+	return true;
+}
+
+
 void Seoul::Disk::handle_disk(unsigned disknr)
 {
-	Block::Session::Tx::Source *source = _diskcon[disknr].blk_con->tx();
+	struct disk_session &disk = _diskcon[disknr];
+	Block::Session::Tx::Source &source = *disk.blk_con->tx();
 
-	while (source->ack_avail())
+	/* complete all acknowledged packets with the motherboard locked once */
+	auto motherboard = _motherboard();
+
+	while (source.ack_avail())
 	{
-		Block::Packet_descriptor packet = source->get_acked_packet();
-		char * const        source_addr = source->packet_content(packet);
+		Block::Packet_descriptor const packet = source.get_acked_packet();
+		unsigned long const slot_index = packet.tag().value;
 
-		/* find the corresponding MessageDisk object */
-		Avl_entry * obj = lookup_and_remove(_lookup_msg, source_addr);
-		if (!obj) {
-			Genode::warning("unknown MessageDisk object - drop ack of block session ", (void *)source_addr);
+		if (slot_index >= QUEUE_DEPTH || !disk.slots[slot_index].count) {
+			Genode::warning("unknown packet tag ", slot_index,
+			                " - drop ack of block session");
+			source.release_packet(packet);
 			continue;
 		}
-		/* got the MessageDisk object */
-		MessageDisk * msg = obj->msg();
-		/* delete helper object */
-		destroy(&_tslab_avl, obj);
 
-		/* go ahead and tell VMM about new block event */
-		if (!packet.succeeded() || 
-		    !(packet.operation() == Block::Packet_descriptor::Opcode::READ ||
-		      packet.operation() == Block::Packet_descriptor::Opcode::WRITE)) {
+		Slot &slot = disk.slots[slot_index];
 
-			Genode::warning("getting block failed");
+		bool const ok = packet.succeeded() &&
+		               (packet.operation() == Block::Packet_descriptor::Opcode::READ ||
+		                packet.operation() == Block::Packet_descriptor::Opcode::WRITE);
+		bool const read = packet.operation() == Block::Packet_descriptor::Opcode::READ;
 
-			MessageDiskCommit mdc(disknr, msg->usertag,
-			                      MessageDisk::DISK_STATUS_DEVICE);
-			_motherboard()->bus_diskcommit.send(mdc);
-	
-		} else {
+		timevalue const now_us = _now_us();
 
-			if (packet.operation() == Block::Packet_descriptor::Opcode::READ) {
+		for (unsigned i = 0; i < slot.count; i++) {
+			Request &request = *slot.requests[i];
 
-				unsigned long long sector = msg->sector;
-				sector = (sector-packet.block_number())
-				       * _diskcon[disknr].info.block_size;
+			if (!ok)
+				disk.stats.errors++;
+			else if (read && !_complete_read(disk, packet, request))
+				Genode::warning("DMA bounds violation during read");
 
-				bool const ok = check_dma_descriptors(msg,
-					[&](char * const dma_addr, unsigned i)
-					{
-						size_t const bytecount = msg->dma[i].bytecount;
+			timevalue const latency_us = now_us - request.start_us;
+			disk.stats.completed++;
+			disk.stats.latency_sum_us += latency_us;
+			if (latency_us > disk.stats.latency_max_us)
+				disk.stats.latency_max_us = latency_us;
 
-						if (bytecount          > packet.size() ||
-						    sector             > packet.size() ||
-						    sector + bytecount > packet.size() ||
-						    source_addr > source->packet_content(packet) + packet.size() - sector - bytecount ||
-						    _backing_store_base + _backing_store_size - bytecount < dma_addr)
-							return false;
+			/* go ahead and tell VMM about new block event */
+			MessageDiskCommit mdc(disknr, request.msg.usertag,
+			                      ok ? MessageDisk::DISK_OK
+			                         : MessageDisk::DISK_STATUS_DEVICE);
+			motherboard->bus_diskcommit.send(mdc);
 
-						memcpy(dma_addr, source_addr + sector, bytecount);
-						sector += bytecount;
-						return true;
-					});
+			_free_request(request);
+		}
 
-				if (!ok)
-					Genode::warning("DMA bounds violation during read");
+		if (!ok)
+			Genode::warning("getting block failed");
 
-				destroy(disk_heap(), msg->dma);
-				msg->dma = nullptr;
-			}
+		slot.count = 0;
+		disk.free_slots[disk.free_count++] = unsigned(slot_index);
+		disk.stats.queued--;
 
-			MessageDiskCommit mdc (disknr, msg->usertag, MessageDisk::DISK_OK);
-			_motherboard()->bus_diskcommit.send(mdc);
-		}
- 
-		{
-			Genode::Mutex::Guard guard(_alloc_mutex);
-			source->release_packet(packet);
-		}
-		destroy(&_tslab_msg, msg);
+		source.release_packet(packet);
 	}
 
-	/* restart disk operations suspended due to out of memory by alloc_packet */
-	check_restart();
+	/* submit requests deferred due to a full queue */
+	_submit_pending(disk);
+
+	_report_stats();
 }
 
 
@@ -172,7 +203,7 @@ bool Seoul::Disk::receive(MessageDisk &msg)
 
 			disk.blk_con =
 				new (disk_heap()) Block::Connection<>(_env, block_alloc,
-				                                      4*512*1024,
+				                                      _tx_buffer_size,
 				                                      label.string());
 			disk.signal =
 				new (disk_heap()) Seoul::Disk_signal(_env.ep(), *this,
@@ -218,217 +249,237 @@ bool Seoul::Disk::receive(MessageDisk &msg)
 
 	case MessageDisk::DISK_READ:
 		/* read and write handling */
-		return execute(msg.type == MessageDisk::DISK_WRITE, disk, msg);
+		return execute(msg.disknr, msg);
 	default:
 		Logging::printf("Got MessageDisk type %x\n", msg.type);
 		return false;
 	}
 }
 
-void Seoul::Disk::check_restart()
+
+void Seoul::Disk::_submit_pending(struct disk_session &disk)
 {
-	bool restarted = true;
+	unsigned long const blk_size = disk.info.block_size;
 
-	while (restarted) {
-		Avl_entry * obj = lookup_and_remove(_restart_msg);
-		if (!obj)
-			return;
+	/* a merged packet must fit into the packet-stream buffer */
+	unsigned long const max_bytes = Genode::min((unsigned long)MAX_MERGE_BYTES,
+	                                            (unsigned long)_tx_buffer_size);
+
+	while (disk.pending_head) {
 
-		MessageDisk       * const   msg = obj->msg();
-		struct disk_session const &disk = _diskcon[msg->disknr];
+		/* collect the run of adjacent requests at the head of the queue */
+		Request           *batch[Slot::MAX_MERGE];
+		unsigned           count       = 0;
+		unsigned long      blocks      = 0;
+		unsigned long      head_blocks = 0;
+		unsigned long long next_sector = 0;
+		bool               aligned     = true;
 
-		restarted = restart(disk, msg);
+		for (Request *r = disk.pending_head; r && count < Slot::MAX_MERGE;
+		     r = r->next) {
 
-		if (restarted) {
-			destroy(&_tslab_avl, obj);
-		} else {
-			Genode::Mutex::Guard guard(_alloc_mutex);
-			_restart_msg.insert(obj);
+			unsigned long const total  = DmaDescriptor::sum_length(r->msg.dmacount,
+			                                                       r->msg.dma);
+			unsigned long const needed = total/blk_size + ((total%blk_size) ? 1 : 0);
+
+			if (count && (!aligned ||
+			              r->msg.type   != batch[0]->msg.type ||
+			              r->msg.sector != next_sector ||
+			              (blocks + needed) * blk_size > max_bytes))
+				break;
+
+			if (!count)
+				head_blocks = needed;
+
+			batch[count++] = r;
+			blocks        += needed;
+			next_sector    = r->msg.sector + needed;
+			aligned        = (total % blk_size) == 0;
+		}
+
+		bool submitted = _submit(disk, batch, count, blocks);
+
+		/*
+		 * Without packets in flight, no acknowledgement triggers a retry.
+		 * The head request fits into the buffer on its own, which got
+		 * checked on receive.
+		 */
+		if (!submitted && count > 1 && disk.free_count == QUEUE_DEPTH) {
+			count     = 1;
+			submitted = _submit(disk, batch, count, head_blocks);
 		}
+
+		/* queue full, retry on the next acknowledgement */
+		if (!submitted)
+			return;
+
+		disk.pending_head = batch[count - 1]->next;
+		if (!disk.pending_head)
+			disk.pending_tail = nullptr;
+
+		disk.stats.pending -= count;
+		disk.stats.merged  += count - 1;
 	}
 }
 
-bool Seoul::Disk::restart(struct disk_session const &disk,
-                          MessageDisk * const msg)
+
+bool Seoul::Disk::_submit(struct disk_session &disk,
+                          Request * const * const batch, unsigned const count,
+                          unsigned long const blocks)
 {
-	Block::Session::Tx::Source * const source = disk.blk_con->tx();
+	Block::Session::Tx::Source &source = *disk.blk_con->tx();
 
-	unsigned long const total    = DmaDescriptor::sum_length(msg->dmacount, msg->dma);
 	unsigned long const blk_size = disk.info.block_size;
-	unsigned long const blocks   = total/blk_size + ((total%blk_size) ? 1 : 0);
-	bool          const write    = msg->type == MessageDisk::DISK_WRITE;
+	bool          const write    = batch[0]->msg.type == MessageDisk::DISK_WRITE;
 
-	Block::Packet_descriptor packet;
+	if (!disk.free_count || !source.ready_to_submit())
+		return false;
 
-	if (!source->ready_to_submit())
-		return false; /* retry later */
+	unsigned const slot_index = disk.free_slots[disk.free_count - 1];
 
-	try {
-		Genode::Mutex::Guard guard(_alloc_mutex);
+	Block::Packet_descriptor packet;
 
+	try {
 		packet = Block::Packet_descriptor(
 			disk.blk_con->alloc_packet(blocks * blk_size),
 			(write) ? Block::Packet_descriptor::WRITE
 			        : Block::Packet_descriptor::READ,
-			msg->sector, blocks);
+			batch[0]->msg.sector, blocks,
+			Block::Packet_descriptor::Tag { slot_index });
+	} catch (...) { return false; }
 
-		char * source_addr = source->packet_content(packet);
-		_lookup_msg.insert(new (&_tslab_avl) Avl_entry(source_addr, msg));
+	if (write) {
+		char * const content = source.packet_content(packet);
 
-	} catch (...) { return false; }
+		for (unsigned i = 0; i < count; i++) {
+			MessageDisk &msg = batch[i]->msg;
 
-	/* read */
-	if (!write) {
-		source->submit_packet(packet);
-		return true;
-	}
+			size_t offset = size_t(msg.sector - packet.block_number()) * blk_size;
 
-	/* write */
-	char * source_addr = source->packet_content(packet);
-	source_addr += (msg->sector - packet.block_number()) * blk_size;
+			/* the copied descriptors got validated on receive */
+			for (unsigned j = 0; j < msg.dmacount; j++) {
+				char * const dma_addr = _backing_store_base +
+				                        msg.dma[j].byteoffset +
+				                        msg.physoffset;
 
-	for (unsigned i = 0; i < msg->dmacount; i++) {
-		char * const dma_addr = _backing_store_base +
-		                        msg->dma[i].byteoffset +
-		                        msg->physoffset;
+				memcpy(content + offset, dma_addr, msg.dma[j].bytecount);
+				offset += msg.dma[j].bytecount;
+			}
 
-		memcpy(source_addr, dma_addr, msg->dma[i].bytecount);
-		source_addr += msg->dma[i].bytecount;
+			/* don't needed anymore + protect us to use it again */
+			destroy(disk_heap(), msg.dma);
+			msg.dma = nullptr;
+		}
 	}
 
-	/* free up DMA descriptors of write */
-	destroy(disk_heap(), msg->dma);
-	msg->dma = nullptr;
+	Slot &slot = disk.slots[slot_index];
+	for (unsigned i = 0; i < count; i++)
+		slot.requests[i] = batch[i];
+	slot.count = count;
+
+	disk.free_count--;
+
+	Stats &stats = disk.stats;
+	stats.packets++;
+	stats.queued++;
+	if (stats.queued > stats.max_queued)
+		stats.max_queued = stats.queued;
+	if (write)
+		stats.write_bytes += blocks * blk_size;
+	else
+		stats.read_bytes  += blocks * blk_size;
 
-	source->submit_packet(packet);
+	source.submit_packet(packet);
 	return true;
 }
 
 
-bool Seoul::Disk::execute(bool const write, struct disk_session const &disk,
-                          MessageDisk const &msg)
+bool Seoul::Disk::execute(unsigned const disknr, MessageDisk const &msg)
 {
-	unsigned long long const sector  = msg.sector;
+	struct disk_session &disk = _diskcon[disknr];
+
 	unsigned long const total    = DmaDescriptor::sum_length(msg.dmacount, msg.dma);
 	unsigned long const blk_size = disk.info.block_size;
 	unsigned long const blocks   = total/blk_size + ((total%blk_size) ? 1 : 0);
 
-	Block::Session::Tx::Source * const source = disk.blk_con->tx();
-	Block::Packet_descriptor packet;
+	/* requests not fitting into the packet stream would never complete */
+	if (blocks * blk_size > _tx_buffer_size) {
+		Logging::printf("disk request too large - blocks=%lu\n", blocks);
+		return false;
+	}
 
 	/* msg copy required for acknowledgements */
-	MessageDisk * const msg_cpy = new (&_tslab_msg) MessageDisk(msg);
-	char * source_addr          = nullptr;
-
-	if (source->ready_to_submit()) {
-		try {
-			Genode::Mutex::Guard guard(_alloc_mutex);
-
-			packet = Block::Packet_descriptor(
-				disk.blk_con->alloc_packet(blocks * blk_size),
-				(write) ? Block::Packet_descriptor::WRITE
-				        : Block::Packet_descriptor::READ,
-				sector, blocks);
-
-			source_addr = source->packet_content(packet);
-
-			_lookup_msg.insert(new (&_tslab_avl) Avl_entry(source_addr, msg_cpy));
-		} catch (Block::Session::Tx::Source::Packet_alloc_failed) {
-			/* msg_cpy object will be used/freed below by copy_dma_descriptors */
-		} catch (...) {
-			if (msg_cpy)
-				destroy(&_tslab_msg, msg_cpy);
-
-			Logging::printf("could not allocate disk block elements - "
-			                "write=%u blocks=%lu\n", write, blocks);
-			return false;
-		}
-	}
+	Request * const request = new (&_tslab_request)
+		Request { msg, _now_us(), nullptr };
 
 	/*
-	 * Copy DMA descriptors ever for read requests and for deferred write
-	 * requests. The descriptors can be changed by the guest at any time.
+	 * Copy DMA descriptors, which can be changed by the guest at any time,
+	 * and validate them once.
 	 */
-	bool const copy_dma_descriptors = !source_addr || !write;
-
-	/* invalid packet allocation or read request */
-	if (copy_dma_descriptors) {
-		msg_cpy->dma = new (disk_heap()) DmaDescriptor[msg_cpy->dmacount];
-		for (unsigned i = 0; i < msg_cpy->dmacount; i++)
-			memcpy(msg_cpy->dma + i, msg.dma + i, sizeof(DmaDescriptor));
-
-		/* validate DMA descriptors */
-		bool const ok = check_dma_descriptors(msg_cpy,
-			[&](char * const dma_addr, unsigned i)
-			{
-				if (!write)
-					/* evaluated during receive */
-					return true;
-
-				size_t const bytecount = msg_cpy->dma[i].bytecount;
-
-				if (bytecount > packet.size() ||
-				    source_addr > source->packet_content(packet) + packet.size() - bytecount ||
-				    _backing_store_base + _backing_store_size - bytecount < dma_addr)
-					return false;
-
-				return true;
-			});
+	request->msg.dma = new (disk_heap()) DmaDescriptor[msg.dmacount];
+	for (unsigned i = 0; i < msg.dmacount; i++)
+		memcpy(request->msg.dma + i, msg.dma + i, sizeof(DmaDescriptor));
 
-		if (ok) {
-			/* DMA descriptors look good - go ahead with disk request */
-
-			if (source_addr)
-				/* valid packet for read request */
-				source->submit_packet(packet);
-			else {
-				/* failed packet allocation, restart at later point in time */
-				Genode::Mutex::Guard guard(_alloc_mutex);
-				_restart_msg.insert(new (&_tslab_avl) Avl_entry(source_addr,
-				                                                msg_cpy));
-			}
-			return true;
-		}
-
-		/* DMA descriptors look bad - free resources */
-		destroy(disk_heap(), msg_cpy->dma);
-		destroy(&_tslab_msg, msg_cpy);
-		if (source_addr) {
-			Genode::Mutex::Guard guard(_alloc_mutex);
-			source->release_packet(packet);
-		}
+	if (!check_dma_descriptors(request->msg)) {
+		_free_request(*request);
 		return false;
 	}
 
-	/* valid packet allocation for write request */
-	source_addr += (sector - packet.block_number()) * blk_size;
+	disk.stats.requests++;
 
-	bool const ok = check_dma_descriptors(msg_cpy,
-		[&](char * const dma_addr, unsigned i)
-	{
-		/* read bytecount from guest memory once and don't evaluate again */
-		size_t const bytecount = msg.dma[i].bytecount;
+	/* enqueue in guest order, a lone request is submitted right away */
+	if (disk.pending_tail)
+		disk.pending_tail->next = request;
+	else
+		disk.pending_head = request;
+	disk.pending_tail = request;
 
-		if (bytecount > packet.size() ||
-		    source_addr > source->packet_content(packet) + packet.size() - bytecount ||
-		    _backing_store_base + _backing_store_size - bytecount < dma_addr)
-			return false;
+	disk.stats.pending++;
+	if (disk.stats.pending > disk.stats.max_pending)
+		disk.stats.max_pending = disk.stats.pending;
 
-		memcpy(source_addr, dma_addr, bytecount);
-		source_addr += bytecount;
+	_submit_pending(disk);
 
-		return true;
-	});
+	return true;
+}
 
-	if (ok) {
-		/* don't needed anymore + protect us to use it again */
-		msg_cpy->dma = nullptr;
-		source->submit_packet(packet);
-	} else {
-		destroy(&_tslab_msg, msg_cpy);
 
-		Genode::Mutex::Guard guard(_alloc_mutex);
-		source->release_packet(packet);
-	}
-	return ok;
+void Seoul::Disk::_report_stats()
+{
+	if (!_stats_reporter.constructed())
+		return;
+
+	timevalue const now_us = _now_us();
+	if (now_us - _stats_reported_us < 1000 * 1000)
+		return;
+
+	_stats_reported_us = now_us;
+
+	_stats_reporter->generate([&] (Genode::Xml_generator &xml) {
+		for (unsigned i = 0; i < MAX_DISKS; i++) {
+			struct disk_session const &disk = _diskcon[i];
+			if (!disk.info.block_size)
+				continue;
+
+			Stats const &stats = disk.stats;
+
+			xml.node("disk", [&] () {
+				xml.attribute("id",             i);
+				xml.attribute("requests",       stats.requests);
+				xml.attribute("merged",         stats.merged);
+				xml.attribute("packets",        stats.packets);
+				xml.attribute("errors",         stats.errors);
+				xml.attribute("read_bytes",     stats.read_bytes);
+				xml.attribute("write_bytes",    stats.write_bytes);
+				xml.attribute("queued",         stats.queued);
+				xml.attribute("max_queued",     stats.max_queued);
+				xml.attribute("pending",        stats.pending);
+				xml.attribute("max_pending",    stats.max_pending);
+				xml.attribute("latency_avg_us", stats.completed
+				                                ? stats.latency_sum_us / stats.completed
+				                                : 0);
+				xml.attribute("latency_max_us", stats.latency_max_us);
+			});
+		}
+	});
 }
@@ -27,6 +27,7 @@
 #include <block_session/connection.h>
 #include <util/string.h>
 #include <base/synced_allocator.h>
+#include <os/reporter.h>
 
 /* local includes */
 #include "synced_motherboard.h"
@@ -70,44 +71,59 @@ class Seoul::Disk : public StaticReceiver<Seoul::Disk>
 
 		Genode::Env &_env;
 
-		/* helper class to lookup a MessageDisk object */
-		class Avl_entry : public Genode::Avl_node<Avl_entry>
-		{
-
-			private:
-
-				Genode::addr_t  const _key;
-				MessageDisk   * const _msg;
-
-				/*
-				 * Noncopyable
-				 */
-				Avl_entry(Avl_entry const &);
-				Avl_entry &operator = (Avl_entry const &);
+		/*
+		 * All state of the disk bridge is accessed with the motherboard
+		 * mutex held. Device models call 'receive' from within the
+		 * motherboard and 'handle_disk' acquires the mutex.
+		 */
 
-			public:
+		/* guest request kept until its completion */
+		struct Request
+		{
+			MessageDisk  msg;
+			timevalue    start_us;
+			Request     *next;
+		};
 
-				Avl_entry(void * key, MessageDisk * const msg)
-				 : _key(reinterpret_cast<Genode::addr_t>(key)), _msg(msg) { }
+		/*
+		 * Block packet in flight
+		 *
+		 * The slot index is stored in the tag of the packet, which makes
+		 * finding the guest requests of an acknowledgement a plain array
+		 * access. Adjacent requests of the guest are merged into one packet.
+		 */
+		struct Slot
+		{
+			enum { MAX_MERGE = 16 };
 
-				bool higher(Avl_entry *e) const { return e->_key > _key; }
+			Request  *requests[MAX_MERGE];
+			unsigned  count;
+		};
 
-				Avl_entry *find(Genode::addr_t ptr)
-				{
-					if (ptr == _key) return this;
-					Avl_entry *obj = this->child(ptr > _key);
-					return obj ? obj->find(ptr) : 0;
-				}
-		
-				MessageDisk * msg() { return _msg; }
+		struct Stats
+		{
+			uint64   requests, merged, packets, errors;
+			uint64   read_bytes, write_bytes;
+			uint64   completed, latency_sum_us, latency_max_us;
+			unsigned queued, max_queued, pending, max_pending;
 		};
 
 		/* block session used by disk models of VMM */
-		enum { MAX_DISKS = 4 };
+		enum { MAX_DISKS = 4, QUEUE_DEPTH = 128, MAX_MERGE_BYTES = 256*1024 };
 		struct disk_session {
 			Block::Connection<> *blk_con;
 			Block::Session::Info info;
 			Disk_signal         *signal;
+
+			Slot                 slots[QUEUE_DEPTH];
+			unsigned             free_slots[QUEUE_DEPTH];
+			unsigned             free_count;
+
+			/* requests not submitted yet, in the order issued by the guest */
+			Request             *pending_head;
+			Request             *pending_tail;
+
+			Stats                stats;
 		} _diskcon[MAX_DISKS] { };
 
 		Synced_motherboard &_motherboard;
@@ -116,22 +132,16 @@ class Seoul::Disk : public StaticReceiver<Seoul::Disk>
 		char        * const _backing_store_base;
 		size_t        const _backing_store_size;
 
-		/* slabs for temporary holding MessageDisk objects */
-		typedef Genode::Tslab<MessageDisk, 128> MessageDisk_Slab;
-		typedef Genode::Synced_allocator<MessageDisk_Slab> MessageDisk_Slab_Sync;
+		Genode::size_t const _tx_buffer_size;
 
-		MessageDisk_Slab_Sync _tslab_msg;
+		/* slab for holding the requests */
+		typedef Genode::Tslab<Request, 4096> Request_slab;
+		typedef Genode::Synced_allocator<Request_slab> Request_slab_sync;
 
-		/* Structure to find back the MessageDisk object out of a Block Ack */
-		typedef Genode::Tslab<Avl_entry, 128> Avl_entry_slab;
-		typedef Genode::Synced_allocator<Avl_entry_slab> Avl_entry_slab_sync;
+		Request_slab_sync _tslab_request;
 
-		Avl_entry_slab_sync _tslab_avl;
-
-		Genode::Avl_tree<Avl_entry> _lookup_msg  { };
-		Genode::Avl_tree<Avl_entry> _restart_msg { };
-		/* _alloc_mutex protects both lists + alloc_packet/release_packet !!! */
-		Genode::Mutex               _alloc_mutex { };
+		Genode::Constructible<Genode::Expanding_reporter> _stats_reporter { };
+		timevalue _stats_reported_us { 0 };
 
 		/*
 		 * Noncopyable
@@ -139,55 +149,49 @@ class Seoul::Disk : public StaticReceiver<Seoul::Disk>
 		Disk(Disk const &);
 		Disk &operator = (Disk const &);
 
-		void check_restart();
-		bool restart(struct disk_session const &, MessageDisk * const);
-		bool execute(bool const write, struct disk_session const &,
-		             MessageDisk const &);
+		timevalue _now_us() {
+			return _unsynchronized_motherboard.clock()->clock(1000 * 1000); }
+
+		bool execute(unsigned disknr, MessageDisk const &);
 
-		template <typename FN>
-		bool check_dma_descriptors(MessageDisk const * const msg,
-		                           FN const &fn)
+		void _submit_pending(struct disk_session &);
+		bool _submit(struct disk_session &, Request * const *, unsigned,
+		             unsigned long);
+		bool _complete_read(struct disk_session const &,
+		                    Block::Packet_descriptor const &, Request &);
+		void _free_request(Request &);
+		void _report_stats();
+
+		/* check that all DMA descriptors stay within the guest memory */
+		bool check_dma_descriptors(MessageDisk const &msg)
 		{
-			/* check bounds for read and write operations */
-			for (unsigned i = 0; i < msg->dmacount; i++) {
+			for (unsigned i = 0; i < msg.dmacount; i++) {
 				char * const dma_addr = _backing_store_base +
-				                        msg->dma[i].byteoffset +
-				                        msg->physoffset;
+				                        msg.dma[i].byteoffset +
+				                        msg.physoffset;
 
-				/* check for bounds */
-				if (dma_addr >= _backing_store_base + _backing_store_size ||
-				    dma_addr < _backing_store_base)
-					return false;
+				size_t const bytecount = msg.dma[i].bytecount;
 
-				if (!fn(dma_addr, i))
+				if (dma_addr >= _backing_store_base + _backing_store_size ||
+				    dma_addr < _backing_store_base ||
+				    bytecount > _backing_store_size ||
+				    _backing_store_base + _backing_store_size - bytecount < dma_addr)
 					return false;
 			}
 			return true;
 		}
 
-		/* find the corresponding MessageDisk object */
-		Avl_entry * lookup_and_remove(Genode::Avl_tree<Avl_entry> &tree,
-		                              void * specific_obj = nullptr)
-		{
-			Genode::Mutex::Guard guard(_alloc_mutex);
-
-			Avl_entry * obj = tree.first();
-			if (obj && specific_obj)
-				obj = obj->find(reinterpret_cast<Genode::addr_t>(specific_obj));
-
-			if (obj)
-				tree.remove(obj);
-
-			return obj;
-		}
-
 	public:
 
 		/**
 		 * Constructor
+		 *
+		 * \param tx_buffer_size  size of the packet-stream buffer per disk
+		 * \param report_stats    periodically report per-disk statistics
 		 */
 		Disk(Genode::Env &, Synced_motherboard &, Motherboard &,
-		     char * backing_store_base, Genode::size_t backing_store_size);
+		     char * backing_store_base, Genode::size_t backing_store_size,
+		     Genode::size_t tx_buffer_size, bool report_stats);
 
 		void handle_disk(unsigned);
 
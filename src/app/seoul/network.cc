@@ -40,27 +40,54 @@ Seoul::Network::Network(Genode::Env &env, Genode::Heap &heap,
 }
 
 
+void Seoul::Network::_count_drop(Genode::uint64_t &counter, char const *reason)
+{
+	counter++;
+
+	/* log the first drop and then at each power of two only */
+	if (counter & (counter - 1))
+		return;
+
+	Genode::warning("network: ", reason, " - ", counter, " frames dropped, ",
+	                _stats.tx, " sent, ", _stats.rx, " received");
+}
+
+
 void Seoul::Network::_handle_rx()
 {
-	while (_nic.rx()->packet_avail()) {
+	unsigned frames = 0;
 
-		if (!_nic.rx()->ready_to_ack()) {
-			Genode::warning("network: not ready for receive ack");
-			break;
-		}
+	{
+		/* deliver the whole batch with one acquisition of the lock */
+		auto motherboard = _motherboard();
 
-		Nic::Packet_descriptor rx_packet = _nic.rx()->get_packet();
+		while (_nic.rx()->packet_avail() && _nic.rx()->ready_to_ack()) {
 
-		/* send it to the network bus */
-		char * rx_content = _nic.rx()->packet_content(rx_packet);
-		_forward_pkt = rx_content;
-		MessageNetwork msg((unsigned char *)rx_content, rx_packet.size(), 0);
-		_motherboard()->bus_network.send(msg);
-		_forward_pkt = 0;
+			if (frames == RX_BATCH) {
+				/* let the vCPUs in, continue with the next batch */
+				_rx_handler.local_submit();
+				break;
+			}
 
-		/* acknowledge received packet */
-		_nic.rx()->acknowledge_packet(rx_packet);
+			Nic::Packet_descriptor const rx_packet = _nic.rx()->get_packet();
+
+			/* send it to the network bus */
+			char * rx_content = _nic.rx()->packet_content(rx_packet);
+			_forward_pkt = rx_content;
+			MessageNetwork msg((unsigned char *)rx_content, rx_packet.size(), 0);
+			motherboard->bus_network.send(msg);
+			_forward_pkt = 0;
+
+			/* acknowledge received packet, the server is woken up once */
+			_nic.rx()->try_ack_packet(rx_packet);
+			frames++;
+		}
+
+		_stats.rx += frames;
 	}
+
+	if (frames)
+		_nic.rx()->wakeup();
 }
 
 
@@ -74,18 +101,29 @@ void Seoul::Network::_handle_tx()
 }
 
 
+void Seoul::Network::_wakeup_tx()
+{
+	/* one drain of acknowledgements per batch */
+	_handle_tx();
+
+	_tx_unsignalled = 0;
+	_nic.tx()->wakeup();
+}
+
+
 bool Seoul::Network::transmit(void const * const packet, Genode::size_t len)
 {
 	if (packet == _forward_pkt)
 		/* don't end in an endless forwarding loop */
 		return false;
 
-	/* check for acknowledgements */
-	_handle_tx();
+	/* complete the batch early if it got large or the queue is full */
+	if (!_nic.tx()->ready_to_submit() || _tx_unsignalled >= TX_BATCH)
+		_wakeup_tx();
 
 	/* exception is no option */
 	if (!_nic.tx()->ready_to_submit()) {
-		Genode::warning("network: congested - submit issue\n");
+		_count_drop(_stats.tx_congested, "congested - submit issue");
 		return false;
 	}
 
@@ -94,15 +132,36 @@ bool Seoul::Network::transmit(void const * const packet, Genode::size_t len)
 	try {
 		tx_packet = _nic.tx()->alloc_packet(len);
 	} catch (Nic::Session::Tx::Source::Packet_alloc_failed) {
-		Genode::warning("network: congested - alloc issue\n");
-		return false;
+		/* acknowledged packets may free enough space */
+		_handle_tx();
+		try {
+			tx_packet = _nic.tx()->alloc_packet(len);
+		} catch (Nic::Session::Tx::Source::Packet_alloc_failed) {
+			_count_drop(_stats.tx_alloc_failed, "congested - alloc issue");
+			return false;
+		}
 	}
 
-	/* fill packet with content */
+	/* copy frame, which virtio_net passes straight from guest memory */
 	char * const tx_content = _nic.tx()->packet_content(tx_packet);
 	memcpy(tx_content, packet, len);
 
-	_nic.tx()->submit_packet(tx_packet);
+	_nic.tx()->try_submit_packet(tx_packet);
+	_tx_unsignalled = _tx_unsignalled + 1;
+	_stats.tx++;
 
 	return true;
 }
+
+
+void Seoul::Network::flush_tx()
+{
+	/* unlocked peek, a missed batch gets flushed after the next VM exit */
+	if (!_tx_unsignalled)
+		return;
+
+	auto motherboard = _motherboard();
+
+	if (_tx_unsignalled)
+		_wakeup_tx();
+}
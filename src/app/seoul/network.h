@@ -43,17 +43,32 @@ class Seoul::Network
 		enum {
 			PACKET_SIZE = Nic::Packet_allocator::DEFAULT_PACKET_SIZE,
 			BUF_SIZE    = Nic::Session::QUEUE_SIZE * PACKET_SIZE,
+
+			/* frames handled per motherboard lock and per server wakeup */
+			RX_BATCH    = 64,
+			TX_BATCH    = 32,
 		};
 
 		Synced_motherboard   &_motherboard;
 		Nic::Packet_allocator _tx_block_alloc;
 		Nic::Connection       _nic;
 
-		Genode::Signal_handler<Network> const _rx_handler;
-		void const *                          _forward_pkt = nullptr;
+		Genode::Signal_handler<Network> _rx_handler;
+		void const *                    _forward_pkt = nullptr;
+
+		/* frames submitted since the last wakeup of the Nic server */
+		unsigned volatile _tx_unsignalled { 0 };
+
+		struct Stats
+		{
+			Genode::uint64_t rx, tx;
+			Genode::uint64_t tx_congested, tx_alloc_failed;
+		} _stats { };
 
 		void _handle_rx();
 		void _handle_tx();
+		void _wakeup_tx();
+		void _count_drop(Genode::uint64_t &, char const *);
 
 		/*
 		 * Noncopyable
@@ -67,7 +82,21 @@ class Seoul::Network
 
 		Nic::Mac_address mac_address() { return _nic.mac_address(); }
 
+		/**
+		 * Submit frame to the Nic session
+		 *
+		 * Must be called with the motherboard lock held. The server is
+		 * woken up once per 'TX_BATCH' frames or on 'flush_tx'.
+		 */
 		bool transmit(void const * const packet, Genode::size_t len);
+
+		/**
+		 * Wake up the Nic server for frames submitted by 'transmit'
+		 *
+		 * Called by the vCPUs after each VM exit, which completes the
+		 * batch of frames sent by the guest NIC model.
+		 */
+		void flush_tx();
 };
 
 #endif /* _NETWORK_H_ */
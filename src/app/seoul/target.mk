@@ -7,6 +7,7 @@ SEOUL_GENODE_DIR  = $(SEOUL_CONTRIB_DIR)/genode
 LIBS   += base blit seoul_libc_support format
 SRC_CC  = component.cc user_env.cc device_model_registry.cc state.cc
 SRC_CC += console.cc keyboard.cc network.cc disk.cc vga_vesa.cc audio.cc
+SRC_CC += virtio_block.cc virtio_net.cc
 SRC_BIN = mono.tff
 
 MODEL_SRC_CC    += $(notdir $(wildcard $(SEOUL_CONTRIB_DIR)/model/*.cc))
@@ -0,0 +1,254 @@
+/*
+ * \brief  Accounting of VM exits per vCPU
+ * \author agent
+ * \date   2026-10-19
+ *
+ * The counters are updated solely by the vCPU thread and read without
+ * synchronization when reported, so a report may be off by the exits
+ * handled meanwhile.
+ */
+
+/*
+ * Copyright (C) 2026 agent
+ *
+ * This file is distributed under the terms of the GNU General Public License
+ * version 2.
+ */
+
+#ifndef _VCPU_STATS_H_
+#define _VCPU_STATS_H_
+
+/* Genode includes */
+#include <util/misc_math.h>
+#include <util/xml_generator.h>
+
+namespace Seoul {
+	struct Vcpu_stats;
+}
+
+
+struct Seoul::Vcpu_stats
+{
+	enum Type { IO, MMIO, NPT, CPUID, HLT, MSR, RDTSC, CR, IRQ_WINDOW,
+	            RECALL, INVALID, OTHER, TYPES };
+
+	enum {
+		/* bucket 0 counts exits below 1 us, bucket i below 2^i us */
+		BUCKETS    = 16,
+		TOP_N      = 8,
+		TABLE_SIZE = 64,
+	};
+
+	static char const *name(Type const type)
+	{
+		switch (type) {
+		case IO:         return "io";
+		case MMIO:       return "mmio";
+		case NPT:        return "npt";
+		case CPUID:      return "cpuid";
+		case HLT:        return "hlt";
+		case MSR:        return "msr";
+		case RDTSC:      return "rdtsc";
+		case CR:         return "cr";
+		case IRQ_WINDOW: return "irq_window";
+		case RECALL:     return "recall";
+		case INVALID:    return "invalid";
+		case OTHER:
+		case TYPES:      break;
+		}
+		return "other";
+	}
+
+	static Type svm_type(unsigned const exit)
+	{
+		switch (exit) {
+		case 0x00 ... 0x1f: return CR;
+		case 0x62:
+		case 0x64:          return IRQ_WINDOW;
+		case 0x6e:          return RDTSC;
+		case 0x72:          return CPUID;
+		case 0x78:          return HLT;
+		case 0x7b:          return IO;
+		case 0x7c:          return MSR;
+		case 0xfc:          return NPT;
+		case 0xfd:          return INVALID;
+		case 0xff:          return RECALL;
+		}
+		return OTHER;
+	}
+
+	static Type vmx_type(unsigned const exit)
+	{
+		switch (exit) {
+		case 0x07: return IRQ_WINDOW;
+		case 0x0a: return CPUID;
+		case 0x0c: return HLT;
+		case 0x10: return RDTSC;
+		case 0x1c: return CR;
+		case 0x1e: return IO;
+		case 0x1f:
+		case 0x20: return MSR;
+		case 0x21: return INVALID;
+		case 0x30: return NPT;
+		case 0xff: return RECALL;
+		}
+		return OTHER;
+	}
+
+	struct Exit
+	{
+		Genode::uint64_t count, ticks, max_ticks;
+		Genode::uint64_t histogram[BUCKETS];
+	};
+
+	/**
+	 * Table of the most frequent addresses
+	 *
+	 * The table follows the space-saving algorithm. Once the table is full,
+	 * an address not present replaces the entry with the lowest count and
+	 * inherits this count as 'error'. So the addresses accessed most often
+	 * in the long run enter the table even after boot-time probing filled
+	 * it. The reported count of an entry exceeds the actual number of
+	 * accesses by at most its error.
+	 */
+	struct Hot_table
+	{
+		struct Entry { Genode::uint64_t key, count, error; } entries[TABLE_SIZE] { };
+
+		void count(Genode::uint64_t const key)
+		{
+			Entry *min = &entries[0];
+
+			for (Entry &e : entries) {
+				if (e.count && e.key == key) {
+					e.count++;
+					return;
+				}
+				if (e.count < min->count)
+					min = &e;
+			}
+
+			/* an unused entry has the lowest count of zero */
+			min->error = min->count;
+			min->key   = key;
+			min->count++;
+		}
+
+		/**
+		 * Call 'fn(key, count, error)' for the 'TOP_N' entries in descending
+		 * order
+		 */
+		template <typename FN>
+		void for_each_top(FN const &fn) const
+		{
+			Genode::uint64_t last_count = ~0ULL;
+			Genode::uint64_t last_key   = 0;
+
+			for (unsigned n = 0; n < TOP_N; n++) {
+				Entry const *top = nullptr;
+
+				for (Entry const &e : entries) {
+					/* order by count and key, which are unique together */
+					bool const below = e.count < last_count ||
+					                   (e.count == last_count && e.key > last_key);
+
+					if (e.count && below && (!top || e.count > top->count ||
+					    (e.count == top->count && e.key < top->key)))
+						top = &e;
+				}
+
+				if (!top)
+					return;
+
+				fn(top->key, top->count, top->error);
+				last_count = top->count;
+				last_key   = top->key;
+			}
+		}
+	};
+
+	Genode::uint64_t const ticks_per_us;
+
+	Exit      exits[TYPES] { };
+	Hot_table io_ports     { };
+	Hot_table mmio         { };
+
+	/* set when the current NPT/EPT exit turns out to be an MMIO access */
+	bool      mmio_access  { false };
+
+	/**
+	 * Constructor
+	 *
+	 * \param tsc_freq  frequency of the time stamps in Hz
+	 */
+	Vcpu_stats(Genode::uint64_t tsc_freq) : ticks_per_us(tsc_freq / (1000 * 1000)) { }
+
+	void account(Type type, Genode::uint64_t const ticks)
+	{
+		if (type == NPT && mmio_access)
+			type = MMIO;
+		mmio_access = false;
+
+		Exit &exit = exits[type];
+		exit.count++;
+		exit.ticks += ticks;
+		if (ticks > exit.max_ticks)
+			exit.max_ticks = ticks;
+
+		Genode::uint64_t const us = ticks_per_us ? ticks / ticks_per_us : 0;
+		unsigned const bucket = us ? unsigned(Genode::log2(us)) + 1 : 0;
+
+		exit.histogram[Genode::min(bucket, unsigned(BUCKETS - 1))]++;
+	}
+
+	void generate(Genode::Xml_generator &xml) const
+	{
+		auto us = [&] (Genode::uint64_t ticks) {
+			return ticks_per_us ? ticks / ticks_per_us : 0; };
+
+		for (unsigned t = 0; t < TYPES; t++) {
+			Exit const &exit = exits[t];
+			if (!exit.count)
+				continue;
+
+			xml.node("exit", [&] () {
+				xml.attribute("type",     name(Type(t)));
+				xml.attribute("count",    exit.count);
+				xml.attribute("total_us", us(exit.ticks));
+				xml.attribute("max_us",   us(exit.max_ticks));
+
+				for (unsigned b = 0; b < BUCKETS; b++) {
+					if (!exit.histogram[b])
+						continue;
+
+					xml.node("bucket", [&] () {
+						xml.attribute("from_us", b ? 1ULL << (b - 1) : 0ULL);
+						xml.attribute("count",   exit.histogram[b]);
+					});
+				}
+			});
+		}
+
+		io_ports.for_each_top([&] (Genode::uint64_t port, Genode::uint64_t count,
+		                           Genode::uint64_t error) {
+			xml.node("io_port", [&] () {
+				xml.attribute("port",  Genode::String<8>(Genode::Hex(port)));
+				xml.attribute("count", count);
+				if (error)
+					xml.attribute("error", error);
+			});
+		});
+
+		mmio.for_each_top([&] (Genode::uint64_t addr, Genode::uint64_t count,
+		                       Genode::uint64_t error) {
+			xml.node("mmio", [&] () {
+				xml.attribute("addr",  Genode::String<20>(Genode::Hex(addr)));
+				xml.attribute("count", count);
+				if (error)
+					xml.attribute("error", error);
+			});
+		});
+	}
+};
+
+#endif /* _VCPU_STATS_H_ */
@@ -23,15 +23,112 @@
 #include "vga_vesa.h"
 
 
+Genode::Color Seoul::Vga_vesa::_text_color(unsigned value)
+{
+	if (value == 0x8) value = 0x7;
+
+	unsigned lum = ((value & 0x8) >> 3)*127;
+	return Genode::Color(((value & 0x4) >> 2)*127+lum, /* R+luminosity */
+	                     ((value & 0x2) >> 1)*127+lum, /* G+luminosity */
+	                     ((value & 0x1) >> 0)*127+lum  /* B+luminosity */);
+}
+
+
+void Seoul::Vga_vesa::_render_glyphs()
+{
+	Pixel_rgb888 cell[CELL_W * CELL_H];
+
+	Genode::Surface<Pixel_rgb888> surface(cell, Gui::Area(CELL_W, CELL_H));
+	Genode::Color const white(255, 255, 255);
+
+	for (unsigned c = 0; c < 256; c++) {
+
+		Genode::memset(cell, 0, sizeof(cell));
+
+		auto box = [&] (int x, int y, unsigned w, unsigned h) {
+			Box_painter::paint(surface, Gui::Rect(Gui::Point(x, y),
+			                                      Gui::Area(w, h)), white); };
+
+		switch (c) {
+		case 0xb3: /* | */
+			box(2, 0, 2, 15);
+			break;
+		case 0xb4: /* -| */
+			box(0, 7, 3, 2); box(2, 0, 2, 15);
+			break;
+		case 0xbf: /* -. */
+			box(0, 7, 3, 2); box(2, 8, 2, 8);
+			break;
+		case 0xc3: /* |- */
+			box(2, 7, 6, 2); box(2, 0, 2, 15);
+			break;
+		case 0xc4: /* - */
+			box(0, 7, 8, 2);
+			break;
+		case 0xc0: /* '- */
+			box(2, 7, 6, 2); box(2, 0, 2, 8);
+			break;
+		case 0xda: /* .- */
+			box(2, 7, 6, 2); box(2, 8, 2, 8);
+			break;
+		case 0xd9: /* -' */
+			box(0, 7, 3, 2); box(2, 0, 2, 8);
+			break;
+		default:
+		{
+			char const buffer[2] = { char(c), 0 };
+			Text_painter::paint(surface, Text_painter::Position(0, 0),
+			                    _default_font, white, buffer);
+			break;
+		}
+		}
+
+		/* white on black, so any channel yields the coverage */
+		for (unsigned i = 0; i < CELL_W * CELL_H; i++)
+			_glyph_alpha[c][i / CELL_W][i % CELL_W] = uint8(cell[i].r());
+	}
+}
+
+
+void Seoul::Vga_vesa::_paint_cell(Genode::Surface<Pixel_rgb888> &surface,
+                                  unsigned const col, unsigned const row,
+                                  uint16 const cell)
+{
+	uint8 const character  = uint8(cell & 0xff);
+	uint8 const colorvalue = uint8(cell >> 8);
+
+	Genode::Color const bg = _text_color((colorvalue & 0xf0) >> 4);
+	Genode::Color const fg = _text_color(colorvalue & 0xf);
+
+	Pixel_rgb888 const bg_pixel(bg.r, bg.g, bg.b);
+	Pixel_rgb888 const fg_pixel(fg.r, fg.g, fg.b);
+
+	unsigned const w = surface.size().w();
+
+	Pixel_rgb888 *line = surface.addr() + row * CELL_H * w + col * CELL_W;
+
+	for (unsigned y = 0; y < CELL_H; y++, line += w) {
+		uint8 const * const alpha = _glyph_alpha[character][y];
+
+		for (unsigned x = 0; x < CELL_W; x++)
+			line[x] = alpha[x] == 0   ? bg_pixel
+			        : alpha[x] == 255 ? fg_pixel
+			        : Pixel_rgb888::mix(bg_pixel, fg_pixel, alpha[x]);
+	}
+}
+
+
 Genode::Milliseconds Seoul::Vga_vesa::_handle_vga_mode(Backend_gui &gui,
                                                        bool const cpus_active)
 {
 	bool const skip_update = _fb_state.vga_off;
 
-	Genode::Color cursor_color(255,255,255);
-	bool          cursor_show = false;
-	int           cursor_x    = 0;
-	int           cursor_y    = 0;
+	/* text output overwrites the VESA content */
+	_tiles_valid = false;
+
+	int  cursor_x    = 0;
+	int  cursor_y    = 0;
+	bool cursor_show = false;
 
 	if (skip_update || !cpus_active) {
 		_fb_state.idle ++;
@@ -39,163 +136,101 @@ Genode::Milliseconds Seoul::Vga_vesa::_handle_vga_mode(Backend_gui &gui,
 	} else
 		_fb_state.idle = 0;
 
-	/* calculate cursor position, get color during loop below */
+	/* text mode requires the GUI buffer to cover all cells */
+	if (gui.fb_mode.area.w() < TEXT_COLS * CELL_W ||
+	    gui.fb_mode.area.h() < TEXT_ROWS * CELL_H)
+		return Milliseconds(0ULL);
+
+	/* calculate cursor position */
 	if (_regs->cursor_pos > _regs->offset) {
 		int pos = int(_regs->cursor_pos - _regs->offset);
-		cursor_x = pos % 80;
-		cursor_y = pos / 80;
+		cursor_x = pos % TEXT_COLS;
+		cursor_y = pos / TEXT_COLS;
 
-		cursor_show = cursor_y < 25;
+		cursor_show = cursor_y < TEXT_ROWS;
 	}
 
-	if (_fb_state.cmp_even)
-		_fb_state.checksum1 = 0;
-	else
-		_fb_state.checksum2 = 0;
+	/* repaint the cell below a previously drawn cursor */
+	int const repaint = (_last_cursor.blink && _text_shadow_valid)
+	                  ? _last_cursor.y * TEXT_COLS + _last_cursor.x : -1;
 
 	Genode::Surface<Pixel_rgb888> _surface(reinterpret_cast<Pixel_rgb888 *>(gui.pixels),
 	                                       gui.fb_mode.area);
 
-	for (int y = 0; y < 25; y++) {
-		for (int x = 0; x < 80; x++) {
-
-			Text_painter::Position const where(x*8, y*15);
-			auto  const pos_char   = _guest_fb+(_regs->offset << 1)
-			                       + y * 80 * 2 + x * 2;
-			uint8 const character  = *(uint8 *) (pos_char);
-			auto  const colorvalue = *(pos_char + 1);
-
-			char buffer[2] = { *pos_char, 0 };
-
-			{
-				char bg = (colorvalue & 0xf0) >> 4;
-				if (bg == 0x8) bg = 0x7;
-
-				unsigned lum = ((bg & 0x8) >> 3)*127;
-				Genode::Color color(((bg & 0x4) >> 2)*127+lum, /* R+luminosity */
-				                    ((bg & 0x2) >> 1)*127+lum, /* G+luminosity */
-				                    ((bg & 0x1) >> 0)*127+lum  /* B+luminosity */);
-
-				Gui::Rect rect(Gui::Point(x * 8, y * 15),
-				               Gui::Area(8, 15));
-				Box_painter::paint(_surface, rect, color);
-			}
-
-			char fg = colorvalue & 0xf;
-			if (fg == 0x8) fg = 0x7;
-			unsigned lum = ((fg & 0x8) >> 3)*127;
-			Genode::Color color(((fg & 0x4) >> 2)*127+lum, /* R+luminosity */
-			                    ((fg & 0x2) >> 1)*127+lum, /* G+luminosity */
-			                    ((fg & 0x1) >> 0)*127+lum  /* B+luminosity */);
-
-			/* get cursor color */
-			if (cursor_x == x && cursor_y == y)
-				cursor_color = color;
-
-			switch (character) {
-			case 0xb3: { /* | */
-				Gui::Rect rect(Gui::Point(x*8 + 2, y*15 + 0), Gui::Area(2, 15));
-				Box_painter::paint(_surface, rect, color);
-				break;
-			}
-			case 0xb4: { /* -| */
-				Gui::Rect rect(Gui::Point(x*8 + 0, y*15 + 7), Gui::Area(3, 2));
-				Box_painter::paint(_surface, rect, color);
-				rect = Gui::Rect(Gui::Point(x*8 + 2, y*15 + 0), Gui::Area(2, 15));
-				Box_painter::paint(_surface, rect, color);
-				break;
-			}
-			case 0xbf: { /* -. */
-				Gui::Rect rect(Gui::Point(x*8 + 0, y*15 + 7), Gui::Area(3, 2));
-				Box_painter::paint(_surface, rect, color);
-				rect = Gui::Rect(Gui::Point(x*8 + 2, y*15 + 8), Gui::Area(2, 8));
-				Box_painter::paint(_surface, rect, color);
-				break;
-			}
-			case 0xc3: { /* |- */
-				Gui::Rect rect(Gui::Point(x*8 + 2, y*15 + 7), Gui::Area(6, 2));
-				Box_painter::paint(_surface, rect, color);
-				rect = Gui::Rect(Gui::Point(x*8 + 2, y*15 + 0), Gui::Area(2, 15));
-				Box_painter::paint(_surface, rect, color);
-				break;
-			}
-			case 0xc4: { /* - */
-				Gui::Rect rect(Gui::Point(x*8 + 0, y*15 + 7), Gui::Area(8, 2));
-				Box_painter::paint(_surface, rect, color);
-				break;
-			}
-			case 0xc0: { /* '- */
-				Gui::Rect rect(Gui::Point(x*8 + 2, y*15 + 7), Gui::Area(6, 2));
-				Box_painter::paint(_surface, rect, color);
-				rect = Gui::Rect(Gui::Point(x*8 + 2, y*15), Gui::Area(2, 8));
-				Box_painter::paint(_surface, rect, color);
-				break;
-			}
-			case 0xda: { /* .- */
-				Gui::Rect rect(Gui::Point(x*8 + 2, y*15 + 7), Gui::Area(6, 2));
-				Box_painter::paint(_surface, rect, color);
-				rect = Gui::Rect(Gui::Point(x*8 + 2, y*15 + 8), Gui::Area(2, 8));
-				Box_painter::paint(_surface, rect, color);
-				break;
-			}
-			case 0xd9: { /* -' */
-				Gui::Rect rect(Gui::Point(x*8 + 0, y*15 + 7), Gui::Area(3, 2));
-				Box_painter::paint(_surface, rect, color);
-				rect = Gui::Rect(Gui::Point(x*8 + 2, y*15), Gui::Area(2, 8));
-				Box_painter::paint(_surface, rect, color);
-				break;
-			}
-			default:
-				Text_painter::paint(_surface, where, _default_font, color, buffer);
-				break;
-			}
-
-			/* Checksum for comparing */
-			if (_fb_state.cmp_even) _fb_state.checksum1 += character;
-			else _fb_state.checksum2 += character;
+	uint16 const * const text = reinterpret_cast<uint16 const *>(
+		_guest_fb + (_regs->offset << 1));
+
+	/* bounding box of the changed cells */
+	unsigned min_x = TEXT_COLS, max_x = 0, min_y = TEXT_ROWS, max_y = 0;
+	bool     content_changed = false;
+
+	for (unsigned y = 0; y < TEXT_ROWS; y++) {
+		for (unsigned x = 0; x < TEXT_COLS; x++) {
+
+			unsigned const i    = y * TEXT_COLS + x;
+			uint16   const cell = text[i];
+
+			bool const same = _text_shadow_valid && _text_shadow[i] == cell;
+
+			if (same && int(i) != repaint)
+				continue;
+
+			if (!same)
+				content_changed = true;
+
+			_text_shadow[i] = cell;
+			_paint_cell(_surface, x, y, cell);
+
+			min_x = Genode::min(min_x, x); max_x = Genode::max(max_x, x);
+			min_y = Genode::min(min_y, y); max_y = Genode::max(max_y, y);
 		}
 	}
 
+	_text_shadow_valid = true;
+
+	bool cursor_drawn = false;
+
 	if (cursor_show) {
 		bool show = !_last_cursor.blink;
 		if (_last_cursor.x != cursor_x || _last_cursor.y != cursor_y ||
 		    show) {
+			uint16 const cell = _text_shadow[cursor_y * TEXT_COLS + cursor_x];
+
 			/* - */
-			Gui::Rect rect(Gui::Point(cursor_x * 8 + 0,
-			                          cursor_y * 15 + 7), Gui::Area(8, 2));
-			Box_painter::paint(_surface, rect, cursor_color);
+			Gui::Rect rect(Gui::Point(cursor_x * CELL_W + 0,
+			                          cursor_y * CELL_H + 7), Gui::Area(8, 2));
+			Box_painter::paint(_surface, rect, _text_color((cell >> 8) & 0xf));
 
-			show = true;
+			show = cursor_drawn = true;
 		}
 
 		_last_cursor = { .x = cursor_x, .y = cursor_y, .blink = show };
-	}
+	} else
+		_last_cursor.blink = false;
+
+	if (min_x <= max_x)
+		gui.refresh(min_x * CELL_W, min_y * CELL_H,
+		            (max_x - min_x + 1) * CELL_W,
+		            (max_y - min_y + 1) * CELL_H);
 
-	_fb_state.cmp_even = !_fb_state.cmp_even;
+	if (cursor_drawn)
+		gui.refresh(cursor_x * CELL_W, cursor_y * CELL_H + 7, CELL_W, 2);
 
-	/* compare checksums to detect changed buffer */
-	if (_fb_state.checksum1 != _fb_state.checksum2) {
+	if (content_changed) {
 		_fb_state.unchanged = 0;
-		gui.refresh(0, 0, gui.fb_mode.area.w(), gui.fb_mode.area.h());
 		return Milliseconds(100ULL);
 	}
 
-	if (++_fb_state.unchanged < 10) {
-		if (cursor_show)
-			gui.refresh(_last_cursor.x * 8  + 0,
-			            _last_cursor.y * 15 + 7, 8, 2);
+	if (++_fb_state.unchanged < 10)
 		return Milliseconds(_fb_state.unchanged * 30);
-	}
 
-	/* if we copy the same data 10 times, unmap the text buffer from guest */
+	/* if the text buffer did not change 10 times, unmap it from guest */
 	_memory.detach(PHYS_FRAME_VGA_COLOR << 12,
 	               FRAME_COUNT_COLOR << 12);
 
 	_fb_state.vga_off = true;
 	_fb_state.unchanged = 0;
 
-	gui.refresh(0, 0, gui.fb_mode.area.w(), gui.fb_mode.area.h());
-
 	return Milliseconds(0ULL);
 }
 
@@ -203,6 +238,9 @@ Genode::Milliseconds Seoul::Vga_vesa::_handle_vga_mode(Backend_gui &gui,
 Genode::Milliseconds Seoul::Vga_vesa::_handle_vesa_mode(Backend_gui &gui,
                                                         bool const cpus_active)
 {
+	/* VESA output overwrites the text cells */
+	_text_shadow_valid = false;
+
 	if (!_fb_state.vga_off) {
 		_memory.detach(PHYS_FRAME_VGA_COLOR << 12,
 		               FRAME_COUNT_COLOR << 12);
@@ -218,9 +256,130 @@ Genode::Milliseconds Seoul::Vga_vesa::_handle_vesa_mode(Backend_gui &gui,
 
 	_fb_state.idle = 0;
 
-	gui.refresh(0, 0, gui.fb_mode.area.w(), gui.fb_mode.area.h());
-
-	_fb_state.unchanged++;
+	if (_refresh_changed_tiles(gui))
+		_fb_state.unchanged = 1;
+	else
+		_fb_state.unchanged++;
 
 	return Milliseconds((_fb_state.unchanged > 4) ? 4 * 10 : _fb_state.unchanged * 10);
 }
+
+
+void Seoul::Vga_vesa::_alloc_tiles(Gui::Area const area)
+{
+	unsigned const tiles_x = (area.w() + TILE_W - 1) / TILE_W;
+	unsigned const tiles_y = (area.h() + TILE_H - 1) / TILE_H;
+
+	if (_tile_hash && tiles_x == _tiles_x && tiles_y == _tiles_y)
+		return;
+
+	if (_tile_hash)
+		destroy(_alloc, _tile_hash);
+
+	_tile_hash   = new (_alloc) uint64[tiles_x * tiles_y];
+	_tiles_x     = tiles_x;
+	_tiles_y     = tiles_y;
+	_tiles_valid = false;
+}
+
+
+uint64 Seoul::Vga_vesa::_hash_tile(Backend_gui const &gui,
+                                   unsigned const tx,
+                                   unsigned const ty) const
+{
+	/* FNV-1a over 64-bit words */
+	static constexpr uint64 FNV_PRIME = 0x100000001b3ULL;
+
+	unsigned const w  = gui.fb_mode.area.w();
+	unsigned const h  = gui.fb_mode.area.h();
+	unsigned const x0 = tx * TILE_W;
+	unsigned const y0 = ty * TILE_H;
+	unsigned const x1 = Genode::min(x0 + TILE_W, w);
+	unsigned const y1 = Genode::min(y0 + TILE_H, h);
+
+	uint32 const * const pixels = reinterpret_cast<uint32 const *>(gui.pixels);
+
+	uint64 hash = 0xcbf29ce484222325ULL;
+
+	for (unsigned y = y0; y < y1; y++) {
+		uint32 const *line = pixels + y * w + x0;
+		unsigned      x    = x0;
+
+		/* hash two pixels at once, tiles start at an even pixel */
+		for (; x + 1 < x1; x += 2, line += 2)
+			hash = (hash ^ *reinterpret_cast<uint64 const *>(line)) * FNV_PRIME;
+
+		if (x < x1)
+			hash = (hash ^ *line) * FNV_PRIME;
+	}
+
+	return hash;
+}
+
+
+bool Seoul::Vga_vesa::_refresh_changed_tiles(Backend_gui &gui)
+{
+	_alloc_tiles(gui.fb_mode.area);
+
+	bool const all = !_tiles_valid;
+
+	unsigned const w = gui.fb_mode.area.w();
+	unsigned const h = gui.fb_mode.area.h();
+
+	/* rectangle spanning the changed tiles of consecutive tile rows */
+	struct { unsigned x0, x1, y0, y1; bool valid; } pending { 0, 0, 0, 0, false };
+
+	auto flush = [&] () {
+		if (!pending.valid)
+			return;
+
+		unsigned const x = pending.x0 * TILE_W;
+		unsigned const y = pending.y0 * TILE_H;
+
+		gui.refresh(x, y,
+		            Genode::min(pending.x1 * TILE_W, w) - x,
+		            Genode::min(pending.y1 * TILE_H, h) - y);
+		pending.valid = false;
+	};
+
+	bool changed = false;
+
+	for (unsigned ty = 0; ty < _tiles_y; ty++) {
+
+		unsigned first = ~0U, last = 0;
+
+		for (unsigned tx = 0; tx < _tiles_x; tx++) {
+			uint64 &stored = _tile_hash[ty * _tiles_x + tx];
+			uint64 const hash = _hash_tile(gui, tx, ty);
+
+			if (!all && hash == stored)
+				continue;
+
+			stored = hash;
+			first  = Genode::min(first, tx);
+			last   = tx;
+		}
+
+		if (first == ~0U) {
+			flush();
+			continue;
+		}
+
+		changed = true;
+
+		/* extend the pending rectangle if the columns match */
+		if (pending.valid && pending.x0 == first && pending.x1 == last + 1) {
+			pending.y1 = ty + 1;
+			continue;
+		}
+
+		flush();
+		pending = { first, last + 1, ty, ty + 1, true };
+	}
+
+	flush();
+
+	_tiles_valid = true;
+
+	return changed;
+}
@@ -19,6 +19,7 @@
 #ifndef _VGA_VESA_H_
 #define _VGA_VESA_H_
 
+#include <base/allocator.h>
 #include <base/duration.h>
 #include <os/pixel_rgb888.h>
 
@@ -63,18 +64,12 @@ class Seoul::Vga_vesa
 		Tff_font                            _default_font;
 
 		struct {
-			uint64   checksum1;
-			uint64   checksum2;
 			unsigned unchanged;
 			unsigned idle;
-			bool     cmp_even;
 			bool     vga_off;
 		} _fb_state {
-			.checksum1 = 0,
-			.checksum2 = 0,
 			.unchanged = 0,
 			.idle      = 0,
-			.cmp_even  = true,
 			.vga_off   = false
 		};
 
@@ -82,16 +77,67 @@ class Seoul::Vga_vesa
 			int x; int y; bool blink;
 		} _last_cursor { };
 
+		/*
+		 * Text mode
+		 *
+		 * The cells of the text buffer are compared against a shadow copy
+		 * and only changed cells are painted, using glyphs pre-rendered
+		 * from the default font.
+		 */
+		enum { TEXT_COLS = 80, TEXT_ROWS = 25, CELL_W = 8, CELL_H = 15 };
+
+		uint16 _text_shadow[TEXT_COLS * TEXT_ROWS] { };
+		bool   _text_shadow_valid { false };
+
+		/* coverage of each glyph, 0 is background and 255 foreground */
+		uint8  _glyph_alpha[256][CELL_H][CELL_W] { };
+
+		static Genode::Color _text_color(unsigned);
+
+		void _render_glyphs();
+		void _paint_cell(Genode::Surface<Pixel_rgb888> &, unsigned, unsigned,
+		                 uint16);
+
+		/*
+		 * Change detection for the VESA framebuffer
+		 *
+		 * The framebuffer is mapped directly into the guest, so writes are
+		 * not trapped. Instead, the content of each tile is hashed on every
+		 * update and only tiles with a changed hash are refreshed at the
+		 * GUI server.
+		 */
+		enum { TILE_W = 64, TILE_H = 16 };
+
+		Genode::Allocator &_alloc;
+		uint64            *_tile_hash   { nullptr };
+		unsigned           _tiles_x     { 0 };
+		unsigned           _tiles_y     { 0 };
+		bool               _tiles_valid { false };
+
+		void   _alloc_tiles(Gui::Area);
+		uint64 _hash_tile(Backend_gui const &, unsigned, unsigned) const;
+		bool   _refresh_changed_tiles(Backend_gui &);
+
 		Milliseconds _handle_vga_mode (Backend_gui &, bool);
 		Milliseconds _handle_vesa_mode(Backend_gui &, bool);
 
 	public:
 
-		Vga_vesa(Guest_memory &memory, char * binary_mono_ttf_start)
+		Vga_vesa(Genode::Allocator &alloc, Guest_memory &memory,
+		         char * binary_mono_ttf_start)
 		:
 			_memory(memory),
-			_default_font(binary_mono_ttf_start, _glyph_buffer)
-		{ }
+			_default_font(binary_mono_ttf_start, _glyph_buffer),
+			_alloc(alloc)
+		{
+			_render_glyphs();
+		}
+
+		~Vga_vesa()
+		{
+			if (_tile_hash)
+				destroy(_alloc, _tile_hash);
+		}
 
 		void init(VgaRegs *regs, char *guest_fb, uint64 fb_phys_base)
 		{
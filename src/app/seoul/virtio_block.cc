@@ -0,0 +1,345 @@
+/*
+ * \brief  Virtio block device model
+ * \author agent
+ * \date   2026-10-19
+ *
+ * The requests of the guest are forwarded as 'MessageDisk' to the disk
+ * backend and thereby share the Block sessions, request queueing and merging
+ * with the IDE and AHCI models. All requests available in the queue are
+ * submitted on one notification. While requests are outstanding, the guest
+ * is asked not to notify the device because each completion re-scans the
+ * queue anyway.
+ */
+
+/*
+ * Copyright (C) 2026 agent
+ *
+ * This file is distributed under the terms of the GNU General Public License
+ * version 2.
+ */
+
+/* Seoul includes */
+#include <nul/motherboard.h>
+#include <host/dma.h>
+
+/* local includes */
+#include "virtio_device.h"
+
+namespace Seoul {
+	class Virtio_block;
+}
+
+
+class Seoul::Virtio_block : public StaticReceiver<Virtio_block>,
+                            public Virtio_device
+{
+	private:
+
+		enum {
+			DEVICE_ID    = 0x1001,
+			CLASS_CODE   = 0x010000,
+			SUBSYSTEM_ID = 2,
+
+			F_SIZE_MAX   = 1u << 1,
+			F_SEG_MAX    = 1u << 2,
+			F_BLK_SIZE   = 1u << 6,
+
+			/* keeps requests within the merge limit of the disk backend */
+			MAX_SEGMENT_SIZE = 4096,
+			SEG_MAX          = 64,
+
+			SECTOR_SIZE  = 512,
+			HEADER_SIZE  = 16,
+			ID_BYTES     = 20,
+
+			T_IN     = 0,
+			T_OUT    = 1,
+			T_GET_ID = 8,
+
+			S_OK     = 0,
+			S_IOERR  = 1,
+			S_UNSUPP = 2,
+		};
+
+		struct Config
+		{
+			Genode::uint64_t capacity;
+			Genode::uint32_t size_max;
+			Genode::uint32_t seg_max;
+			Genode::uint16_t cylinders;
+			Genode::uint8_t  heads;
+			Genode::uint8_t  sectors;
+			Genode::uint32_t blk_size;
+		} __attribute__((packed));
+
+		struct Segment
+		{
+			char           *ptr;
+			Genode::size_t  len;
+			bool            write;
+		};
+
+		struct Request
+		{
+			bool             busy;
+			Genode::uint8_t *status;
+			Genode::uint32_t written;
+		};
+
+		unsigned const _disknr;
+
+		DiskParameter  _params       { };
+		bool           _params_valid { false };
+
+		Virtio_queue   _queue { _memory };
+
+		Request        _requests[Virtio_queue::MAX_SIZE] { };
+		unsigned       _inflight   { 0 };
+
+		/* distinguishes completions of requests issued before a reset */
+		unsigned       _generation { 0 };
+
+		/* set while the queue is processed, defers completions */
+		bool           _processing { false };
+
+		bool _disk_params()
+		{
+			if (_params_valid)
+				return true;
+
+			MessageDisk msg(_disknr, &_params);
+			_params_valid = _motherboard().bus_disk.send(msg) &&
+			                _params.sectorsize &&
+			                _params.sectorsize % SECTOR_SIZE == 0;
+			return _params_valid;
+		}
+
+		unsigned long _usertag(unsigned head) const {
+			return (unsigned long)(_generation & 0xffff) << 16 | head; }
+
+		void _complete(unsigned head, Genode::uint8_t *status,
+		               Genode::uint8_t value, Genode::uint32_t written)
+		{
+			*status = value;
+			_queue.push(head, written);
+		}
+
+		void _request(unsigned head)
+		{
+			Segment  segments[SEG_MAX + 2];
+			unsigned count = 0;
+
+			bool const valid = _queue.for_each_buffer(head,
+				[&] (char *ptr, Genode::size_t len, bool write) {
+					if (count >= SEG_MAX + 2)
+						return false;
+					segments[count++] = Segment { ptr, len, write };
+					return true;
+				});
+
+			bool const malformed = !valid || count < 2 ||
+			                       segments[0].write ||
+			                       segments[0].len < HEADER_SIZE ||
+			                       !segments[count - 1].write ||
+			                       !segments[count - 1].len;
+			if (malformed) {
+				/* without a status byte, the chain is just returned */
+				Logging::printf("virtio_block: malformed request\n");
+				_queue.push(head, 0);
+				return;
+			}
+
+			Segment const &header = segments[0];
+			Segment const &last   = segments[count - 1];
+
+			Genode::uint8_t * const status =
+				reinterpret_cast<Genode::uint8_t *>(last.ptr + last.len - 1);
+
+			Genode::uint32_t   const type   = *reinterpret_cast<Genode::uint32_t *>(header.ptr);
+			unsigned long long const sector = *reinterpret_cast<Genode::uint64_t *>(header.ptr + 8);
+
+			Segment  const * const data       = segments + 1;
+			unsigned         const data_count = count - 2;
+
+			if (type == T_GET_ID) {
+				Genode::String<ID_BYTES> const id("seoul-disk", _disknr);
+				if (!data_count || !data[0].write || data[0].len < ID_BYTES)
+					return _complete(head, status, S_IOERR, 1);
+
+				Genode::memset(data[0].ptr, 0, ID_BYTES);
+				Genode::memcpy(data[0].ptr, id.string(), id.length() - 1);
+				return _complete(head, status, S_OK, ID_BYTES + 1);
+			}
+
+			if (type != T_IN && type != T_OUT)
+				return _complete(head, status, S_UNSUPP, 1);
+
+			bool const read = type == T_IN;
+
+			DmaDescriptor dma[SEG_MAX];
+			unsigned long total = 0;
+
+			for (unsigned i = 0; i < data_count; i++) {
+				if (data[i].write != read)
+					return _complete(head, status, S_IOERR, 1);
+
+				dma[i].byteoffset = data[i].ptr - _memory.base;
+				dma[i].bytecount  = data[i].len;
+				total            += data[i].len;
+			}
+
+			if (!data_count || !_disk_params())
+				return _complete(head, status, S_IOERR, 1);
+
+			/* the guest addresses 512-byte sectors regardless of the block size */
+			unsigned long long const blocks_per_sector = _params.sectorsize / SECTOR_SIZE;
+
+			if (total % _params.sectorsize || sector % blocks_per_sector ||
+			    (sector + total / SECTOR_SIZE) / blocks_per_sector > _params.sectors)
+				return _complete(head, status, S_IOERR, 1);
+
+			_requests[head] = Request { true, status,
+			                            Genode::uint32_t(read ? total + 1 : 1) };
+			_inflight++;
+
+			MessageDisk msg(read ? MessageDisk::DISK_READ : MessageDisk::DISK_WRITE,
+			                _disknr, _usertag(head), sector / blocks_per_sector,
+			                data_count, dma, 0, _memory.size);
+
+			if (_motherboard().bus_disk.send(msg) && msg.error == MessageDisk::DISK_OK)
+				return;
+
+			/* a failed request may have been committed already */
+			if (!_requests[head].busy)
+				return;
+
+			_requests[head].busy = false;
+			_inflight--;
+			_complete(head, status, S_IOERR, 1);
+		}
+
+		void _process()
+		{
+			_processing = true;
+
+			for (;;) {
+				unsigned head = 0;
+				while (_queue.pop(head))
+					_request(head);
+
+				_flush(_queue);
+
+				/* completions re-scan the queue, notifications are not needed */
+				if (_inflight) {
+					_queue.notifications(false);
+					break;
+				}
+
+				if (!_queue.notifications(true))
+					break;
+			}
+
+			_processing = false;
+		}
+
+		/*
+		 * Virtio_device interface
+		 */
+
+		Genode::uint32_t _device_features() override {
+			return F_SIZE_MAX | F_SEG_MAX | F_BLK_SIZE; }
+
+		unsigned _device_config_size() override { return sizeof(Config); }
+
+		Genode::uint8_t _device_config(unsigned offset) override
+		{
+			_disk_params();
+
+			Config const config {
+				_params_valid ? _params.sectors * _params.sectorsize / SECTOR_SIZE : 0,
+				MAX_SEGMENT_SIZE, SEG_MAX, 0, 0, 0,
+				_params_valid ? _params.sectorsize : unsigned(SECTOR_SIZE) };
+
+			return reinterpret_cast<Genode::uint8_t const *>(&config)[offset];
+		}
+
+		void _device_notify(unsigned) override
+		{
+			if (!_processing)
+				_process();
+		}
+
+		void _device_reset() override
+		{
+			for (unsigned i = 0; i < Virtio_queue::MAX_SIZE; i++)
+				_requests[i].busy = false;
+
+			_inflight = 0;
+			_generation++;
+		}
+
+	public:
+
+		Virtio_block(Motherboard &mb, unsigned bdf, unsigned irq,
+		             unsigned port, unsigned disknr)
+		:
+			Virtio_device(mb, bdf, irq, port, DEVICE_ID, CLASS_CODE,
+			              SUBSYSTEM_ID),
+			_disknr(disknr)
+		{
+			_queues[0]  = &_queue;
+			_num_queues = 1;
+
+			if (!_disk_params())
+				Logging::printf("virtio_block: disk %u not available yet\n",
+				                _disknr);
+		}
+
+		using Virtio_device::receive;
+
+		bool receive(MessageDiskCommit &msg)
+		{
+			if (msg.disknr != _disknr)
+				return false;
+
+			unsigned const head = msg.usertag & 0xffff;
+			if (msg.usertag != _usertag(head) || head >= Virtio_queue::MAX_SIZE ||
+			    !_requests[head].busy)
+				return false;
+
+			Request &request = _requests[head];
+			request.busy = false;
+			_inflight--;
+
+			_complete(head, request.status,
+			          msg.status == MessageDisk::DISK_OK ? S_OK : S_IOERR,
+			          msg.status == MessageDisk::DISK_OK ? request.written : 1);
+
+			/* the current run publishes the completion */
+			if (!_processing)
+				_process();
+
+			return true;
+		}
+};
+
+
+extern "C" void __parameter_virtio_block_fn(Motherboard &mb, unsigned long *argv,
+                                            const char *, unsigned)
+{
+	if (argv[1] == ~0UL || argv[2] == ~0UL)
+		Logging::panic("virtio_block: irq and port are required\n");
+
+	unsigned const bdf = argv[0] == ~0UL ? Seoul::Virtio_device::free_bdf(mb)
+	                                     : unsigned(argv[0]);
+
+	Seoul::Virtio_block * const dev =
+		new Seoul::Virtio_block(mb, bdf, unsigned(argv[1]),
+		                        unsigned(argv[2]),
+		                        argv[3] == ~0UL ? 0 : unsigned(argv[3]));
+
+	mb.bus_pcicfg    .add(dev, Seoul::Virtio_block::receive_static<MessagePciConfig>);
+	mb.bus_ioin      .add(dev, Seoul::Virtio_block::receive_static<MessageIOIn>);
+	mb.bus_ioout     .add(dev, Seoul::Virtio_block::receive_static<MessageIOOut>);
+	mb.bus_diskcommit.add(dev, Seoul::Virtio_block::receive_static<MessageDiskCommit>);
+}
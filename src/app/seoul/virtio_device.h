@@ -0,0 +1,313 @@
+/*
+ * \brief  Legacy virtio PCI transport of the virtio device models
+ * \author agent
+ * \date   2026-10-19
+ *
+ * The device exposes the legacy (virtio 0.9.5) register layout via an I/O
+ * BAR, which is supported by all Linux guests without MSI-X. The interrupt
+ * is a level-triggered legacy PCI interrupt, which stays asserted until the
+ * guest reads the ISR register. Completions that happen in between do not
+ * cause additional interrupts.
+ */
+
+/*
+ * Copyright (C) 2026 agent
+ *
+ * This file is distributed under the terms of the GNU General Public License
+ * version 2.
+ */
+
+#ifndef _VIRTIO_DEVICE_H_
+#define _VIRTIO_DEVICE_H_
+
+/* Seoul includes */
+#include <nul/motherboard.h>
+
+/* local includes */
+#include "virtio_queue.h"
+
+namespace Seoul {
+	class Virtio_device;
+}
+
+
+class Seoul::Virtio_device
+{
+	public:
+
+		enum {
+			VENDOR_ID = 0x1af4,
+
+			/* legacy register layout */
+			REG_HOST_FEATURES  = 0x00,
+			REG_GUEST_FEATURES = 0x04,
+			REG_QUEUE_PFN      = 0x08,
+			REG_QUEUE_SIZE     = 0x0c,
+			REG_QUEUE_SELECT   = 0x0e,
+			REG_QUEUE_NOTIFY   = 0x10,
+			REG_STATUS         = 0x12,
+			REG_ISR            = 0x13,
+			REG_CONFIG         = 0x14,
+
+			IO_SIZE            = 0x40,
+
+			ISR_QUEUE          = 1,
+
+			F_RING_EVENT_IDX   = 1u << 29,
+
+			MAX_QUEUES         = 2,
+		};
+
+	private:
+
+		Motherboard      &_mb;
+
+		unsigned const    _bdf;
+		Genode::uint16_t  _device_id;
+		Genode::uint32_t  _class_code;
+		Genode::uint16_t  _subsystem_id;
+
+		/* PCI configuration space */
+		Genode::uint16_t  _command    { 0 };
+		Genode::uint32_t  _bar        { 0 };
+		Genode::uint8_t   _irq_line;
+
+		/* virtio registers */
+		Genode::uint32_t  _guest_features { 0 };
+		unsigned          _queue_select   { 0 };
+		Genode::uint8_t   _status         { 0 };
+		Genode::uint8_t   _isr            { 0 };
+
+		bool _io_enabled() const { return _command & 1; }
+
+		bool _port_match(unsigned short port, unsigned &offset) const
+		{
+			unsigned const base = _bar & ~(IO_SIZE - 1u);
+
+			if (!_io_enabled() || !base || port < base || port >= base + IO_SIZE)
+				return false;
+
+			offset = port - base;
+			return true;
+		}
+
+		void _irq_line_level(bool assert)
+		{
+			MessageIrqLines msg(assert ? MessageIrq::ASSERT_IRQ
+			                           : MessageIrq::DEASSERT_IRQ, _irq_line);
+			_mb.bus_irqlines.send(msg);
+		}
+
+		void _reset()
+		{
+			_guest_features = 0;
+			_queue_select   = 0;
+			_status         = 0;
+
+			for (unsigned i = 0; i < _num_queues; i++)
+				_queues[i]->reset();
+
+			if (_isr)
+				_irq_line_level(false);
+			_isr = 0;
+
+			_device_reset();
+		}
+
+	protected:
+
+		Virtio_guest_memory _memory { };
+
+		Virtio_queue *_queues[MAX_QUEUES] { };
+		unsigned      _num_queues { 0 };
+
+		Motherboard &_motherboard() { return _mb; }
+
+		bool _driver_ok() const { return _status & 4; }
+
+		bool _feature(Genode::uint32_t f) const { return _guest_features & f; }
+
+		/**
+		 * Publish used buffers of queue and signal the guest if requested
+		 */
+		void _flush(Virtio_queue &queue)
+		{
+			if (!queue.flush() || (_isr & ISR_QUEUE))
+				return;
+
+			_isr |= ISR_QUEUE;
+			_irq_line_level(true);
+		}
+
+		/*
+		 * Interface of the concrete device
+		 */
+		virtual Genode::uint32_t _device_features() = 0;
+		virtual unsigned         _device_config_size() = 0;
+		virtual Genode::uint8_t  _device_config(unsigned offset) = 0;
+		virtual void             _device_notify(unsigned queue) = 0;
+		virtual void             _device_reset() = 0;
+
+		Virtio_device(Motherboard &mb, unsigned bdf, unsigned irq,
+		              unsigned port, Genode::uint16_t device_id,
+		              Genode::uint32_t class_code, Genode::uint16_t subsystem_id)
+		:
+			_mb(mb), _bdf(bdf), _device_id(device_id),
+			_class_code(class_code), _subsystem_id(subsystem_id),
+			_irq_line(Genode::uint8_t(irq))
+		{
+			/* the port is pre-assigned, the guest may relocate the BAR */
+			if (port && port < 0x10000) {
+				_bar     = (port & ~(IO_SIZE - 1u)) | 1;
+				_command = 1;
+			}
+
+			MessageHostOp msg(MessageHostOp::OP_GUEST_MEM, 0UL);
+			if (!mb.bus_hostop.send(msg) || !msg.ptr)
+				Logging::panic("virtio: no guest memory available");
+
+			_memory.base = msg.ptr;
+			_memory.size = msg.len;
+		}
+
+		virtual ~Virtio_device() { }
+
+	public:
+
+		/**
+		 * Return first device number on PCI bus 0 not claimed by a model
+		 */
+		static unsigned free_bdf(Motherboard &mb)
+		{
+			for (unsigned dev = 1; dev < 32; dev++) {
+				MessagePciConfig msg(dev << 3, 0);
+				if (!mb.bus_pcicfg.send(msg))
+					return dev << 3;
+			}
+
+			Logging::panic("virtio: no free PCI device number\n");
+			return 0;
+		}
+
+		bool receive(MessagePciConfig &msg)
+		{
+			if (msg.bdf != _bdf)
+				return false;
+
+			if (msg.type == MessagePciConfig::TYPE_READ) {
+				switch (msg.dword) {
+				case 0:  msg.value = unsigned(_device_id) << 16 | VENDOR_ID;  break;
+				case 1:  msg.value = _command;                                break;
+				case 2:  msg.value = _class_code << 8;                        break;
+				case 4:  msg.value = _bar;                                    break;
+				case 11: msg.value = unsigned(_subsystem_id) << 16 | VENDOR_ID; break;
+				/* interrupt pin INTA */
+				case 15: msg.value = 1u << 8 | _irq_line;                     break;
+				default: msg.value = 0;
+				}
+				return true;
+			}
+
+			if (msg.type != MessagePciConfig::TYPE_WRITE)
+				return false;
+
+			switch (msg.dword) {
+			case 1:
+				/* only I/O space and bus master are implemented */
+				_command = Genode::uint16_t(msg.value & 0x5);
+				break;
+			case 4:
+				/* sizing of the I/O BAR yields the mask of writable bits */
+				_bar = (msg.value & ~(IO_SIZE - 1u) & 0xffffu) | 1;
+				break;
+			case 15:
+				_irq_line = Genode::uint8_t(msg.value);
+				break;
+			}
+			return true;
+		}
+
+		bool receive(MessageIOIn &msg)
+		{
+			unsigned offset = 0;
+			if (!_port_match(msg.port, offset))
+				return false;
+
+			unsigned const width = 1u << msg.type;
+			Virtio_queue const * const queue = _queue_select < _num_queues
+			                                 ? _queues[_queue_select] : nullptr;
+
+			switch (offset) {
+			case REG_HOST_FEATURES:
+				msg.value = _device_features() | F_RING_EVENT_IDX;
+				return true;
+			case REG_GUEST_FEATURES:
+				msg.value = _guest_features;
+				return true;
+			case REG_QUEUE_PFN:
+				msg.value = queue ? queue->pfn() : 0;
+				return true;
+			case REG_QUEUE_SIZE:
+				msg.value = queue ? queue->size() : 0;
+				return true;
+			case REG_QUEUE_SELECT:
+				msg.value = _queue_select;
+				return true;
+			case REG_STATUS:
+				msg.value = _status;
+				return true;
+			case REG_ISR:
+				/* reading the ISR acknowledges the interrupt */
+				msg.value = _isr;
+				if (_isr)
+					_irq_line_level(false);
+				_isr = 0;
+				return true;
+			}
+
+			msg.value = 0;
+			if (offset >= REG_CONFIG) {
+				offset -= REG_CONFIG;
+				for (unsigned i = 0; i < width; i++)
+					if (offset + i < _device_config_size())
+						msg.value |= unsigned(_device_config(offset + i)) << (8 * i);
+			}
+			return true;
+		}
+
+		bool receive(MessageIOOut &msg)
+		{
+			unsigned offset = 0;
+			if (!_port_match(msg.port, offset))
+				return false;
+
+			switch (offset) {
+			case REG_GUEST_FEATURES:
+				_guest_features = msg.value & (_device_features() | F_RING_EVENT_IDX);
+				for (unsigned i = 0; i < _num_queues; i++)
+					_queues[i]->event_idx(_feature(F_RING_EVENT_IDX));
+				break;
+			case REG_QUEUE_PFN:
+				if (_queue_select < _num_queues) {
+					_queues[_queue_select]->pfn(msg.value);
+					_queues[_queue_select]->event_idx(_feature(F_RING_EVENT_IDX));
+				}
+				break;
+			case REG_QUEUE_SELECT:
+				_queue_select = msg.value & 0xffff;
+				break;
+			case REG_QUEUE_NOTIFY:
+				if (_driver_ok() && (msg.value & 0xffff) < _num_queues)
+					_device_notify(msg.value & 0xffff);
+				break;
+			case REG_STATUS:
+				_status = Genode::uint8_t(msg.value);
+				if (!_status)
+					_reset();
+				break;
+			}
+			return true;
+		}
+};
+
+#endif /* _VIRTIO_DEVICE_H_ */
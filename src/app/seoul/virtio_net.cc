@@ -0,0 +1,255 @@
+/*
+ * \brief  Virtio network device model
+ * \author agent
+ * \date   2026-10-19
+ *
+ * Frames are exchanged as 'MessageNetwork' with the Nic session of the VMM.
+ * The transmit queue is drained completely on each notification and
+ * signalled once. The guest never needs to notify the receive queue because
+ * received frames are placed in the buffers available at that time, so
+ * notifications of the receive queue stay disabled.
+ */
+
+/*
+ * Copyright (C) 2026 agent
+ *
+ * This file is distributed under the terms of the GNU General Public License
+ * version 2.
+ */
+
+/* Seoul includes */
+#include <nul/motherboard.h>
+
+/* local includes */
+#include "virtio_device.h"
+
+namespace Seoul {
+	class Virtio_net;
+}
+
+
+class Seoul::Virtio_net : public StaticReceiver<Virtio_net>,
+                          public Virtio_device
+{
+	private:
+
+		enum {
+			DEVICE_ID    = 0x1000,
+			CLASS_CODE   = 0x020000,
+			SUBSYSTEM_ID = 1,
+
+			F_MAC        = 1u << 5,
+			F_STATUS     = 1u << 16,
+
+			STATUS_LINK_UP = 1,
+
+			QUEUE_RX     = 0,
+			QUEUE_TX     = 1,
+
+			/* legacy header without mergeable receive buffers */
+			HEADER_SIZE  = 10,
+			MAX_FRAME    = 1514 + 4,
+		};
+
+		struct Config
+		{
+			Genode::uint8_t  mac[6];
+			Genode::uint16_t status;
+		} __attribute__((packed));
+
+		Config        _config { };
+
+		Virtio_queue  _rx_queue { _memory };
+		Virtio_queue  _tx_queue { _memory };
+
+		/* frame currently sent by us, ignored when seen on the bus */
+		void const   *_tx_frame { nullptr };
+		unsigned char _tx_buffer[MAX_FRAME];
+
+		unsigned long _rx_dropped { 0 };
+		unsigned long _tx_dropped { 0 };
+
+		/**
+		 * Send one frame of the transmit queue
+		 *
+		 * A frame contained in one buffer is sent straight from guest memory.
+		 */
+		bool _transmit(unsigned head)
+		{
+			Genode::size_t  skip   = HEADER_SIZE;
+			Genode::size_t  len    = 0;
+			unsigned        chunks = 0;
+			unsigned char  *frame  = nullptr;
+
+			bool const valid = _tx_queue.for_each_buffer(head,
+				[&] (char *ptr, Genode::size_t size, bool write) {
+					if (write)
+						return false;
+
+					Genode::size_t const header = Genode::min(skip, size);
+					skip -= header;
+					ptr  += header;
+					size -= header;
+
+					if (!size)
+						return true;
+
+					if (len + size > MAX_FRAME)
+						return false;
+
+					if (!chunks)
+						frame = reinterpret_cast<unsigned char *>(ptr);
+					else {
+						/* gather scattered frame */
+						if (chunks == 1)
+							Genode::memcpy(_tx_buffer, frame, len);
+						Genode::memcpy(_tx_buffer + len, ptr, size);
+						frame = _tx_buffer;
+					}
+
+					chunks++;
+					len += size;
+					return true;
+				});
+
+			if (!valid || !len)
+				return false;
+
+			_tx_frame = frame;
+			MessageNetwork msg(frame, unsigned(len), 0);
+			bool const sent = _motherboard().bus_network.send(msg);
+			_tx_frame = nullptr;
+
+			return sent;
+		}
+
+		void _process_tx()
+		{
+			do {
+				_tx_queue.notifications(false);
+
+				unsigned head = 0;
+				while (_tx_queue.pop(head)) {
+					if (!_transmit(head))
+						_tx_dropped++;
+
+					_tx_queue.push(head, 0);
+				}
+
+				_flush(_tx_queue);
+
+			} while (_tx_queue.notifications(true));
+		}
+
+		/*
+		 * Virtio_device interface
+		 */
+
+		Genode::uint32_t _device_features() override { return F_MAC | F_STATUS; }
+
+		unsigned _device_config_size() override { return sizeof(Config); }
+
+		Genode::uint8_t _device_config(unsigned offset) override {
+			return reinterpret_cast<Genode::uint8_t const *>(&_config)[offset]; }
+
+		void _device_notify(unsigned queue) override
+		{
+			if (queue == QUEUE_TX)
+				_process_tx();
+			else
+				_rx_queue.notifications(false);
+		}
+
+		void _device_reset() override { }
+
+	public:
+
+		Virtio_net(Motherboard &mb, unsigned bdf, unsigned irq, unsigned port)
+		:
+			Virtio_device(mb, bdf, irq, port, DEVICE_ID, CLASS_CODE,
+			              SUBSYSTEM_ID)
+		{
+			_queues[QUEUE_RX] = &_rx_queue;
+			_queues[QUEUE_TX] = &_tx_queue;
+			_num_queues       = 2;
+
+			MessageHostOp msg(MessageHostOp::OP_GET_MAC, 0UL);
+			if (!mb.bus_hostop.send(msg))
+				Logging::panic("virtio_net: could not get MAC address\n");
+
+			for (unsigned i = 0; i < sizeof(_config.mac); i++)
+				_config.mac[i] = Genode::uint8_t(msg.mac >> (8 * (5 - i)));
+
+			_config.status = STATUS_LINK_UP;
+		}
+
+		using Virtio_device::receive;
+
+		bool receive(MessageNetwork &msg)
+		{
+			if (msg.type != MessageNetwork::PACKET || msg.buffer == _tx_frame)
+				return false;
+
+			if (!_driver_ok())
+				return false;
+
+			unsigned head = 0;
+			if (!_rx_queue.pop(head)) {
+				_rx_dropped++;
+				return false;
+			}
+
+			/* zeroed header, no offloads are offered */
+			Genode::size_t header = HEADER_SIZE;
+			Genode::size_t offset = 0;
+
+			_rx_queue.for_each_buffer(head,
+				[&] (char *ptr, Genode::size_t size, bool write) {
+					if (!write)
+						return false;
+
+					Genode::size_t const h = Genode::min(header, size);
+					Genode::memset(ptr, 0, h);
+					header -= h;
+					ptr    += h;
+					size   -= h;
+
+					Genode::size_t const n = Genode::min(size, msg.len - offset);
+					Genode::memcpy(ptr, msg.buffer + offset, n);
+					offset += n;
+
+					return offset < msg.len;
+				});
+
+			/* the walk stops early once the frame is complete */
+			bool const complete = offset == msg.len && !header;
+			if (!complete)
+				_rx_dropped++;
+
+			_rx_queue.push(head, complete ? Genode::uint32_t(HEADER_SIZE + msg.len) : 0);
+			_rx_queue.notifications(false);
+			_flush(_rx_queue);
+
+			return complete;
+		}
+};
+
+
+extern "C" void __parameter_virtio_net_fn(Motherboard &mb, unsigned long *argv,
+                                          const char *, unsigned)
+{
+	if (argv[1] == ~0UL || argv[2] == ~0UL)
+		Logging::panic("virtio_net: irq and port are required\n");
+
+	unsigned const bdf = argv[0] == ~0UL ? Seoul::Virtio_device::free_bdf(mb)
+	                                     : unsigned(argv[0]);
+
+	Seoul::Virtio_net * const dev =
+		new Seoul::Virtio_net(mb, bdf, unsigned(argv[1]),
+		                      unsigned(argv[2]));
+
+	mb.bus_pcicfg .add(dev, Seoul::Virtio_net::receive_static<MessagePciConfig>);
+	mb.bus_ioin   .add(dev, Seoul::Virtio_net::receive_static<MessageIOIn>);
+	mb.bus_ioout  .add(dev, Seoul::Virtio_net::receive_static<MessageIOOut>);
+	mb.bus_network.add(dev, Seoul::Virtio_net::receive_static<MessageNetwork>);
+}
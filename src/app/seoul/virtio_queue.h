@@ -0,0 +1,308 @@
+/*
+ * \brief  Split virtqueue of the legacy virtio PCI transport
+ * \author agent
+ * \date   2026-10-19
+ *
+ * The queue lives in guest memory, which is accessed via the local mapping
+ * of the guest RAM. All indices and descriptors are read once and validated
+ * before use because the guest may change them at any time.
+ */
+
+/*
+ * Copyright (C) 2026 agent
+ *
+ * This file is distributed under the terms of the GNU General Public License
+ * version 2.
+ */
+
+#ifndef _VIRTIO_QUEUE_H_
+#define _VIRTIO_QUEUE_H_
+
+#include <base/stdint.h>
+
+namespace Seoul {
+	struct Virtio_guest_memory;
+	class  Virtio_queue;
+}
+
+
+/**
+ * Local view of the guest RAM
+ */
+struct Seoul::Virtio_guest_memory
+{
+	char           *base { nullptr };
+	Genode::size_t  size { 0 };
+
+	/**
+	 * Return local pointer of guest-physical range or nullptr if invalid
+	 */
+	char *ptr(Genode::uint64_t const addr, Genode::size_t const len) const
+	{
+		if (!base || addr > size || len > size - addr)
+			return nullptr;
+
+		return base + addr;
+	}
+};
+
+
+class Seoul::Virtio_queue
+{
+	public:
+
+		enum {
+			MAX_SIZE   = 256,
+			ALIGN      = 4096,
+			PAGE_SHIFT = 12,
+
+			DESC_F_NEXT     = 1,
+			DESC_F_WRITE    = 2,
+			DESC_F_INDIRECT = 4,
+
+			AVAIL_F_NO_INTERRUPT = 1,
+			USED_F_NO_NOTIFY     = 1,
+		};
+
+		struct Descriptor
+		{
+			Genode::uint64_t addr;
+			Genode::uint32_t len;
+			Genode::uint16_t flags;
+			Genode::uint16_t next;
+		} __attribute__((packed));
+
+	private:
+
+		Virtio_guest_memory const &_memory;
+
+		unsigned          _size      { MAX_SIZE };
+		Genode::uint32_t  _pfn       { 0 };
+		bool              _event_idx { false };
+
+		Descriptor       volatile *_desc  { nullptr };
+		Genode::uint16_t volatile *_avail { nullptr };
+		Genode::uint16_t volatile *_used  { nullptr };
+
+		Genode::uint16_t _last_avail { 0 };
+		Genode::uint16_t _used_idx   { 0 };
+
+		/* used index at the last interrupt decision */
+		Genode::uint16_t _signalled  { 0 };
+
+		static void _barrier() { __sync_synchronize(); }
+
+		/*
+		 * Layout of the rings, see virtio specification 1.0, section 2.4.2
+		 *
+		 * avail: flags, idx, ring[size], used_event
+		 * used:  flags, idx, { id (32bit), len (32bit) }[size], avail_event
+		 */
+		Genode::uint16_t volatile &_avail_flags()         { return _avail[0]; }
+		Genode::uint16_t volatile &_avail_idx()           { return _avail[1]; }
+		Genode::uint16_t volatile &_avail_ring(unsigned i) { return _avail[2 + i]; }
+		Genode::uint16_t volatile &_used_event()          { return _avail[2 + _size]; }
+
+		Genode::uint16_t volatile &_used_flags()          { return _used[0]; }
+		Genode::uint16_t volatile &_used_idx_guest()      { return _used[1]; }
+		Genode::uint16_t volatile &_avail_event()         { return _used[2 + 4 * _size]; }
+
+		Genode::uint32_t volatile *_used_elem(unsigned i) {
+			return reinterpret_cast<Genode::uint32_t volatile *>(_used + 2) + 2 * i; }
+
+		static Genode::size_t _avail_bytes(unsigned size) { return 2 * (3 + size); }
+		static Genode::size_t _used_bytes (unsigned size) { return 2 * 3 + 8 * size; }
+
+		static Genode::size_t _align(Genode::size_t v) {
+			return (v + ALIGN - 1) & ~Genode::size_t(ALIGN - 1); }
+
+		/*
+		 * 16-bit ring arithmetic as used by 'vring_need_event'
+		 */
+		static bool _need_event(Genode::uint16_t event, Genode::uint16_t now,
+		                        Genode::uint16_t old)
+		{
+			return Genode::uint16_t(now - event - 1) < Genode::uint16_t(now - old);
+		}
+
+	public:
+
+		Virtio_queue(Virtio_guest_memory const &memory) : _memory(memory) { }
+
+		unsigned         size()  const { return _size; }
+		Genode::uint32_t pfn()   const { return _pfn; }
+		bool             ready() const { return _desc; }
+
+		void event_idx(bool enabled) { _event_idx = enabled; }
+
+		void reset()
+		{
+			_pfn        = 0;
+			_desc       = nullptr;
+			_avail      = nullptr;
+			_used       = nullptr;
+			_last_avail = 0;
+			_used_idx   = 0;
+			_signalled  = 0;
+			_event_idx  = false;
+		}
+
+		/**
+		 * Set guest page frame of the queue, 0 disables the queue
+		 */
+		void pfn(Genode::uint32_t const pfn)
+		{
+			reset();
+
+			if (!pfn)
+				return;
+
+			Genode::uint64_t const base  = Genode::uint64_t(pfn) << PAGE_SHIFT;
+			Genode::size_t   const used  = _align(sizeof(Descriptor) * _size +
+			                                      _avail_bytes(_size));
+			Genode::size_t   const total = used + _used_bytes(_size);
+
+			char * const local = _memory.ptr(base, total);
+			if (!local)
+				return;
+
+			_pfn   = pfn;
+			_desc  = reinterpret_cast<Descriptor volatile *>(local);
+			_avail = reinterpret_cast<Genode::uint16_t volatile *>(
+			         local + sizeof(Descriptor) * _size);
+			_used  = reinterpret_cast<Genode::uint16_t volatile *>(local + used);
+		}
+
+		/**
+		 * Return true if the guest made buffers available
+		 */
+		bool pending()
+		{
+			return ready() && _avail_idx() != _last_avail;
+		}
+
+		/**
+		 * Fetch head of next available descriptor chain
+		 *
+		 * \return false if no buffer is available
+		 */
+		bool pop(unsigned &head)
+		{
+			if (!pending())
+				return false;
+
+			/* read ring entry only after the index */
+			_barrier();
+
+			head = _avail_ring(_last_avail % _size);
+			_last_avail++;
+
+			return head < _size;
+		}
+
+		/**
+		 * Call 'fn(char *ptr, size_t len, bool write)' for each descriptor of
+		 * the chain starting at 'head'
+		 *
+		 * \return false if the chain is malformed or 'fn' returned false
+		 */
+		template <typename FN>
+		bool for_each_buffer(unsigned head, FN const &fn)
+		{
+			if (!ready() || head >= _size)
+				return false;
+
+			/* limit the walk to catch descriptor loops */
+			for (unsigned i = 0, idx = head; i < _size; i++) {
+				Descriptor const d = { _desc[idx].addr, _desc[idx].len,
+				                       _desc[idx].flags, _desc[idx].next };
+
+				/* indirect descriptors are not offered */
+				if (d.flags & DESC_F_INDIRECT)
+					return false;
+
+				char * const ptr = _memory.ptr(d.addr, d.len);
+				if (!ptr || !fn(ptr, Genode::size_t(d.len), bool(d.flags & DESC_F_WRITE)))
+					return false;
+
+				if (!(d.flags & DESC_F_NEXT))
+					return true;
+
+				idx = d.next;
+				if (idx >= _size)
+					return false;
+			}
+			return false;
+		}
+
+		/**
+		 * Return descriptor chain to the guest
+		 *
+		 * The used index is published by 'flush' to batch the update.
+		 */
+		void push(unsigned head, Genode::uint32_t written)
+		{
+			if (!ready())
+				return;
+
+			Genode::uint32_t volatile * const elem = _used_elem(_used_idx % _size);
+			elem[0] = head;
+			elem[1] = written;
+			_used_idx++;
+		}
+
+		/**
+		 * Publish used entries
+		 *
+		 * \return true if the guest asked for an interrupt
+		 */
+		bool flush()
+		{
+			if (!ready() || _used_idx == _signalled)
+				return false;
+
+			/* entries must be visible before the index */
+			_barrier();
+			_used_idx_guest() = _used_idx;
+			_barrier();
+
+			Genode::uint16_t const old = _signalled;
+			_signalled = _used_idx;
+
+			if (_event_idx)
+				return _need_event(_used_event(), _used_idx, old);
+
+			return !(_avail_flags() & AVAIL_F_NO_INTERRUPT);
+		}
+
+		/**
+		 * Enable or disable guest notifications for new buffers
+		 *
+		 * Notifications are disabled while the device processes the queue
+		 * anyway, e.g., on the completion of outstanding requests.
+		 *
+		 * \return true if buffers became available in the meantime, which
+		 *         the caller must process to not miss a notification
+		 */
+		bool notifications(bool enable)
+		{
+			if (!ready())
+				return false;
+
+			if (_event_idx) {
+				/* notify on the next buffer or not before wrap-around */
+				_avail_event() = enable ? _last_avail
+				                        : Genode::uint16_t(_last_avail + 0x8000);
+			} else
+				_used_flags() = enable ? 0 : USED_F_NO_NOTIFY;
+
+			if (!enable)
+				return false;
+
+			/* re-check after publishing the notification request */
+			_barrier();
+			return pending();
+		}
+};
+
+#endif /* _VIRTIO_QUEUE_H_ */
@@ -93,7 +93,8 @@ void Remote_rom::Backend_base::handle_ip(Ethernet_frame &eth,
 {
 	Ipv4_packet &ip = eth.data<Ipv4_packet>(edguard);
 	if (_accept_ip == Ipv4_packet::broadcast()
-		 || _accept_ip == ip.dst()) {
+		 || _accept_ip == ip.dst()
+		 || (_accept_group && _group_ip == ip.dst())) {
 
 		if (ip.protocol() == Ipv4_packet::Protocol::UDP) {
 			if (_dst_mac == Ethernet_frame::broadcast() && ip.src() == _dst_ip) {
@@ -102,7 +103,7 @@ void Remote_rom::Backend_base::handle_ip(Ethernet_frame &eth,
 			/* remote_rom protocol is wrapped in UDP */
 			Udp_packet &udp = ip.data<Udp_packet>(edguard);
 			if (udp.dst_port() == _udp_port)
-				receive(udp.data<Packet>(edguard), edguard);
+				receive(udp.data<Packet>(edguard), edguard, ip.src());
 		}
 	}
 }
@@ -62,6 +62,22 @@ class Remote_rom::Backend_base : public Genode::Interface
 			Genode::log("link state changed");
 		}
 
+		static bool _multicast(Ipv4_address const &ip)
+		{
+			return (ip.addr[0] & 0xf0) == 0xe0;
+		}
+
+		/**
+		 * Return Ethernet address of an IPv4 multicast group
+		 */
+		static Mac_address _multicast_mac(Ipv4_address const &ip)
+		{
+			Genode::uint8_t mac[6] = { 0x01, 0x00, 0x5e,
+			                           (Genode::uint8_t)(ip.addr[1] & 0x7f),
+			                           ip.addr[2], ip.addr[3] };
+			return Mac_address(mac);
+		}
+
 		void _tx_ack(bool block = false)
 		{
 			/* check for acknowledgements */
@@ -90,12 +106,22 @@ class Remote_rom::Backend_base : public Genode::Interface
 		Ipv4_address          _src_ip;
 		Ipv4_address          _accept_ip;
 		Ipv4_address          _dst_ip;
+		Ipv4_address          _group_ip;
+		bool                  _accept_group;
 		bool                  _chksum_offload { false };
 
 		/**
 		 * Handle accepted network packet from the other side
+		 *
+		 * \param src  IP address of the sender
+		 */
+		virtual void receive(Packet &packet, Size_guard &,
+		                     Ipv4_address const &src) = 0;
+
+		/**
+		 * Return true if packets are sent to a multicast group
 		 */
-		virtual void receive(Packet &packet, Size_guard &) = 0;
+		bool multicast() const { return _multicast(_dst_ip); }
 
 		inline void arp_request()
 		{
@@ -164,7 +190,9 @@ class Remote_rom::Backend_base : public Genode::Interface
 
 		template <typename T>
 		void transmit_notification(Packet::Type type,
-		                           T const &frontend)
+		                           T const &frontend,
+		                           unsigned base_hash = 0,
+		                           unsigned flags     = 0)
 		{
 			size_t const frame_size = sizeof(Ethernet_frame)
 			                        + sizeof(Ipv4_packet)
@@ -191,6 +219,8 @@ class Remote_rom::Backend_base : public Genode::Interface
 			NotificationPacket &npak =
 				pak.construct_at_data<NotificationPacket>(size_guard);
 			npak.content_size(frontend.content_size());
+			npak.base_hash(base_hash);
+			npak.flags(flags);
 
 			/* fill in header values that need the packet to be complete already */
 			udp.length(size_guard.head_size() - udp_off);
@@ -221,8 +251,14 @@ class Remote_rom::Backend_base : public Genode::Interface
 		  _src_ip   (policy.attribute_value("src", Ipv4_packet::current())),
 		  _accept_ip(policy.attribute_value("src", Ipv4_packet::broadcast())),
 		  _dst_ip   (policy.attribute_value("dst", Ipv4_packet::broadcast())),
+		  _group_ip (policy.attribute_value("multicast", Ipv4_address())),
+		  _accept_group(policy.has_attribute("multicast")),
 		  _chksum_offload(config.attribute_value("chksum_offload", _chksum_offload))
 		{
+			/* multicast groups need no address resolution */
+			if (multicast())
+				_dst_mac = _multicast_mac(_dst_ip);
+
 			_nic.link_state_sigh(_link_state_handler);
 			_nic.rx_channel()->sigh_packet_avail(_rx_packet_handler);
 		}
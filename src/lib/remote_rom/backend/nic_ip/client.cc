@@ -5,42 +5,75 @@
  * \date   2018-11-06
  */
 
+#include <util/list.h>
+#include <base/attached_ram_dataspace.h>
+
 #include <base.h>
 #include <backend_base.h>
+#include <compression.h>
+#include <digest.h>
 
 namespace Remote_rom {
 	using  Genode::Cstring;
 	using  Genode::Microseconds;
+	using  Genode::Attached_ram_dataspace;
 
 	class Content_receiver;
 	class Backend_client;
 };
 
-class Remote_rom::Content_receiver
+class Remote_rom::Content_receiver : public Genode::List<Content_receiver>::Element
 {
 	private:
 		enum {
-			MAX_PAYLOAD_SIZE = DataPacket::MAX_PAYLOAD_SIZE,
-			TIMEOUT_DATA_US   = 50000   /*  50ms */
+			MAX_PAYLOAD_SIZE  = DataPacket::MAX_PAYLOAD_SIZE,
+			TIMEOUT_DATA_US   = 50000,  /*  50ms */
+			MAX_DIGEST_ERRORS = 3,
+
+			/* flags that stay the same for all packets of a round */
+			MODE_FLAGS        = DataPacket::DELTA
+			                  | DataPacket::COMPRESSED
+			                  | DataPacket::DIGEST,
 		};
 
 		char                      *_write_ptr      { nullptr };
 		size_t                     _buf_size       { 0 };
-		size_t                     _offset         { 0 };
+		bool                       _mode_known     { false };
+		unsigned                   _mode           { 0 };
 
 		/* window state */
 		size_t                     _window_id      { 0 };
 		size_t                     _window_length  { 0 };
-		size_t                     _next_packet_id { 0 };
-		bool                       _omit_nack      { false };
+		size_t                     _received_count { 0 };
+		bool                       _last_window    { false };
+		Window_state               _received       { };
+
+		/* compressed stream, decompressed frame by frame */
+		Genode::Ram_allocator     &_ram;
+		Attached_ram_dataspace     _stream;
+		bool                       _compressed     { false };
+		bool                       _stream_error   { false };
+		size_t                     _stream_end     { 0 };
+		size_t                     _stream_done    { 0 };
+		size_t                     _raw_done       { 0 };
+
+		/*
+		 * Window digests
+		 *
+		 * We remember where the payload of each packet was written to so
+		 * that we are able to verify the window once it is complete.
+		 */
+		bool                       _digest         { false };
+		bool                       _corrupt        { false };
+		unsigned                   _digest_errors  { 0 };
+		uint8_t                    _window_digest[DataPacket::DIGEST_SIZE] { };
+		uint32_t                   _packet_offset[Window_state::MAX_PACKETS] { };
+		uint16_t                   _packet_size[Window_state::MAX_PACKETS]   { };
 
 		/* timeouts and general object management*/
 		Timer::One_shot_timeout<Content_receiver> _timeout;
 		Backend_client            &_backend;
-		Rom_receiver_base         *_frontend       { nullptr };
-
-		size_t _write_offset()
-		{ return _offset + _next_packet_id * MAX_PAYLOAD_SIZE; }
+		Rom_receiver_base         *_frontend;
 
 		void timeout_handler(Genode::Duration);
 
@@ -48,50 +81,168 @@ class Remote_rom::Content_receiver
 		Content_receiver(Content_receiver const &);
 		Content_receiver &operator=(Content_receiver const &);
 
-		bool _start_window(size_t window_length)
+		/**
+		 * Forget the progress of the current transmission round
+		 */
+		void _reset_reception()
 		{
-			/* calculate offset to beginning of new window */
-			_offset += _window_length * MAX_PAYLOAD_SIZE;
-
-			/* zero packet_id marks first window */
-			if (_next_packet_id > 0)
-				_window_id++;
+			_mode_known     = false;
+			_mode           = 0;
+			_window_id      = 0;
+			_window_length  = 0;
+			_received_count = 0;
+			_last_window    = false;
+			_received.clear();
+			_compressed     = false;
+			_stream_error   = false;
+			_stream_end     = 0;
+			_stream_done    = 0;
+			_raw_done       = 0;
+			_digest         = false;
+			_digest_errors  = 0;
+		}
 
-			_window_length  = window_length;
-			_next_packet_id = 0;
+		bool _start_window(DataPacket const &p)
+		{
+			/*
+			 * Windows are numbered consecutively starting with 0, which
+			 * also drops the windows of a round we joined in the middle.
+			 * A zero window length marks the first window.
+			 */
+			size_t const expected = _window_length ? _window_id + 1 : 0;
+			if (p.window_id() != expected)
+				return false;
 
-			if (_offset >= _buf_size)
+			if (!p.window_length() || p.window_length() > Window_state::MAX_PACKETS) {
+				Genode::warning("invalid window length ", p.window_length());
 				return false;
+			}
 
+			_window_id      = expected;
+			_window_length  = p.window_length();
+			_last_window    = p.flags() & DataPacket::LAST_WINDOW;
+			_received_count = 0;
+			_received.clear();
 
 			return true;
 		}
 
-		void _write(const void *data, size_t packet_id, size_t size)
+		/**
+		 * Write payload to content or stream buffer
+		 *
+		 * \return number of bytes written
+		 */
+		size_t _write(const void *data, size_t offset, size_t size)
 		{
-			if (!_write_ptr) return;
-			if (packet_id != _next_packet_id) return;
+			if (!_write_ptr) return 0;
 
-			size_t const offset = _write_offset();
-			if (offset >= _buf_size)
-				return;
+			char * const dst      = _compressed ? _stream.local_addr<char>()
+			                                    : _write_ptr;
+			size_t const dst_size = _compressed ? _stream.size() : _buf_size;
+
+			if (offset >= dst_size)
+				return 0;
+
+			size_t const len = Genode::min(size, dst_size-offset);
+			Genode::memcpy(dst+offset, data, len);
 
-			size_t const len = Genode::min(size, _buf_size-offset);
-			Genode::memcpy(_write_ptr+offset, data, len);
+			_stream_end = Genode::max(_stream_end, offset + len);
+
+			return len;
 		}
 
-	public:
-		Content_receiver(Timer::Connection &timer,
-		                 Backend_client    &backend)
-		: _timeout(timer, *this, &Content_receiver::timeout_handler),
-		  _backend(backend)
-		{ }
+		/**
+		 * Check the payloads of the completed window against its digest
+		 */
+		bool _verify_window() const
+		{
+			char const * const base = _compressed ? _stream.local_addr<char const>()
+			                                      : _write_ptr;
+
+			Window_digest digest;
+			for (size_t i = 0; i < _window_length; i++)
+				digest.update(base + _packet_offset[i], _packet_size[i]);
 
-		void register_receiver(Rom_receiver_base *frontend)
+			uint8_t result[Window_digest::SIZE];
+			digest.finish(result);
+
+			return !Genode::memcmp(result, _window_digest, sizeof(result));
+		}
+
+		/**
+		 * Discard the current window and request its retransmission
+		 */
+		void _window_corrupt()
+		{
+			if (++_digest_errors > MAX_DIGEST_ERRORS) {
+				Genode::warning("giving up after ", (unsigned)MAX_DIGEST_ERRORS,
+				                " digest errors");
+				_write_ptr = nullptr;
+				_frontend->commit_new_content(true);
+				return;
+			}
+
+			Genode::warning("digest mismatch in window ", _window_id,
+			                ", requesting retransmission");
+
+			_received.clear();
+			_received_count = 0;
+
+			_corrupt = true;
+			_backend.send_ack(*this);
+			_corrupt = false;
+
+			_timeout.schedule(Microseconds(TIMEOUT_DATA_US));
+		}
+
+		/**
+		 * Decompress all frames received completely
+		 *
+		 * Must only be called on window completion as the stream is
+		 * contiguous up to '_stream_end' then.
+		 */
+		void _decompress()
 		{
-			_frontend = frontend;
+			char const * const stream = _stream.local_addr<char const>();
+
+			while (!_stream_error
+			    && _stream_done + sizeof(Frame_header) <= _stream_end) {
+
+				Frame_header const &header =
+					*reinterpret_cast<Frame_header const *>(stream + _stream_done);
+
+				size_t const payload   = _stream_done + sizeof(Frame_header);
+				size_t const frame_end = payload + header.compressed_size;
+				if (frame_end > _stream_end)
+					break;
+
+				if (_raw_done + header.raw_size > _buf_size
+				 || !Compression::uncompress(stream + payload,
+				                             header.compressed_size,
+				                             _write_ptr + _raw_done,
+				                             header.raw_size)) {
+					Genode::warning("corrupt frame in compressed stream");
+					_stream_error = true;
+					return;
+				}
+
+				_raw_done    += header.raw_size;
+				_stream_done  = frame_end;
+			}
 		}
 
+	public:
+		Content_receiver(Genode::Env       &env,
+		                 Timer::Connection &timer,
+		                 Backend_client    &backend,
+		                 Rom_receiver_base &frontend)
+		: _ram(env.ram()),
+		  _stream(env.ram(), env.rm(), 0),
+		  _timeout(timer, *this, &Content_receiver::timeout_handler),
+		  _backend(backend),
+		  _frontend(&frontend)
+		{ }
+
 		void start_new_content(unsigned hash,
 		                       size_t   size)
 		{
@@ -99,11 +250,7 @@ class Remote_rom::Content_receiver
 
 			_write_ptr      = _frontend->start_new_content(hash, size);
 			_buf_size       = _write_ptr ? size : 0;
-			_offset         = 0;
-			_window_id      = 0;
-			_window_length  = 0;
-			_next_packet_id = 0;
-			_omit_nack      = false;
+			_reset_reception();
 
 			if (_timeout.scheduled())
 				_timeout.discard();
@@ -119,24 +266,30 @@ class Remote_rom::Content_receiver
 		char const *module_name() const
 		{ return _frontend ? _frontend->module_name()  : ""; }
 
+		unsigned base_hash() const
+		{ return _frontend ? _frontend->base_hash() : 0; }
+
 		size_t content_size() const
 		{ return _buf_size; }
 
-		bool window_complete()
+		bool window_complete() const
 		{
 			/* remark: also returns true if we havent started any window yet */
-			return _next_packet_id == _window_length;
+			return _received_count == _window_length;
 		}
 
-		bool complete()
+		bool complete() const
 		{
-			return _write_offset() >= _buf_size;
+			return _last_window && window_complete();
 		}
 
 		bool accept_packet(const DataPacket &p);
 
-		size_t window_id()        { return _window_id; }
-		size_t ack_until()        { return _next_packet_id; }
+		size_t window_id()              const { return _window_id; }
+		size_t ack_until()              const { return _received.first_missing(_window_length); }
+		Window_state const &received()  const { return _received; }
+
+		unsigned ack_flags() const { return _corrupt ? AckPacket::CORRUPT : 0; }
 };
 
 class Remote_rom::Backend_client :
@@ -146,26 +299,41 @@ class Remote_rom::Backend_client :
 	private:
 		friend class Content_receiver;
 
-		Content_receiver   _content_receiver { _timer, *this };
+		Genode::Env                    &_env;
+		Genode::Allocator              &_alloc;
+		Genode::List<Content_receiver>  _receivers { };
 
 		Backend_client(Backend_client &);
 		Backend_client &operator= (Backend_client &);
 
-		void update(const char* module_name)
+		Content_receiver *_lookup(char const *module_name)
 		{
-			/* check module name */
-			if (Genode::strcmp(module_name, _content_receiver.module_name()))
-				return;
+			for (Content_receiver *r = _receivers.first(); r; r = r->next())
+				if (!Genode::strcmp(module_name, r->module_name()))
+					return r;
+
+			return nullptr;
+		}
 
+		void update(Content_receiver const &receiver)
+		{
 			if (_verbose)
-				Genode::log("sending UPDATE(", _content_receiver.module_name(), ")");
+				Genode::log("sending UPDATE(", receiver.module_name(), ")");
+
+			/* offer the content we already hold as base for a delta */
+			unsigned const base_hash = receiver.base_hash();
 
-			transmit_notification(Packet::UPDATE, _content_receiver);
+			unsigned const flags = NotificationPacket::COMPRESSED
+			                     | NotificationPacket::DIGEST
+			                     | (base_hash ? NotificationPacket::DELTA : 0);
+
+			transmit_notification(Packet::UPDATE, receiver, base_hash, flags);
 		}
 
 		void send_ack(Content_receiver const &recv);
 
-		void receive(Packet &packet, Size_guard &size_guard) override;
+		void receive(Packet &packet, Size_guard &size_guard,
+		             Ipv4_address const &) override;
 
 	public:
 
@@ -173,14 +341,15 @@ class Remote_rom::Backend_client :
 		               Genode::Allocator &alloc,
 		               Genode::Xml_node config,
 		               Genode::Xml_node policy)
-		: Backend_base(env, alloc, config, policy)
+		: Backend_base(env, alloc, config, policy),
+		  _env(env), _alloc(alloc)
 		{ }
 
 
 		void register_receiver(Rom_receiver_base *receiver) override
 		{
-			/* TODO support multiple receivers (ROM names) */
-			_content_receiver.register_receiver(receiver);
+			_receivers.insert(new (_alloc)
+				Content_receiver(_env, _timer, *this, *receiver));
 
 			/*
 			 * FIXME request update on startup
@@ -234,8 +403,10 @@ void Remote_rom::Backend_client::send_ack(Content_receiver const &recv)
 
 	AckPacket &ack =
 		pak.construct_at_data<AckPacket>(size_guard);
-	ack.window_id(_content_receiver.window_id());
-	ack.ack_until(_content_receiver.ack_until());
+	ack.window_id(recv.window_id());
+	ack.ack_until(recv.ack_until());
+	ack.flags(recv.ack_flags());
+	ack.window_state() = recv.received();
 
 	/* fill in header values that need the packet to be complete already */
 	udp.length(size_guard.head_size() - udp_off);
@@ -248,16 +419,21 @@ void Remote_rom::Backend_client::send_ack(Content_receiver const &recv)
 	submit_tx_packet(pd);
 
 	if (_verbose)
-		Genode::log("Sent ACK for window ", _content_receiver.window_id());
+		Genode::log("Sent ACK for window ", recv.window_id());
 }
 
-void Remote_rom::Backend_client::receive(Packet     &packet,
-                                         Size_guard &size_guard)
+void Remote_rom::Backend_client::receive(Packet             &packet,
+                                         Size_guard         &size_guard,
+                                         Ipv4_address const &)
 {
 	switch (packet.type())
 	{
 		case Packet::SIGNAL:
 		{
+			Content_receiver *receiver = _lookup(packet.module_name());
+			if (!receiver)
+				return;
+
 			const NotificationPacket &signal
 				= packet.data<NotificationPacket>(size_guard);
 
@@ -268,34 +444,35 @@ void Remote_rom::Backend_client::receive(Packet     &packet,
 						      signal.content_size());
 
 			/* start new content with given size and hash */
-			_content_receiver.start_new_content(
+			receiver->start_new_content(
 					packet.content_hash(),
 					signal.content_size());
 
 			/* send update request */
-			update(packet.module_name());
+			update(*receiver);
 
 			break;
 		}
 		case Packet::DATA:
 		{
 			/* check module name */
-			if (Genode::strcmp(packet.module_name(), _content_receiver.module_name()))
+			Content_receiver *receiver = _lookup(packet.module_name());
+			if (!receiver)
 				return;
 
 			/* check hash */
-			if (packet.content_hash() != _content_receiver.content_hash()) {
+			if (packet.content_hash() != receiver->content_hash()) {
 				Genode::warning("ignoring hash mismatch ",
 				                Genode::Hex(packet.content_hash()),
 				                " != ",
-				                Genode::Hex(_content_receiver.content_hash()));
+				                Genode::Hex(receiver->content_hash()));
 				return;
 			}
 
 			const DataPacket &data = packet.data<DataPacket>(size_guard);
 			size_guard.consume_head(data.payload_size());
 
-			_content_receiver.accept_packet(data);
+			receiver->accept_packet(data);
 
 			break;
 		}
@@ -312,7 +489,7 @@ void Remote_rom::Backend_client::receive(Packet     &packet,
 
 void Remote_rom::Content_receiver::timeout_handler(Genode::Duration)
 {
-	Genode::warning("timeout occurred waiting for packet ", _next_packet_id,
+	Genode::warning("timeout occurred waiting for packet ", ack_until(),
 	                " in window ", _window_id, " of length ", _window_length);
 	_backend.send_ack(*this);
 }
@@ -322,67 +499,105 @@ bool Remote_rom::Content_receiver::accept_packet(const DataPacket &p)
 	/**
 	 * TODO replace return value with exceptions
 	 */
-	if (complete() || !_frontend) return false;
+	if (!_frontend || !_write_ptr) return false;
 
-	if (_timeout.scheduled())
-		_timeout.discard();
+	unsigned const mode = p.flags() & MODE_FLAGS;
 
-	if (window_complete()) {
-		if (!_start_window(p.window_length())) {
-			Genode::warning("unexpected error starting window of size ",
-			                p.window_length());
-			return false;
-		}
+	/* the sender missed our ACK and retransmits the completed window */
+	if (window_complete() && _window_length && p.window_id() == _window_id
+	 && p.window_length() == _window_length && mode == _mode) {
+		Genode::log("re-sending ACK");
+		_backend.send_ack(*this);
+		return false;
 	}
 
-	/* drop packets with wrong window id */
-	if (p.window_id() != _window_id) {
-		if  (p.window_id() == _window_id-1
-		  && p.packet_id() == p.window_length()-1) {
+	if (complete()) return false;
 
-			/* rollback the window */
-			_offset        -= _window_length * MAX_PAYLOAD_SIZE;
-			_window_id      = p.window_id();
-			_window_length  = p.window_length();
-			_next_packet_id = _window_length;
+	/*
+	 * The sender started a new round, e.g., for receivers that requested
+	 * the content meanwhile, or the round we joined in the middle ended.
+	 * Start over with the first window of the new round.
+	 */
+	if (_window_length && p.window_id() == 0
+	 && (_window_id != 0 || p.window_length() != _window_length || mode != _mode)) {
+		Genode::log("transmission restarted, resynchronizing");
+		_reset_reception();
+	}
 
-			/* send acknowledge if we receive the last packet, as
-			 * the sender missed our previous ACK */
-			Genode::log("re-sending ACK");
-			_backend.send_ack(*this);
-		}
+	if (window_complete() && !_start_window(p))
 		return false;
-	}
 
-	/* NACK if we missed a packet */
-	if (p.packet_id() != _next_packet_id) {
+	/* drop packets that do not belong to the current window */
+	if (p.window_id() != _window_id || p.window_length() != _window_length
+	 || p.packet_id() >= _window_length || (_mode_known && mode != _mode))
+		return false;
 
-		if (!_omit_nack) {
+	if (_timeout.scheduled())
+		_timeout.discard();
 
-			Genode::log("lost packet, sending NACK");
-			_backend.send_ack(*this);
+	/* patch the previous content if we receive a delta */
+	if (!_mode_known) {
+		if (p.flags() & DataPacket::DELTA)
+			_frontend->start_delta();
+
+		/* receive compressed content into the stream buffer */
+		if (p.flags() & DataPacket::COMPRESSED) {
+			size_t const max = Compression::max_stream_size(_buf_size);
+			if (_stream.size() < max)
+				_stream.realloc(&_ram, max);
 
-			/* omit any further NACKs until we received a correct
-			 * package or a timeout occurred */
-			_omit_nack = true;
+			_compressed = true;
 		}
 
-		return false;
+		_digest     = p.flags() & DataPacket::DIGEST;
+		_mode       = mode;
+		_mode_known = true;
 	}
-	else {
-		_omit_nack = false;
+
+	/* ignore duplicates */
+	if (!_received.received(p.packet_id())) {
+		size_t const id = p.packet_id();
+
+		/* all packets of a window carry the same digest */
+		if (_digest && !_received_count)
+			Genode::memcpy(_window_digest, p.digest(), sizeof(_window_digest));
+
+		_packet_offset[id] = p.offset();
+		_packet_size[id]   = _write(p.addr(), p.offset(), p.payload_size());
+		_received.set(id);
+		_received_count++;
 	}
 
-	_write(p.addr(), p.packet_id(), p.payload_size());
-	_next_packet_id++;
+	if (window_complete()) {
+		if (_digest) {
+			if (!_verify_window()) {
+				_window_corrupt();
+				return false;
+			}
+			_digest_errors = 0;
+		}
+
+		_backend.send_ack(*this);
+
+		if (_compressed)
+			_decompress();
 
-	if (window_complete())
+		if (complete()) {
+			/* verified windows make the checksum of the content redundant */
+			_frontend->commit_new_content(false, _digest && !_stream_error);
+			return true;
+		}
+	}
+	else if (p.packet_id() == _window_length-1) {
+		/*
+		 * The last packet of the window arrived but we missed others,
+		 * request retransmission of the missing packets only.
+		 */
+		Genode::log("lost packets, sending selective ACK");
 		_backend.send_ack(*this);
+	}
 
-	if (complete())
-		_frontend->commit_new_content();
-	else
-		_timeout.schedule(Microseconds(TIMEOUT_DATA_US));
+	_timeout.schedule(Microseconds(TIMEOUT_DATA_US));
 
 	return true;
 }
@@ -0,0 +1,40 @@
+/*
+ * \brief  Compression of the transferred ROM content using snappy
+ * \author agent
+ * \date   2026-10-19
+ */
+
+#include <snappy.h>
+
+#include <compression.h>
+
+Genode::size_t Remote_rom::Compression::max_frame_size(size_t raw_size)
+{
+	return sizeof(Frame_header) + snappy::MaxCompressedLength(raw_size);
+}
+
+
+Genode::size_t Remote_rom::Compression::compress_frame(char const *src,
+                                                        size_t      len,
+                                                        char       *dst)
+{
+	size_t compressed_size = 0;
+	snappy::RawCompress(src, len, dst + sizeof(Frame_header), &compressed_size);
+
+	Frame_header &header = *reinterpret_cast<Frame_header *>(dst);
+	header.raw_size        = len;
+	header.compressed_size = compressed_size;
+
+	return sizeof(Frame_header) + compressed_size;
+}
+
+
+bool Remote_rom::Compression::uncompress(char const *src, size_t len,
+                                         char *dst, size_t raw_size)
+{
+	size_t size = 0;
+	if (!snappy::GetUncompressedLength(src, len, &size) || size != raw_size)
+		return false;
+
+	return snappy::RawUncompress(src, len, dst);
+}
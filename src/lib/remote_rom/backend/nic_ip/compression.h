@@ -0,0 +1,70 @@
+/*
+ * \brief  Compression of the transferred ROM content
+ * \author agent
+ * \date   2026-10-19
+ *
+ * The content is split into frames that are compressed independently. Thus,
+ * the receiver is able to decompress each frame as soon as it arrived.
+ */
+
+#include <base/fixed_stdint.h>
+#include <base/stdint.h>
+
+#ifndef __INCLUDE__REMOTE_ROM__COMPRESSION_H_
+#define __INCLUDE__REMOTE_ROM__COMPRESSION_H_
+
+namespace Remote_rom {
+	using Genode::size_t;
+	using Genode::uint32_t;
+
+	struct Frame_header;
+
+	namespace Compression {
+
+		enum { FRAME_SIZE = 64*1024 };   /* uncompressed size of a frame */
+
+		/**
+		 * Return maximum size of a compressed frame including its header
+		 */
+		size_t max_frame_size(size_t raw_size);
+
+		/**
+		 * Return maximum size of the compressed stream
+		 */
+		inline size_t max_stream_size(size_t raw_size)
+		{
+			size_t const frames = raw_size / FRAME_SIZE
+			                    + ((raw_size % FRAME_SIZE) ? 1 : 0);
+			return frames * max_frame_size(FRAME_SIZE);
+		}
+
+		/**
+		 * Compress 'len' bytes into a frame
+		 *
+		 * \param dst  buffer of at least 'max_frame_size(len)' bytes
+		 *
+		 * \return size of the frame including its header
+		 */
+		size_t compress_frame(char const *src, size_t len, char *dst);
+
+		/**
+		 * Decompress the payload of a frame
+		 *
+		 * \return false if the payload is corrupt or does not match 'raw_size'
+		 */
+		bool uncompress(char const *src, size_t len, char *dst, size_t raw_size);
+	}
+}
+
+
+/**
+ * Header preceding each frame of the compressed stream
+ */
+struct Remote_rom::Frame_header
+{
+	uint32_t raw_size;          /* size of the decompressed frame */
+	uint32_t compressed_size;   /* size of the payload following the header */
+
+} __attribute__((packed));
+
+#endif
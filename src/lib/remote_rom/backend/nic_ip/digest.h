@@ -0,0 +1,46 @@
+/*
+ * \brief  Digest of the content transferred within a window
+ * \author agent
+ * \date   2026-10-19
+ */
+
+#include <base/stdint.h>
+#include <nettle/sha2.h>
+
+#ifndef __INCLUDE__REMOTE_ROM__DIGEST_H_
+#define __INCLUDE__REMOTE_ROM__DIGEST_H_
+
+namespace Remote_rom {
+	using Genode::size_t;
+	using Genode::uint8_t;
+
+	class Window_digest;
+}
+
+
+/**
+ * SHA-256 digest calculated incrementally over the payloads of a window
+ */
+class Remote_rom::Window_digest
+{
+	public:
+
+		enum { SIZE = SHA256_DIGEST_SIZE };
+
+	private:
+
+		sha256_ctx _ctx { };
+
+	public:
+
+		Window_digest() { sha256_init(&_ctx); }
+
+		void update(void const *data, size_t len)
+		{
+			sha256_update(&_ctx, len, static_cast<uint8_t const *>(data));
+		}
+
+		void finish(uint8_t *digest) { sha256_digest(&_ctx, SIZE, digest); }
+};
+
+#endif
@@ -91,49 +91,159 @@ class Remote_rom::Packet
 
 class Remote_rom::NotificationPacket
 {
+	public:
+		enum Flags {
+			DELTA      = 1 << 0,      /* receiver is able to apply a delta */
+			COMPRESSED = 1 << 1,      /* receiver accepts compressed content */
+			DIGEST     = 1 << 2,      /* receiver verifies window digests */
+		};
+
 	private:
 		uint32_t     _content_size;   /* ROM content size in bytes */
+		uint32_t     _base_hash;      /* version the receiver currently holds */
+		uint16_t     _flags;
 
 	public:
 
 		void   content_size(size_t size) { _content_size = size; }
 		size_t content_size() const      { return _content_size; }
 
+		void     base_hash(uint32_t hash) { _base_hash = hash; }
+		uint32_t base_hash() const        { return _base_hash; }
+
+		void     flags(unsigned flags)    { _flags = flags; }
+		unsigned flags() const            { return _flags; }
+
 } __attribute__((packed));
 
-class Remote_rom::AckPacket
+/**
+ * Reception state of the packets within a window
+ *
+ * The state is transferred as part of an 'AckPacket' and thus must not
+ * contain anything but a plain bit field.
+ */
+class Remote_rom::Window_state
 {
+	public:
+		enum { MAX_PACKETS = 1024 };   /* maximum number of packets per window */
+
 	private:
-		uint16_t     _window_id;   /* refers to this window id */
-		uint16_t     _ack_until;   /* acknowledge until this packet id - 1 */
+		uint8_t      _bits[MAX_PACKETS / 8];
+
+		static size_t _limit(size_t length)
+		{ return length < MAX_PACKETS ? length : MAX_PACKETS; }
+
+	public:
+
+		void clear() { Genode::memset(_bits, 0, sizeof(_bits)); }
+
+		void set(size_t id)
+		{
+			if (id < MAX_PACKETS)
+				_bits[id / 8] = (uint8_t)(_bits[id / 8] | (1 << (id % 8)));
+		}
+
+		bool received(size_t id) const
+		{ return id < MAX_PACKETS && (_bits[id / 8] & (1 << (id % 8))); }
+
+		/**
+		 * Add the packets marked as received in 'other'
+		 */
+		void merge(Window_state const &other)
+		{
+			for (size_t i = 0; i < sizeof(_bits); i++)
+				_bits[i] = (uint8_t)(_bits[i] | other._bits[i]);
+		}
+
+		/**
+		 * Keep only the packets also marked as received in 'other'
+		 */
+		void intersect(Window_state const &other)
+		{
+			for (size_t i = 0; i < sizeof(_bits); i++)
+				_bits[i] = (uint8_t)(_bits[i] & other._bits[i]);
+		}
+
+		/**
+		 * Return id of the first packet not yet received
+		 */
+		size_t first_missing(size_t length) const
+		{
+			size_t const max = _limit(length);
+			for (size_t id = 0; id < max; id++)
+				if (!received(id)) return id;
+
+			return max;
+		}
 
 		/**
-		 * TODO Implement selective ARQ by using a Bit_array to save
-		 *      the ACK state in the window.
-		 *      We should, however, not use the Bit_array directly as a
-		 *      Packet member.
+		 * Return number of received packets within the first 'length' packets
 		 */
+		size_t count(size_t length) const
+		{
+			size_t const max = _limit(length);
+			size_t cnt = 0;
+			for (size_t id = 0; id < max; id++)
+				if (received(id)) cnt++;
+
+			return cnt;
+		}
+
+		bool complete(size_t length) const
+		{ return first_missing(length) == _limit(length); }
+
+} __attribute__((packed));
+
+class Remote_rom::AckPacket
+{
+	public:
+		enum Flags {
+			CORRUPT = 1 << 0,          /* window failed verification */
+		};
+
+	private:
+		uint16_t     _window_id;   /* refers to this window id */
+		uint16_t     _ack_until;   /* acknowledge until this packet id - 1 */
+		uint16_t     _flags;
+		Window_state _state;       /* selective acknowledgement of packets */
 
 	public:
 
+		void     flags(unsigned flags) { _flags = flags; }
+		unsigned flags() const         { return _flags; }
+
 		void window_id(size_t window_id) { _window_id = window_id; }
 		void ack_until(size_t packet_id) { _ack_until = packet_id; }
 
 		size_t window_id() const { return _window_id; }
 		size_t ack_until() const { return _ack_until; }
 
+		Window_state       &window_state()       { return _state; }
+		Window_state const &window_state() const { return _state; }
+
 } __attribute__((packed));
 
 class Remote_rom::DataPacket
 {
 	public:
 		static const size_t MAX_PAYLOAD_SIZE = 1350;
+		static const size_t DIGEST_SIZE      = 32;
+
+		enum Flags {
+			LAST_WINDOW = 1 << 0,      /* packet belongs to the last window */
+			DELTA       = 1 << 1,      /* payload patches the previous version */
+			COMPRESSED  = 1 << 2,      /* payload is part of a compressed stream */
+			DIGEST      = 1 << 3,      /* packet carries the window digest */
+		};
 
 	private:
 		uint16_t     _payload_size;    /* payload size in bytes */
 		uint16_t     _window_id;       /* window id */
 		uint16_t     _packet_id;       /* packet number within window */
 		uint16_t     _window_length;   /* 0: no ARQ, >0: ARQ window length */
+		uint16_t     _flags;
+		uint32_t     _offset;          /* content or stream offset of the payload */
+		uint8_t      _digest[DIGEST_SIZE]; /* digest of all window payloads */
 
 		char _data[0];
 
@@ -151,6 +261,19 @@ class Remote_rom::DataPacket
 		size_t window_id()     const { return _window_id; }
 		size_t packet_id()     const { return _packet_id; }
 
+		void     flags(unsigned flags) { _flags = flags; }
+		unsigned flags() const         { return _flags; }
+
+		void   offset(size_t offset) { _offset = offset; }
+		size_t offset() const        { return _offset; }
+
+		void digest(uint8_t const *digest)
+		{
+			Genode::memcpy(_digest, digest, DIGEST_SIZE);
+		}
+
+		uint8_t const *digest() const { return _digest; }
+
 		/**
 		 * Set payload size of the packet
 		 */
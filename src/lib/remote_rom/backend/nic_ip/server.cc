@@ -5,45 +5,217 @@
  * \date   2018-11-06
  */
 
+#include <base/attached_ram_dataspace.h>
+#include <util/list.h>
+
 #include <base.h>
 #include <backend_base.h>
+#include <compression.h>
+#include <digest.h>
 
 namespace Remote_rom {
 	using  Genode::Cstring;
 	using  Genode::Microseconds;
+	using  Genode::uint64_t;
+	using  Genode::Attached_ram_dataspace;
 
+	class Rtt_estimator;
+	struct Subscriber;
 	class Content_sender;
 	class Backend_server;
 };
 
-class Remote_rom::Content_sender
+
+/**
+ * Estimation of the ACK round-trip time (RFC 6298)
+ */
+class Remote_rom::Rtt_estimator
+{
+	private:
+		enum {
+			TIMEOUT_INITIAL_US = 1000000,   /* 1000ms */
+			TIMEOUT_MIN_US     =   10000,   /*   10ms */
+			TIMEOUT_MAX_US     = 4000000,   /* 4000ms */
+		};
+
+		uint64_t _srtt_us   { 0 };
+		uint64_t _rttvar_us { 0 };
+		uint64_t _rto_us    { TIMEOUT_INITIAL_US };
+
+		static uint64_t _clamp(uint64_t us)
+		{
+			return Genode::min((uint64_t)TIMEOUT_MAX_US,
+			                   Genode::max((uint64_t)TIMEOUT_MIN_US, us));
+		}
+
+	public:
+
+		void sample(uint64_t rtt_us)
+		{
+			if (!_srtt_us) {
+				_srtt_us   = rtt_us;
+				_rttvar_us = rtt_us / 2;
+			} else {
+				uint64_t const delta = _srtt_us > rtt_us ? _srtt_us - rtt_us
+				                                         : rtt_us - _srtt_us;
+				_rttvar_us = (3*_rttvar_us + delta) / 4;
+				_srtt_us   = (7*_srtt_us + rtt_us) / 8;
+			}
+
+			_rto_us = _clamp(_srtt_us + 4*_rttvar_us);
+		}
+
+		/**
+		 * Double the timeout after a retransmission timeout occurred
+		 */
+		void backoff() { _rto_us = _clamp(2*_rto_us); }
+
+		Microseconds rto() const { return Microseconds(_rto_us); }
+};
+
+
+/**
+ * Receiver that requested the current content
+ */
+struct Remote_rom::Subscriber
+{
+	enum State { FREE, PENDING, ACTIVE };
+
+	State        state     { FREE };
+	Ipv4_address ip        { };
+	unsigned     hash      { 0 };   /* requested version */
+	unsigned     flags     { 0 };   /* 'NotificationPacket::Flags' */
+	unsigned     base_hash { 0 };   /* version held by the receiver */
+	unsigned     misses    { 0 };   /* consecutive ACK timeouts */
+	Window_state acked     { };     /* packets acknowledged in current window */
+};
+
+
+class Remote_rom::Content_sender : public Genode::List<Content_sender>::Element
 {
+	public:
+
+		struct Policy
+		{
+			bool delta;       /* send deltas against the last version */
+			bool compress;    /* send compressed content */
+			bool multicast;   /* serve all receivers at once */
+			bool digest;      /* send a digest of each window */
+		};
+
 	private:
 		enum {
-			MAX_PAYLOAD_SIZE = DataPacket::MAX_PAYLOAD_SIZE,
-			MAX_WINDOW_SIZE  = 900,
-			TIMEOUT_ACK_US   = 1000000   /*  1000ms */
+			MAX_PAYLOAD_SIZE    = DataPacket::MAX_PAYLOAD_SIZE,
+			MAX_WINDOW_SIZE     = 900,
+			MIN_WINDOW_SIZE     = 4,
+			INITIAL_WINDOW_SIZE = 32,
+			WINDOW_INCREMENT    = 16,
+			MAX_RETRIES         = 3,
+			MAX_SUBSCRIBERS     = 64,
+			COLLECT_US          = 20000,   /* 20ms */
 		};
 
+		static_assert(MAX_WINDOW_SIZE <= Window_state::MAX_PACKETS,
+		              "window size exceeds ACK bitmap");
+
+		static_assert((size_t)Window_digest::SIZE == DataPacket::DIGEST_SIZE,
+		              "digest does not fit into data packet");
+
 		/* total data size */
 		size_t _data_size     { 0 };
 
+		/* total size of the transmitted (possibly compressed) stream */
+		size_t _stream_size   { 0 };
+
+		/* total number of packets to transmit */
+		size_t _stream_packets { 0 };
+
 		/* current window length */
-		size_t _window_length { MAX_WINDOW_SIZE };
+		size_t _window_length { 0 };
 
 		/* current window id */
 		size_t _window_id     { 0 };
 
-		/* data offset of current window */
-		size_t _offset        { 0 };
+		/* stream position (in packets) of current window */
+		size_t _window_start  { 0 };
 
 		/* current packed id */
 		size_t _packet_id     { 0 };
 
-		size_t _errors        { 0 };
+		bool   _transmitting  { false };
+
+		/* packets of the current window are scheduled for transmission */
+		bool   _burst_pending { false };
+
+		/* packets of the current window acknowledged by all subscribers */
+		Window_state _acked   { };
+
+		/*
+		 * Receivers of the content
+		 *
+		 * In multicast mode, each window is sent once to the group. We wait
+		 * for the acknowledgements of all subscribers and retransmit the
+		 * packets missed by any of them. Receivers requesting the content
+		 * during an ongoing transmission are served in the next round.
+		 */
+		bool const   _multicast;
+		Subscriber   _subscribers[MAX_SUBSCRIBERS] { };
+
+		/* congestion control */
+		size_t   _cwnd           { INITIAL_WINDOW_SIZE };
+		size_t   _ssthresh       { MAX_WINDOW_SIZE };
+		bool     _window_lossy   { false };
+		uint64_t _window_sent_us { 0 };
+		Rtt_estimator _rtt       { };
+
+		/*
+		 * Delta transfers
+		 *
+		 * We keep a copy of the last version acknowledged by the receiver.
+		 * If the receiver still holds this version, only the blocks that
+		 * changed are transmitted. A block corresponds to the payload of a
+		 * single packet.
+		 */
+		Genode::Ram_allocator  &_ram;
+		bool const              _delta_enabled;
+		bool                    _delta      { false };
+		Attached_ram_dataspace  _base;
+		size_t                  _base_size  { 0 };
+		unsigned                _base_hash  { 0 };
+		Attached_ram_dataspace  _blocks;    /* indices of changed blocks */
+
+		/*
+		 * Compressed transfers
+		 *
+		 * The content is compressed once per version. The compressed stream
+		 * is kept until the content changes. Versions are counted locally
+		 * because the content hash is a mere checksum, which may collide.
+		 */
+		bool const              _compress_enabled;
+		bool                    _compressed { false };
+		Attached_ram_dataspace  _stream;
+		Attached_ram_dataspace  _frame;     /* uncompressed frame */
+		size_t                  _compressed_size    { 0 };
+		unsigned long           _compressed_version { 0 };
+		unsigned long           _content_version    { 0 };
+
+		/*
+		 * Window digests
+		 *
+		 * Each packet carries the SHA-256 digest over the payloads of its
+		 * window, which allows the receiver to verify a window as soon as it
+		 * is complete. Note that the digest only protects the integrity of
+		 * the content but does not authenticate the sender.
+		 */
+		bool const              _digest_enabled;
+		bool                    _digest { false };
+		uint8_t                 _window_digest[DataPacket::DIGEST_SIZE] { };
 
 		/* timeouts and general object management*/
+		Timer::Connection                      &_timer;
 		Timer::One_shot_timeout<Content_sender> _timeout;
+		Timer::One_shot_timeout<Content_sender> _collect_timeout;
+		Timer::One_shot_timeout<Content_sender> _retransmit_timeout;
 		Backend_server            &_backend;
 		Rom_forwarder_base        *_frontend       { nullptr };
 
@@ -51,89 +223,386 @@ class Remote_rom::Content_sender
 		{
 			Genode::warning("no ACK received for window ", _window_id);
 
-			/* only handle  */
-			if (_errors == 0) {
-				/* go back to beginning of window */
-				go_back(0);
-				transmit(false);
+			/* give up on subscribers that stopped responding */
+			for (Subscriber &s : _subscribers) {
+				if (s.state != Subscriber::ACTIVE || s.acked.complete(_window_length))
+					continue;
+
+				if (++s.misses > MAX_RETRIES) {
+					Genode::warning("dropping subscriber ", s.ip);
+					s.state = Subscriber::FREE;
+				}
 			}
-			else {
-				reset();
-				_frontend->finish_transmission();
+
+			if (!_active_subscribers()) {
 				Genode::warning("transmission cancelled");
+				_finish(false);
+				return;
+			}
+
+			_update_acked();
+			if (_window_complete()) {
+				_continue();
+				return;
+			}
+
+			/* retransmission timeout: restart with minimal window */
+			_ssthresh = Genode::max(_cwnd / 2, (size_t)MIN_WINDOW_SIZE);
+			_cwnd     = MIN_WINDOW_SIZE;
+			_window_lossy = true;
+			_rtt.backoff();
+
+			_send_missing();
+		}
+
+		void collect_handler(Genode::Duration) { _start(); }
+
+		/**
+		 * Retransmit the packets missed by any subscriber at once
+		 */
+		void retransmit_handler(Genode::Duration)
+		{
+			/*
+			 * A running burst ends by arming the ACK timeout, which
+			 * covers packets missed before the burst position.
+			 */
+			if (!_transmitting || _burst_pending || _window_complete())
+				return;
+
+			_send_missing();
+		}
+
+		unsigned _active_subscribers() const
+		{
+			unsigned count = 0;
+			for (Subscriber const &s : _subscribers)
+				if (s.state == Subscriber::ACTIVE) count++;
+
+			return count;
+		}
+
+		bool _pending_subscribers() const
+		{
+			for (Subscriber const &s : _subscribers)
+				if (s.state == Subscriber::PENDING) return true;
+
+			return false;
+		}
+
+		Subscriber *_subscriber(Ipv4_address const &ip)
+		{
+			for (Subscriber &s : _subscribers)
+				if (s.state != Subscriber::FREE && s.ip == ip)
+					return &s;
+
+			return nullptr;
+		}
+
+		/**
+		 * Determine the packets acknowledged by all active subscribers
+		 */
+		void _update_acked()
+		{
+			bool first = true;
+			for (Subscriber const &s : _subscribers) {
+				if (s.state != Subscriber::ACTIVE)
+					continue;
+
+				if (first) _acked = s.acked;
+				else       _acked.intersect(s.acked);
+
+				first = false;
 			}
-			_errors++;
+
+			if (first)
+				_acked.clear();
 		}
 
+		/**
+		 * Start transmission to all pending subscribers
+		 */
+		void _start();
+
+		/**
+		 * Continue with the next window after the current one was completed
+		 */
+		void _continue();
+
+		/**
+		 * Finish transmission and serve subscribers that are still pending
+		 */
+		void _finish(bool success);
+
 		/* Noncopyable */
 		Content_sender(Content_sender const &);
 		Content_sender &operator=(Content_sender const &);
 
-		static size_t _calculate_window_size(size_t size)
+		uint64_t _now_us() const
+		{ return _timer.curr_time().trunc_to_plain_us().value; }
+
+		static size_t _num_blocks(size_t size)
 		{
 			size_t const mod = size % MAX_PAYLOAD_SIZE;
-			size_t const packets = size / MAX_PAYLOAD_SIZE + (mod ? 1 : 0);
-
-			return Genode::min((size_t)MAX_WINDOW_SIZE, packets);
+			return size / MAX_PAYLOAD_SIZE + (mod ? 1 : 0);
 		}
 
-		/**
-		 * Go to next packet. Returns false if window is complete.
-		 */
-		inline bool _next_packet()
-		{ return ++_packet_id < _window_length; }
+		size_t _calculate_window_size() const
+		{ return Genode::min(_cwnd, _stream_packets - _window_start); }
 
 		inline bool _window_complete() const
-		{ return _packet_id == _window_length; }
+		{ return _acked.complete(_window_length); }
 
 		inline bool _transmission_complete() const
-		{ return _offset >= _data_size; }
+		{ return _window_start >= _stream_packets; }
+
+		/**
+		 * Return content block transmitted by the current packet.
+		 */
+		inline size_t _block() const
+		{
+			size_t const pos = _window_start + _packet_id;
+			return _delta ? _blocks.local_addr<uint32_t>()[pos] : pos;
+		}
+
 		/**
 		 * Return absolute data offset of current packet.
 		 */
 		inline size_t _data_offset() const
-		{ return _offset + _packet_id * MAX_PAYLOAD_SIZE; }
+		{ return _block() * MAX_PAYLOAD_SIZE; }
+
+		/**
+		 * Determine the blocks that differ from the base version
+		 *
+		 * Returns the number of changed blocks.
+		 */
+		size_t _collect_changed_blocks()
+		{
+			size_t const blocks = _num_blocks(_data_size);
+
+			if (_blocks.size() < blocks * sizeof(uint32_t))
+				_blocks.realloc(&_ram, blocks * sizeof(uint32_t));
 
+			uint32_t   *changed = _blocks.local_addr<uint32_t>();
+			char const *base    = _base.local_addr<char const>();
+			size_t      count   = 0;
+
+			char buf[MAX_PAYLOAD_SIZE];
+			for (size_t i = 0; i < blocks; i++) {
+				size_t const off = i * MAX_PAYLOAD_SIZE;
+				size_t const len = Genode::min(_data_size - off,
+				                               (size_t)MAX_PAYLOAD_SIZE);
+
+				if (off + len > _base_size) {
+					changed[count++] = i;
+					continue;
+				}
+
+				_frontend->transfer_content(buf, len, off);
+				if (Genode::memcmp(buf, base + off, len))
+					changed[count++] = i;
+			}
+
+			/* always transmit at least one block, e.g., on truncation */
+			if (!count)
+				changed[count++] = 0;
+
+			return count;
+		}
+
+		/**
+		 * Compress current content unless already done for this version
+		 */
+		void _compress_content()
+		{
+			if (_compressed_size && _compressed_version == _content_version)
+				return;
+
+			size_t const max = Compression::max_stream_size(_data_size);
+			if (_stream.size() < max)
+				_stream.realloc(&_ram, max);
+			if (_frame.size() < Compression::FRAME_SIZE)
+				_frame.realloc(&_ram, Compression::FRAME_SIZE);
+
+			char * const frame  = _frame.local_addr<char>();
+			char * const stream = _stream.local_addr<char>();
+
+			size_t size = 0;
+			for (size_t off = 0; off < _data_size; off += Compression::FRAME_SIZE) {
+				size_t const len = Genode::min(_data_size - off,
+				                               (size_t)Compression::FRAME_SIZE);
+
+				_frontend->transfer_content(frame, len, off);
+				size += Compression::compress_frame(frame, len, stream + size);
+			}
+
+			_compressed_size    = size;
+			_compressed_version = _content_version;
+		}
+
+		/**
+		 * Remember transmitted content as base for subsequent deltas
+		 */
+		void _store_base()
+		{
+			if (!_delta_enabled) return;
+
+			if (_base.size() < _data_size)
+				_base.realloc(&_ram, _data_size);
+
+			_frontend->transfer_content(_base.local_addr<char>(), _data_size, 0);
+			_base_size = _data_size;
+			_base_hash = _frontend->content_hash();
+		}
+
+		/**
+		 * Adapt window size after a window was completely acknowledged
+		 */
+		void _window_succeeded()
+		{
+			if (_cwnd < _ssthresh)
+				_cwnd = Genode::min(2*_cwnd, _ssthresh);
+			else
+				_cwnd += WINDOW_INCREMENT;
+
+			_cwnd = Genode::min(_cwnd, (size_t)MAX_WINDOW_SIZE);
+		}
+
+		/**
+		 * Adapt window size after the receiver reported lost packets
+		 */
+		void _window_failed()
+		{
+			/* reduce only once per window */
+			if (_window_lossy) return;
+
+			_window_lossy = true;
+			_ssthresh = Genode::max(_cwnd / 2, (size_t)MIN_WINDOW_SIZE);
+			_cwnd     = _ssthresh;
+		}
 
 		/**
 		 * Go to next window. Returns false if end of data was reached.
-		 * TODO we may adapt the window size if retransmission occurred
 		 */
 		bool _next_window() {
-			/* advance offset by data transmitted in the last window */
-			_offset += _window_length * MAX_PAYLOAD_SIZE;
+			/* advance stream position by packets of the last window */
+			_window_start += _window_length;
 			if (_transmission_complete())
 				return false;
 
 			_window_id++;
-			_window_length = _calculate_window_size(_data_size-_offset);
-			_packet_id = 0;
-			
+			_start_window();
+
 			return true;
 		}
 
-	public:
-		Content_sender(Timer::Connection &timer, Backend_server &backend)
-		: _timeout(timer, *this, &Content_sender::timeout_handler),
-		  _backend(backend)
-		{ }
+		/**
+		 * Calculate digest over the payloads of the current window
+		 */
+		void _calculate_window_digest()
+		{
+			if (!_digest) {
+				Genode::memset(_window_digest, 0, sizeof(_window_digest));
+				return;
+			}
 
-		void register_forwarder(Rom_forwarder_base *forwarder)
+			Window_digest digest;
+
+			char buf[MAX_PAYLOAD_SIZE];
+			for (_packet_id = 0; _packet_id < _window_length; _packet_id++) {
+				size_t const len = payload_size();
+				transfer_content(buf, len);
+				digest.update(buf, len);
+			}
+
+			digest.finish(_window_digest);
+		}
+
+		void _start_window()
 		{
-			_frontend = forwarder;
+			if (_retransmit_timeout.scheduled())
+				_retransmit_timeout.discard();
+
+			_window_length = _calculate_window_size();
+			_window_lossy  = false;
+			_acked.clear();
+
+			for (Subscriber &s : _subscribers)
+				s.acked.clear();
+
+			_calculate_window_digest();
+			_packet_id = 0;
 		}
 
+		/**
+		 * Schedule (re-)transmission of all packets not acknowledged yet
+		 *
+		 * The packets are sent by 'send_burst' so that the backend is able
+		 * to interleave the windows of multiple modules.
+		 */
+		void _send_missing();
+
+	public:
+		Content_sender(Genode::Env        &env,
+		               Timer::Connection  &timer,
+		               Backend_server     &backend,
+		               Rom_forwarder_base &frontend,
+		               Policy const       &policy)
+		: _multicast(policy.multicast),
+		  _ram(env.ram()),
+		  _delta_enabled(policy.delta),
+		  _base(env.ram(), env.rm(), 0),
+		  _blocks(env.ram(), env.rm(), 0),
+		  _compress_enabled(policy.compress),
+		  _stream(env.ram(), env.rm(), 0),
+		  _frame(env.ram(), env.rm(), 0),
+		  _digest_enabled(policy.digest),
+		  _timer(timer),
+		  _timeout(timer, *this, &Content_sender::timeout_handler),
+		  _collect_timeout(timer, *this, &Content_sender::collect_handler),
+		  _retransmit_timeout(timer, *this, &Content_sender::retransmit_handler),
+		  _backend(backend),
+		  _frontend(&frontend)
+		{ }
+
 		void reset()
 		{
-			_offset        = 0;
-			_packet_id     = 0;
-			_window_id     = 0;
-			_data_size     = 0;
-			_window_length = 0;
-			_errors        = 0;
+			if (_timeout.scheduled())
+				_timeout.discard();
+			if (_retransmit_timeout.scheduled())
+				_retransmit_timeout.discard();
+
+			_window_start   = 0;
+			_packet_id      = 0;
+			_window_id      = 0;
+			_data_size      = 0;
+			_stream_size    = 0;
+			_stream_packets = 0;
+			_window_length  = 0;
+			_transmitting   = false;
+			_burst_pending  = false;
+			_delta          = false;
+			_compressed     = false;
+			_digest         = false;
 		}
 
-		bool transmitting() { return _packet_id > 0; }
+		bool transmitting() const { return _transmitting; }
+
+		/**
+		 * Invalidate data derived from the previous content
+		 */
+		void content_changed() { _content_version++; }
+
+		bool burst_pending() const { return _burst_pending; }
+
+		/**
+		 * Send up to 'quantum' of the scheduled packets
+		 *
+		 * \return true if packets are left for transmission
+		 */
+		bool send_burst(size_t quantum);
+
+		bool belongs_to(Rom_forwarder_base const &forwarder) const
+		{ return _frontend == &forwarder; }
 
 		/**********************
 		 * frontend accessors *
@@ -152,16 +621,38 @@ class Remote_rom::Content_sender
 		{
 			if (!_frontend) return 0;
 
-			return _frontend->transfer_content(dst, max_size, _data_offset());
+			if (!_compressed)
+				return _frontend->transfer_content(dst, max_size, _data_offset());
+
+			size_t const offset = _data_offset();
+			size_t const len    = Genode::min(max_size, _stream_size - offset);
+			Genode::memcpy(dst, _stream.local_addr<char>() + offset, len);
+
+			/* clear remaining buffer to prevent data leakage */
+			if (max_size > len)
+				Genode::memset(dst + len, 0, max_size - len);
+
+			return max_size;
 		}
 
 		/************************
 		 * transmission control *
 		 ************************/
 
-		bool transmit(bool restart);
+		/**
+		 * Handle request of the current content
+		 *
+		 * \param src      address of the receiver
+		 * \param hash     requested version
+		 * \param request  capabilities of the receiver
+		 */
+		void request(Ipv4_address const &src, unsigned hash,
+		             NotificationPacket const &request);
 
-		void go_back(size_t packet_id) { _packet_id = packet_id; }
+		/**
+		 * Process the (selective) acknowledgement of the current window
+		 */
+		void acknowledge(Ipv4_address const &src, AckPacket const &ack);
 
 		/*************************************
 		 * accessors for packet construction *
@@ -171,12 +662,30 @@ class Remote_rom::Content_sender
 		 * Return payload size of current packet.
 		 */
 		size_t payload_size() const
-		{ return Genode::min(_data_size-_data_offset(),
+		{ return Genode::min(_stream_size-_data_offset(),
 		                     (size_t)MAX_PAYLOAD_SIZE); }
 
 		size_t window_id()     const { return _window_id; }
 		size_t window_length() const { return _window_length; }
 		size_t packet_id()     const { return _packet_id; }
+		size_t data_offset()   const { return _data_offset(); }
+
+		uint8_t const *window_digest() const { return _window_digest; }
+
+		unsigned packet_flags() const
+		{
+			unsigned flags = 0;
+			if (_window_start + _window_length >= _stream_packets)
+				flags |= DataPacket::LAST_WINDOW;
+			if (_delta)
+				flags |= DataPacket::DELTA;
+			if (_compressed)
+				flags |= DataPacket::COMPRESSED;
+			if (_digest)
+				flags |= DataPacket::DIGEST;
+
+			return flags;
+		}
 };
 
 class Remote_rom::Backend_server :
@@ -187,14 +696,57 @@ class Remote_rom::Backend_server :
 
 		friend class Content_sender;
 
-		Content_sender              _content_sender { _timer, *this };
+		enum {
+			/* packets sent per module before serving the next one */
+			BURST_QUANTUM = 16
+		};
+
+		Genode::Env                  &_env;
+		Genode::Allocator            &_alloc;
+		Content_sender::Policy const  _policy;
+		Genode::List<Content_sender>  _senders { };
+
+		Genode::Signal_handler<Backend_server> _burst_handler {
+			_env.ep(), *this, &Backend_server::_handle_burst };
 
 		Backend_server(Backend_server &);
 		Backend_server &operator= (Backend_server &);
 
 		void send_packet(Content_sender const &sender);
 
-		void receive(Packet &packet, Size_guard &) override;
+		void receive(Packet &packet, Size_guard &,
+		             Ipv4_address const &src) override;
+
+		Content_sender *_lookup(char const *module_name)
+		{
+			for (Content_sender *s = _senders.first(); s; s = s->next())
+				if (!Genode::strcmp(module_name, s->module_name()))
+					return s;
+
+			return nullptr;
+		}
+
+		/**
+		 * Transmit scheduled packets of all modules in a round-robin fashion
+		 *
+		 * After each round, we return to the entrypoint to process incoming
+		 * acknowledgements before continuing.
+		 */
+		void _handle_burst()
+		{
+			bool pending = false;
+			for (Content_sender *s = _senders.first(); s; s = s->next())
+				if (s->burst_pending())
+					pending |= s->send_burst(BURST_QUANTUM);
+
+			if (pending)
+				Genode::Signal_transmitter(_burst_handler).submit();
+		}
+
+		void schedule_burst()
+		{
+			Genode::Signal_transmitter(_burst_handler).submit();
+		}
 
 	public:
 
@@ -202,23 +754,40 @@ class Remote_rom::Backend_server :
 		               Genode::Allocator &alloc,
 		               Genode::Xml_node config,
 		               Genode::Xml_node policy)
-		: Backend_base(env, alloc, config, policy)
+		: Backend_base(env, alloc, config, policy),
+		  _env(env), _alloc(alloc),
+		  _policy { policy.attribute_value("delta",    false),
+		            policy.attribute_value("compress", false),
+		            multicast(),
+		            policy.attribute_value("digest",   false) }
 		{ }
 
 
 		void register_forwarder(Rom_forwarder_base *forwarder) override
-		{ _content_sender.register_forwarder(forwarder); }
+		{
+			_senders.insert(new (_alloc)
+				Content_sender(_env, _timer, *this, *forwarder, _policy));
+		}
 
 
-		void send_update() override
+		void send_update(Rom_forwarder_base &forwarder) override
 		{
-			if (!_content_sender.content_size()) return;
+			Content_sender *sender = nullptr;
+			for (sender = _senders.first(); sender; sender = sender->next())
+				if (sender->belongs_to(forwarder))
+					break;
+
+			if (!sender) return;
+
+			sender->content_changed();
+
+			if (!sender->content_size()) return;
 
 			if (_verbose)
-				Genode::log("sending SIGNAL(", _content_sender.module_name(), ")");
+				Genode::log("sending SIGNAL(", sender->module_name(), ")");
 
 			/* TODO re-send SIGNAL packet after a timeout */
-			transmit_notification(Packet::SIGNAL, _content_sender);
+			transmit_notification(Packet::SIGNAL, *sender);
 		}
 };
 
@@ -270,6 +839,9 @@ void Remote_rom::Backend_server::send_packet(Content_sender const &sender)
 	data.window_id(sender.window_id());
 	data.window_length(sender.window_length());
 	data.packet_id(sender.packet_id());
+	data.flags(sender.packet_flags());
+	data.offset(sender.data_offset());
+	data.digest(sender.window_digest());
 
 	size_guard.consume_head(max_payload);
 	data.payload_size(sender.transfer_content((char*)data.addr(),
@@ -286,35 +858,41 @@ void Remote_rom::Backend_server::send_packet(Content_sender const &sender)
 	submit_tx_packet(pd);
 }
 
-void Remote_rom::Backend_server::receive(Packet &packet,
-                                         Size_guard &size_guard)
+void Remote_rom::Backend_server::receive(Packet             &packet,
+                                         Size_guard         &size_guard,
+                                         Ipv4_address const &src)
 {
 	switch (packet.type())
 	{
 		case Packet::UPDATE:
+		{
 			if (_verbose)
 				Genode::log("receiving UPDATE (",
 				            Cstring(packet.module_name()),
 				            ") packet");
 
-			/* check module name */
-			if (Genode::strcmp(packet.module_name(), _content_sender.module_name()))
+			Content_sender *sender = _lookup(packet.module_name());
+			if (!sender)
 				return;
 
 			/* compare content hash */
-			if (packet.content_hash() != _content_sender.content_hash()) {
+			if (packet.content_hash() != sender->content_hash()) {
 				if (_verbose)
 					Genode::log("ignoring UPDATE with invalid hash");
 				return;
 			}
 
 			if (_verbose) {
-				Genode::log("Sending data of size ", _content_sender.content_size());
+				Genode::log("Sending data of size ", sender->content_size());
 			}
 
-			_content_sender.transmit(true);
+			NotificationPacket const &request =
+				packet.data<NotificationPacket>(size_guard);
+
+			sender->request(src, packet.content_hash(), request);
 
 			break;
+		}
 		case Packet::SIGNAL:
 			if (_verbose)
 				Genode::log("ignoring SIGNAL");
@@ -325,13 +903,11 @@ void Remote_rom::Backend_server::receive(Packet &packet,
 			break;
 		case Packet::ACK:
 		{
-			if (!_content_sender.transmitting())
+			Content_sender *sender = _lookup(packet.module_name());
+			if (!sender || !sender->transmitting())
 				return;
 
-			if (Genode::strcmp(packet.module_name(), _content_sender.module_name()))
-				return;
-
-			if (packet.content_hash() != _content_sender.content_hash()) {
+			if (packet.content_hash() != sender->content_hash()) {
 				if (_verbose)
 					Genode::warning("ignoring ACK with wrong hash");
 				return;
@@ -339,20 +915,13 @@ void Remote_rom::Backend_server::receive(Packet &packet,
 
 			AckPacket const &ack = packet.data<AckPacket>(size_guard);
 
-			if (ack.window_id() != _content_sender.window_id()) {
+			if (ack.window_id() != sender->window_id()) {
 				if (_verbose)
 					Genode::warning("ignoring ACK with wrong window id");
 				return;
 			}
 
-			if (ack.ack_until() < _content_sender.packet_id()) {
-				if (_verbose)
-					Genode::warning("Go back to packet id ", ack.ack_until());
-
-				_content_sender.go_back(ack.ack_until());
-			}
-
-			_content_sender.transmit(false);
+			sender->acknowledge(src, ack);
 
 			break;
 		}
@@ -361,45 +930,222 @@ void Remote_rom::Backend_server::receive(Packet &packet,
 	}
 }
 
-bool Remote_rom::Content_sender::transmit(bool restart)
+void Remote_rom::Content_sender::request(Ipv4_address       const &src,
+                                         unsigned                  hash,
+                                         NotificationPacket const &request)
 {
-	if (!_frontend) return false;
+	Subscriber *subscriber = _subscriber(src);
 
-	if (_timeout.scheduled())
-		_timeout.discard();
+	/* ignore repeated requests during transmission */
+	if (subscriber && subscriber->state == Subscriber::ACTIVE)
+		return;
 
-	_errors = 0;
+	if (!subscriber) {
+		for (Subscriber &s : _subscribers)
+			if (s.state == Subscriber::FREE) { subscriber = &s; break; }
+	}
 
-	if (restart) {
-		/* do not start if we are still transmitting */
-		if (!_transmission_complete())
-			return false;
+	if (!subscriber) {
+		Genode::warning("too many subscribers, ignoring request from ", src);
+		return;
+	}
+
+	subscriber->state     = Subscriber::PENDING;
+	subscriber->ip        = src;
+	subscriber->hash      = hash;
+	subscriber->flags     = request.flags();
+	subscriber->base_hash = request.base_hash();
+	subscriber->misses    = 0;
+
+	/* pending subscribers are served after the current transmission */
+	if (_transmitting)
+		return;
+
+	/* collect the requests of all group members before starting */
+	if (_multicast) {
+		if (!_collect_timeout.scheduled())
+			_collect_timeout.schedule(Microseconds(COLLECT_US));
+		return;
+	}
+
+	_start();
+}
+
+void Remote_rom::Content_sender::_start()
+{
+	if (!_frontend || _transmitting) return;
+
+	unsigned const hash = _frontend->content_hash();
+
+	/* deltas, compression, and digests must be supported by all subscribers */
+	bool     delta    = _delta_enabled && _base_size;
+	bool     compress = _compress_enabled;
+	bool     digest   = _digest_enabled;
+	unsigned active   = 0;
 
-		_frontend->start_transmission();
-		reset();
+	for (Subscriber &s : _subscribers) {
+		if (s.state != Subscriber::PENDING)
+			continue;
 
-		_data_size     = _frontend->content_size();
-		_window_length = _calculate_window_size(_data_size);
+		/* the content changed since the request */
+		if (s.hash != hash) {
+			s.state = Subscriber::FREE;
+			continue;
+		}
+
+		s.state = Subscriber::ACTIVE;
+		active++;
+
+		delta    &= (s.flags & NotificationPacket::DELTA)
+		         && s.base_hash == _base_hash;
+		compress &= (s.flags & NotificationPacket::COMPRESSED) != 0;
+		digest   &= (s.flags & NotificationPacket::DIGEST)     != 0;
 	}
-	else if (_window_complete()) {
-		if (!_next_window()) {
-			_frontend->finish_transmission();
 
-			if (transmitting()) {
-				reset();
-				return true;
-			}
-			else
-				return false;
+	if (!active) return;
+
+	_frontend->start_transmission();
+	reset();
+
+	_transmitting   = true;
+	_data_size      = _frontend->content_size();
+	_stream_size    = _data_size;
+	_stream_packets = _num_blocks(_data_size);
+
+	/* the receivers hold our base version, only send changed blocks */
+	if (delta) {
+		size_t const changed = _collect_changed_blocks();
+		if (changed < _stream_packets) {
+			_delta          = true;
+			_stream_packets = changed;
 		}
 	}
 
-	do {
+	/* otherwise, send compressed content if it pays off */
+	if (!_delta && compress) {
+		_compress_content();
+		if (_compressed_size < _data_size) {
+			_compressed     = true;
+			_stream_size    = _compressed_size;
+			_stream_packets = _num_blocks(_stream_size);
+		}
+	}
+
+	_digest = digest;
+
+	_start_window();
+	_send_missing();
+}
+
+void Remote_rom::Content_sender::_continue()
+{
+	if (!_next_window()) {
+		_finish(true);
+		return;
+	}
+
+	_send_missing();
+}
+
+void Remote_rom::Content_sender::_finish(bool success)
+{
+	if (success)
+		_store_base();
+
+	reset();
+
+	for (Subscriber &s : _subscribers)
+		if (s.state == Subscriber::ACTIVE)
+			s.state = Subscriber::FREE;
+
+	_frontend->finish_transmission();
+
+	/* serve receivers that requested the content in the meantime */
+	if (_pending_subscribers())
+		_start();
+}
+
+void Remote_rom::Content_sender::acknowledge(Ipv4_address const &src,
+                                             AckPacket    const &ack)
+{
+	Subscriber *subscriber = _subscriber(src);
+	if (!subscriber || subscriber->state != Subscriber::ACTIVE)
+		return;
+
+	subscriber->misses = 0;
+
+	/* the receiver discarded the window because its digest did not match */
+	if (ack.flags() & AckPacket::CORRUPT)
+		subscriber->acked = ack.window_state();
+	else
+		subscriber->acked.merge(ack.window_state());
+
+	_update_acked();
+
+	if (_window_complete()) {
+		/* Karn's algorithm: only sample windows without retransmissions */
+		if (!_window_lossy) {
+			_rtt.sample(_now_us() - _window_sent_us);
+			_window_succeeded();
+		}
+
+		if (_timeout.scheduled())
+			_timeout.discard();
+
+		_continue();
+		return;
+	}
+
+	/* wait for the other subscribers */
+	if (subscriber->acked.complete(_window_length))
+		return;
+
+	/* retransmit lost packets only */
+	_window_failed();
+
+	/*
+	 * In multicast mode, the ACKs of the other subscribers are collected
+	 * first so that a lossy window causes a single retransmission of the
+	 * packets missed by any of them.
+	 */
+	if (_multicast) {
+		if (!_retransmit_timeout.scheduled())
+			_retransmit_timeout.schedule(Microseconds(COLLECT_US));
+		return;
+	}
+
+	_send_missing();
+}
+
+void Remote_rom::Content_sender::_send_missing()
+{
+	if (_timeout.scheduled())
+		_timeout.discard();
+	if (_retransmit_timeout.scheduled())
+		_retransmit_timeout.discard();
+
+	_packet_id     = 0;
+	_burst_pending = true;
+	_backend.schedule_burst();
+}
+
+bool Remote_rom::Content_sender::send_burst(size_t quantum)
+{
+	for (size_t sent = 0; _packet_id < _window_length; _packet_id++) {
+		if (_acked.received(_packet_id))
+			continue;
+
+		if (sent++ == quantum)
+			return true;
+
 		_backend.send_packet(*this);
-	} while (_next_packet());
+	}
+
+	_burst_pending  = false;
+	_window_sent_us = _now_us();
 
 	/* set ACK timeout */
-	_timeout.schedule(Microseconds(TIMEOUT_ACK_US));
+	_timeout.schedule(_rtt.rto());
 
 	return false;
 }
@@ -24,13 +24,14 @@
 #include <util/list.h>
 
 #include <base/rpc_server.h>
+#include <base/session_label.h>
 #include <root/component.h>
 
 #include <base/attached_ram_dataspace.h>
 #include <base/attached_rom_dataspace.h>
 #include <rom_session/rom_session.h>
 
-#include <base/component.h>
+#include <libc/component.h>
 
 #include <backend_base.h>
 #include <util.h>
@@ -45,9 +46,12 @@ namespace Remote_rom {
 	class  Root;
 	struct Main;
 	struct Rom_module;
+	struct Module;
 
 	typedef Genode::List_element<Session_component> Session_element;
 	typedef Genode::List<Session_element>           Session_list;
+	typedef Genode::List<Module>                    Module_list;
+	typedef Genode::String<64>                      Module_name;
 };
 
 
@@ -64,6 +68,8 @@ class Remote_rom::Rom_module
 
 		unsigned _bg_hash { 0 };
 		size_t   _bg_size { 0 };
+		unsigned _fg_hash { 0 };
+		size_t   _fg_size { 0 };
 
 	public:
 		Rom_module(Genode::Ram_allocator &ram, Genode::Env &env)
@@ -99,24 +105,44 @@ class Remote_rom::Rom_module
 			return _bg.local_addr<char>();
 		}
 
+		/**
+		 * Copy foreground content into the background dataspace
+		 *
+		 * Used for applying a delta to the current content.
+		 */
+		void copy_fg_to_bg()
+		{
+			if (!_fg_size) return;
+
+			Genode::memcpy(_bg.local_addr<char>(), _fg.local_addr<char>(),
+			               Genode::min(_fg_size, _bg_size));
+		}
+
 		/**
 		 * Commit data contained in background dataspace
 		 * (swap foreground and background dataspace)
+		 *
+		 * \param verified  skip the checksum of content already verified
 		 */
-		bool commit_bg()
+		bool commit_bg(bool verified)
 		{
-			if (_bg_hash != cksum(_bg.local_addr<char>(), _bg_size)) {
+			if (!verified
+			 && _bg_hash != cksum(_bg.local_addr<char>(), _bg_size)) {
 				Genode::error("checksum error");
 				return false;
 			}
 
 			_fg.swap(_bg);
+			_fg_hash = _bg_hash;
+			_fg_size = _bg_size;
 			return true;
 		}
 
 		unsigned hash() const { return _bg_hash; }
 		void hash(unsigned v) { _bg_hash = v; }
 
+		unsigned fg_hash() const { return _fg_hash; }
+
 };
 
 class Remote_rom::Session_component :
@@ -167,57 +193,126 @@ class Remote_rom::Session_component :
 		}
 };
 
+/**
+ * ROM module received from the remote server and its local sessions
+ */
+struct Remote_rom::Module : Rom_receiver_base, Genode::List<Module>::Element
+{
+	Module_name const name;
+	Rom_module        rom_module;
+	Session_list      sessions { };
+
+	Module(Genode::Env &env, Module_name const &name)
+	: name(name), rom_module(env.ram(), env)
+	{ }
+
+	void notify_clients()
+	{
+		for (Session_element *s = sessions.first(); s; s = s->next())
+			s->object()->notify_client();
+	}
+
+	const char* module_name()  const override { return name.string(); }
+	unsigned    content_hash() const override { return rom_module.hash(); }
+	unsigned    base_hash()    const override { return rom_module.fg_hash(); }
+
+	char* start_new_content(unsigned hash, size_t len) override
+	{
+		/* save expected hash */
+		/* TODO (optional) skip if we already have the same data */
+		rom_module.hash(hash);
+
+		return rom_module.base(len);
+	}
+
+	void start_delta() override { rom_module.copy_fg_to_bg(); }
+
+	void commit_new_content(bool abort=false, bool verified=false) override
+	{
+		if (abort)
+			return;
+
+		if (rom_module.commit_bg(verified))
+			notify_clients();
+	}
+};
+
 class Remote_rom::Root : public Genode::Root_component<Session_component>
 {
 	private:
 
 		Genode::Env    &_env;
-		Rom_module     &_rom_module;
-		Session_list    _sessions;
+		Module_list    &_modules;
+
+		Module *_lookup(Module_name const &name)
+		{
+			for (Module *m = _modules.first(); m; m = m->next())
+				if (m->name == name)
+					return m;
+
+			/* a single module is handed out regardless of the label */
+			Module *m = _modules.first();
+			if (m && !m->next())
+				return m;
+
+			return nullptr;
+		}
 
 	protected:
 
-		Session_component *_create_session(const char *) override
+		Session_component *_create_session(const char *args) override
 		{
 			using namespace Genode;
 
-			/*
-			 * TODO compare requested module name with provided module name (config)
-			 * */
+			Session_label const label = label_from_args(args);
+			Module_name   const name  = label.last_element();
+
+			Module *module = _lookup(name);
+			if (!module) {
+				error("no remote ROM module for session '", label, "'");
+				throw Service_denied();
+			}
 
 			return new (Root::md_alloc())
-			            Session_component(_env, _sessions, _rom_module);
+			            Session_component(_env, module->sessions,
+			                              module->rom_module);
 		}
 
 	public:
 
-		Root(Genode::Env &env, Genode::Allocator &md_alloc, Rom_module &rom_module)
+		Root(Genode::Env &env, Genode::Allocator &md_alloc, Module_list &modules)
 		:
 		  Genode::Root_component<Session_component>(&env.ep().rpc_ep(), &md_alloc),
 		  _env(env),
-		  _rom_module(rom_module),
-		  _sessions()
+		  _modules(modules)
 		{ }
-
-		void notify_clients()
-		{
-			for (Session_element *s = _sessions.first(); s; s = s->next())
-				s->object()->notify_client();
-		}
 };
 
-struct Remote_rom::Main : public Rom_receiver_base
+struct Remote_rom::Main
 {
 	Genode::Env &env;
 	Genode::Heap heap            { &env.ram(), &env.rm() };
-	Rom_module   rom_module      { env.ram(), env };
-	Root         remote_rom_root { env, heap, rom_module };
+	Module_list  modules         { };
+	Root         remote_rom_root { env, heap, modules };
 
 	Genode::Attached_rom_dataspace _config = { env, "config" };
 
 	Backend_client_base &_backend;
 
-	char remotename[255];
+	void _add_module(Genode::Xml_node node)
+	{
+		Module_name const name = node.attribute_value("name", Module_name());
+		if (!name.valid()) {
+			Genode::error("missing module name in ", node);
+			return;
+		}
+
+		Module *module = new (heap) Module(env, name);
+		modules.insert(module);
+
+		/* initialise backend */
+		_backend.register_receiver(module);
+	}
 
 	Main(Genode::Env &env) :
 	  env(env),
@@ -225,44 +320,25 @@ struct Remote_rom::Main : public Rom_receiver_base
 	{
 		try {
 			Genode::Xml_node remote_rom = _config.xml().sub_node("remote_rom");
-			remote_rom.attribute("name").value(remotename, sizeof(remotename));
-		} catch (...) {
-			Genode::error("No ROM module configured!");
-		}
-
-		env.parent().announce(env.ep().manage(remote_rom_root));
-
-		/* initialise backend */
-		_backend.register_receiver(this);
-	}
 
-	const char* module_name()  const override { return remotename; }
-	unsigned    content_hash() const override { return rom_module.hash(); }
+			/* single module specified at the <remote_rom> node */
+			if (remote_rom.has_attribute("name"))
+				_add_module(remote_rom);
 
-	char* start_new_content(unsigned hash, size_t len) override
-	{
-		/* save expected hash */
-		/* TODO (optional) skip if we already have the same data */
-		rom_module.hash(hash);
+			/* multiple modules received via the same backend */
+			remote_rom.for_each_sub_node("rom", [&] (Genode::Xml_node node) {
+				_add_module(node); });
 
-		return rom_module.base(len);
-	}
+		} catch (...) { }
 
-	void commit_new_content(bool abort=false) override
-	{
-		if (abort)
-			return;
+		if (!modules.first())
+			Genode::error("No ROM module configured!");
 
-		if (rom_module.commit_bg())
-			remote_rom_root.notify_clients();
+		env.parent().announce(env.ep().manage(remote_rom_root));
 	}
-
 };
 
-namespace Component {
-	Genode::size_t stack_size() { return 2*1024*sizeof(long); }
-	void construct(Genode::Env &env)
-	{
-		static Remote_rom::Main main(env);
-	}
+void Libc::Component::construct(Libc::Env &env)
+{
+	static Remote_rom::Main main(env);
 }
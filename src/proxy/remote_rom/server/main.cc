@@ -21,7 +21,7 @@
 #include <base/env.h>
 #include <base/heap.h>
 
-#include <base/component.h>
+#include <libc/component.h>
 #include <base/attached_rom_dataspace.h>
 
 #include <backend_base.h>
@@ -34,28 +34,34 @@ namespace Remote_rom {
 	class Rom_forwarder;
 	struct Main;
 
-	static char modulename[255];
-	static bool binary = false;
-
+	typedef Genode::String<64> Module_name;
 };
 
-struct Remote_rom::Rom_forwarder : Rom_forwarder_base
+struct Remote_rom::Rom_forwarder : Rom_forwarder_base,
+                                   Genode::List<Rom_forwarder>::Element
 {
-		Attached_rom_dataspace &_rom;
+		Module_name      const  _name;
+		bool             const  _binary;
+		Attached_rom_dataspace  _rom;
 		Backend_server_base    &_backend;
 
 		unsigned                _current_hash    { 0 };
 		bool                    _transmitting    { false };
 		bool                    _update_received { false };
 
-		Attached_rom_dataspace &_config;
+		Genode::Signal_handler<Rom_forwarder> _dispatcher;
 
-		Rom_forwarder(Attached_rom_dataspace &rom, Backend_server_base &backend,
-		              Attached_rom_dataspace &config)
-			: _rom(rom), _backend(backend), _config(config)
+		Rom_forwarder(Genode::Env &env, Module_name const &name, bool binary,
+		              Backend_server_base &backend)
+			: _name(name), _binary(binary), _rom(env, name.string()),
+			  _backend(backend),
+			  _dispatcher(env.ep(), *this, &Rom_forwarder::update)
 		{
 			_backend.register_forwarder(this);
 
+			/* register update dispatcher */
+			_rom.sigh(_dispatcher);
+
 			/* on startup, send an update message to remote client */
 			update();
 		}
@@ -71,7 +77,7 @@ struct Remote_rom::Rom_forwarder : Rom_forwarder_base
 				update();
 		}
 
-		const char *module_name() const override { return modulename; }
+		const char *module_name() const override { return _name.string(); }
 
 		void update()
 		{
@@ -89,7 +95,7 @@ struct Remote_rom::Rom_forwarder : Rom_forwarder_base
 				_current_hash = cksum(_rom.local_addr<char>(), content_size());
 
 				/* trigger backend_server */
-				_backend.send_update();
+				_backend.send_update(*this);
 			}
 		}
 
@@ -101,7 +107,7 @@ struct Remote_rom::Rom_forwarder : Rom_forwarder_base
 		size_t content_size() const override
 		{
 			if (_rom.valid()) {
-				if (binary)
+				if (_binary)
 					return _rom.size();
 				else
 					return Genode::min(Genode::strlen(_rom.local_addr<char>()),
@@ -131,42 +137,45 @@ struct Remote_rom::Main
 	Genode::Heap    _heap   = { &_env.ram(), &_env.rm() };
 	Attached_rom_dataspace _config = { _env, "config" };
 
-	Attached_rom_dataspace _rom;
-	Rom_forwarder          _forwarder;
+	Backend_server_base          &_backend;
+	Genode::List<Rom_forwarder>   _forwarders { };
+
+	void _add_forwarder(Genode::Xml_node node)
+	{
+		Module_name const name = node.attribute_value("name", Module_name());
+		if (!name.valid()) {
+			Genode::error("missing module name in ", node);
+			return;
+		}
 
-	Genode::Signal_handler<Rom_forwarder> _dispatcher = {_env.ep(), _forwarder,
-	                                                     &Rom_forwarder::update};
+		_forwarders.insert(new (_heap)
+			Rom_forwarder(_env, name, node.attribute_value("binary", false),
+			              _backend));
+	}
 
 	Main(Genode::Env &env)
 		: _env(env),
-	     _rom(env, modulename),
-	     _forwarder(_rom, backend_init_server(env, _heap, _config.xml()),
-	                _config)
+		  _backend(backend_init_server(env, _heap, _config.xml()))
 	{
-		/* register update dispatcher */
-		_rom.sigh(_dispatcher);
-	}
-};
+		try {
+			Genode::Xml_node remote_rom = _config.xml().sub_node("remote_rom");
 
-namespace Component {
-	Genode::size_t stack_size()    { return 2*1024*sizeof(long); }
+			/* single module specified at the <remote_rom> node */
+			if (remote_rom.has_attribute("name"))
+				_add_forwarder(remote_rom);
 
+			/* multiple modules served by the same backend */
+			remote_rom.for_each_sub_node("rom", [&] (Genode::Xml_node node) {
+				_add_forwarder(node); });
 
-	void construct(Genode::Env &env)
-	{
-		using Remote_rom::modulename;
+		} catch (...) { }
 
-		Genode::Attached_rom_dataspace config = { env, "config" };
-		try {
-			Genode::Xml_node remote_rom = config.xml().sub_node("remote_rom");
-			remote_rom.attribute("name").value(modulename, sizeof(modulename));
-			try {
-				remote_rom.attribute("binary").value(&Remote_rom::binary);
-			} catch (...) { }
-		} catch (...) {
+		if (!_forwarders.first())
 			Genode::error("No ROM module configured!");
-		}
-
-		static Remote_rom::Main main(env);
 	}
+};
+
+void Libc::Component::construct(Libc::Env &env)
+{
+	static Remote_rom::Main main(env);
 }
@@ -0,0 +1,62 @@
+/*
+ * \brief  Hashing backend based on Crypto++
+ * \author agent
+ * \date   2026-10-19
+ */
+
+/*
+ * Copyright (C) 2026 agent
+ *
+ * This file is part of the Genode OS framework, which is distributed
+ * under the terms of the GNU General Public License version 2.
+ */
+
+/* Crypto++ includes */
+#include <blake2.h>
+#include <sha3.h>
+#include <sha.h>
+
+/* local includes */
+#include <hasher.h>
+
+namespace Rom_hash { template <typename> struct Cryptopp_hasher; }
+
+
+template <typename HASH>
+struct Rom_hash::Cryptopp_hasher : Stream_hasher
+{
+	HASH _hash;
+
+	template <typename... ARGS>
+	Cryptopp_hasher(Env &env, ARGS &&... args)
+	: Stream_hasher(env), _hash(args...) { }
+
+	size_t digest_size() const override { return _hash.DigestSize(); }
+
+	void update(uint8_t const *data, size_t len) override {
+		_hash.Update(data, len); }
+
+	void finish(uint8_t *digest) override { _hash.Final(digest); }
+};
+
+
+Rom_hash::Hasher *Rom_hash::create_cryptopp_hasher(Allocator       &alloc,
+                                                   Env             &env,
+                                                   Algorithm const &algorithm,
+                                                   size_t           digest_size)
+{
+	using namespace CryptoPP;
+
+	if (algorithm == "sha1")
+		return new (alloc) Cryptopp_hasher<SHA1>(env);
+	if (algorithm == "sha256")
+		return new (alloc) Cryptopp_hasher<SHA256>(env);
+	if (algorithm == "sha512")
+		return new (alloc) Cryptopp_hasher<SHA512>(env);
+	if (algorithm == "sha3")
+		return new (alloc) Cryptopp_hasher<SHA3>(env, (unsigned)digest_size);
+	if (algorithm == "blake2b")
+		return new (alloc) Cryptopp_hasher<BLAKE2b>(env, false, (unsigned)digest_size);
+
+	return nullptr;
+}
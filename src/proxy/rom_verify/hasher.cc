@@ -0,0 +1,46 @@
+/*
+ * \brief  Selection of the hashing backend
+ * \author agent
+ * \date   2026-10-19
+ */
+
+/*
+ * Copyright (C) 2026 agent
+ *
+ * This file is part of the Genode OS framework, which is distributed
+ * under the terms of the GNU General Public License version 2.
+ */
+
+/* Genode includes */
+#include <base/log.h>
+
+/* local includes */
+#include <hasher.h>
+
+
+Rom_hash::Hasher *Rom_hash::create_hasher(Allocator       &alloc,
+                                          Env             &env,
+                                          Backend   const &backend,
+                                          Algorithm const &algorithm,
+                                          size_t           digest_size,
+                                          unsigned         threads)
+{
+	if (digest_size > Hasher::MAX_DIGEST_SIZE)
+		return nullptr;
+
+	/* tree hashing is independent of the configured backend */
+	if (algorithm == "blake2b_tree")
+		return create_tree_hasher(alloc, env, digest_size, threads);
+
+	if (backend == "cryptopp")
+		return create_cryptopp_hasher(alloc, env, algorithm, digest_size);
+
+	if (backend == "nettle")
+		return create_nettle_hasher(alloc, env, algorithm, digest_size);
+
+	if (backend == "sodium")
+		return create_sodium_hasher(alloc, env, algorithm, digest_size);
+
+	error("unknown hashing backend '", backend, "'");
+	return nullptr;
+}
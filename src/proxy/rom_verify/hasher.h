@@ -0,0 +1,96 @@
+/*
+ * \brief  Hashing backends of the ROM verification server
+ * \author agent
+ * \date   2026-10-19
+ */
+
+/*
+ * Copyright (C) 2026 agent
+ *
+ * This file is part of the Genode OS framework, which is distributed
+ * under the terms of the GNU General Public License version 2.
+ */
+
+#ifndef _ROM_VERIFY__HASHER_H_
+#define _ROM_VERIFY__HASHER_H_
+
+/* Genode includes */
+#include <base/env.h>
+#include <base/allocator.h>
+#include <dataspace/capability.h>
+#include <util/string.h>
+
+namespace Rom_hash {
+	using namespace Genode;
+
+	struct Hasher;
+	struct Stream_hasher;
+
+	typedef String<16> Backend;
+	typedef String<16> Algorithm;
+
+	/**
+	 * Create hasher for 'algorithm' implemented by 'backend'
+	 *
+	 * \param digest_size  digest size for algorithms with variable digest
+	 *                     size, i.e., sha3 and blake2b
+	 * \param threads      number of threads used for tree hashing
+	 *
+	 * \return  hasher or nullptr if the backend lacks the algorithm
+	 */
+	Hasher *create_hasher(Allocator &, Env &, Backend const &,
+	                      Algorithm const &, size_t digest_size,
+	                      unsigned threads);
+
+	Hasher *create_cryptopp_hasher(Allocator &, Env &, Algorithm const &, size_t);
+	Hasher *create_nettle_hasher  (Allocator &, Env &, Algorithm const &, size_t);
+	Hasher *create_sodium_hasher  (Allocator &, Env &, Algorithm const &, size_t);
+	Hasher *create_tree_hasher    (Allocator &, Env &, size_t, unsigned);
+}
+
+
+struct Rom_hash::Hasher : Interface
+{
+	enum { MAX_DIGEST_SIZE = 64 };
+
+	virtual size_t digest_size() const = 0;
+
+	/**
+	 * Calculate digest over the first 'size' bytes of dataspace 'ds'
+	 */
+	virtual void hash(Dataspace_capability ds, size_t size, uint8_t *digest) = 0;
+};
+
+
+/**
+ * Hasher that processes the dataspace sequentially
+ *
+ * The dataspace is attached and hashed in chunks instead of mapping it as
+ * a whole.
+ */
+struct Rom_hash::Stream_hasher : Hasher
+{
+	enum { CHUNK_SIZE = 1 << 20 };
+
+	Env &_env;
+
+	Stream_hasher(Env &env) : _env(env) { }
+
+	virtual void update(uint8_t const *data, size_t len) = 0;
+	virtual void finish(uint8_t *digest) = 0;
+
+	void hash(Dataspace_capability ds, size_t size, uint8_t *digest) override
+	{
+		for (size_t off = 0; off < size; off += CHUNK_SIZE) {
+			size_t const len = min(size - off, (size_t)CHUNK_SIZE);
+
+			uint8_t const *chunk = _env.rm().attach(ds, len, off);
+			update(chunk, len);
+			_env.rm().detach(chunk);
+		}
+
+		finish(digest);
+	}
+};
+
+#endif /* _ROM_VERIFY__HASHER_H_ */
@@ -12,30 +12,282 @@
  */
 
 /* Crypto++ includes */
-#include <sha3.h>
 #include <sha.h>
 #include <hex.h>
 
 /* Genode includes */
 #include <os/session_policy.h>
 #include <rom_session/connection.h>
+#include <rm_session/connection.h>
+#include <region_map/client.h>
 #include <base/attached_rom_dataspace.h>
 #include <base/heap.h>
 #include <base/service.h>
 #include <base/session_label.h>
+#include <dataspace/client.h>
+#include <util/reconstructible.h>
+#include <util/retry.h>
 #include <libc/component.h>
 #include <base/log.h>
 
+/* local includes */
+#include <hasher.h>
+
 namespace Rom_hash {
 	using namespace Genode;
 
+	struct Verified_rom;
+	struct Verified_cache;
+	struct Paged_rom;
 	struct Session;
 	struct Main;
 
 	typedef Session_state::Args Args;
+
+	static std::string decode_hex(char const *hex, size_t len)
+	{
+		using namespace CryptoPP;
+
+		HexDecoder decoder;
+		decoder.Put((byte const *)hex, len);
+		decoder.MessageEnd();
+
+		std::string bin;
+		bin.resize(decoder.MaxRetrievable());
+		decoder.Get((byte*)bin.data(), bin.size());
+		return bin;
+	}
 }
 
 
+/**
+ * ROM module that was verified already
+ *
+ * A module is identified by its label and its dataspace. The capability of
+ * the dataspace is kept to prevent its name from being reused for another
+ * dataspace. The expected digest is part of the key so that policy changes
+ * take effect for cached modules.
+ */
+struct Rom_hash::Verified_rom
+{
+	typedef String<160> Digest;   /* "<algorithm>=<hex digest>" */
+
+	Session_label        const label;
+	Dataspace_capability const ds;
+	size_t               const size;
+	Digest               const digest;
+
+	Verified_rom(Session_label const &label, Dataspace_capability ds,
+	             size_t size, Digest const &digest)
+	: label(label), ds(ds), size(size), digest(digest) { }
+
+	bool matches(Session_label const &l, Dataspace_capability d,
+	             size_t s, Digest const &dg) const
+	{
+		return ds == d && size == s && label == l && digest == dg;
+	}
+};
+
+
+/**
+ * Fixed-size cache of verified ROM modules with round-robin replacement
+ */
+struct Rom_hash::Verified_cache
+{
+	enum { MAX_ENTRIES = 32 };
+
+	Constructible<Verified_rom> _entries[MAX_ENTRIES] { };
+
+	unsigned _next = 0;
+
+	bool contains(Session_label const &label, Dataspace_capability ds,
+	              size_t size, Verified_rom::Digest const &digest) const
+	{
+		for (Constructible<Verified_rom> const &e : _entries)
+			if (e.constructed() && e->matches(label, ds, size, digest))
+				return true;
+
+		return false;
+	}
+
+	void insert(Session_label const &label, Dataspace_capability ds,
+	            size_t size, Verified_rom::Digest const &digest)
+	{
+		_entries[_next].construct(label, ds, size, digest);
+		_next = (_next + 1) % MAX_ENTRIES;
+	}
+};
+
+
+/**
+ * ROM session verifying the content on demand
+ *
+ * The client obtains a managed dataspace that is populated block by block
+ * the first time a block is touched. Each block is checked against the
+ * SHA-256 digest of a hash tree before it becomes accessible. The tree is
+ * provided as separate ROM module that contains the concatenated SHA-256
+ * digests of all blocks. The tree itself is verified against the root named
+ * by the policy when the session is created, which merely costs hashing
+ * 32 bytes per block. The last block is hashed up to the end of the
+ * dataspace.
+ *
+ * ! <policy label="python.tar" merkle_root="<hex SHA-256 of tree>"
+ * !         merkle_tree="python.tar.merkle" merkle_block="65536"/>
+ *
+ * A block whose digest does not match is never mapped, which leaves the
+ * faulting client blocked. The same holds for write accesses.
+ */
+struct Rom_hash::Paged_rom : Rpc_object<Rom_session>
+{
+	typedef String<160> Tree_label;
+
+	enum {
+		DIGEST_SIZE    = CryptoPP::SHA256::DIGESTSIZE,
+		MIN_BLOCK_SIZE = 4096,
+
+		/* quota donated to the RM session whenever its regions exhaust it */
+		UPGRADE_RAM    = 8*1024,
+		UPGRADE_CAPS   = 2,
+	};
+
+	Env &_env;
+
+	Session_label        const _label;
+	Dataspace_capability const _backing;
+	size_t               const _size = Dataspace_client(_backing).size();
+	size_t               const _block_size;
+	size_t               const _num_blocks = (_size + _block_size - 1) / _block_size;
+
+	Attached_rom_dataspace _tree;
+
+	Rm_connection     _rm_connection { _env };
+	Region_map_client _rm { _rm_connection.create(_size) };
+
+	Signal_handler<Paged_rom> _fault_handler {
+		_env.ep(), *this, &Paged_rom::_handle_fault };
+
+	static size_t _checked_block_size(size_t size)
+	{
+		if (size < MIN_BLOCK_SIZE || (size & (size - 1))) {
+			error("invalid merkle_block size ", size);
+			throw Service_denied();
+		}
+		return size;
+	}
+
+	CryptoPP::byte const *_leaf(size_t block) const
+	{
+		return _tree.local_addr<CryptoPP::byte const>() + block*DIGEST_SIZE;
+	}
+
+	bool _verify_block(size_t block)
+	{
+		size_t const off = block*_block_size;
+		size_t const len = min(_size - off, _block_size);
+
+		CryptoPP::byte const *data = _env.rm().attach(_backing, len, off);
+		bool const ok = CryptoPP::SHA256().VerifyDigest(_leaf(block), data, len);
+		_env.rm().detach(data);
+
+		return ok;
+	}
+
+	/**
+	 * Map block read-only at its original offset
+	 *
+	 * Each block is a separate region of the managed dataspace, so the
+	 * RM session is upgraded as its regions consume the quota.
+	 */
+	void _attach_block(size_t off, size_t len)
+	{
+		retry<Out_of_ram>(
+			[&] () {
+				retry<Out_of_caps>(
+					[&] () { _rm.attach(_backing, len, off, true, off, false, false); },
+					[&] () { _rm_connection.upgrade_caps(UPGRADE_CAPS); });
+			},
+			[&] () { _rm_connection.upgrade_ram(UPGRADE_RAM); });
+	}
+
+	void _handle_fault()
+	{
+		Region_map::State const state = _rm.state();
+		if (state.type == Region_map::State::READY)
+			return;
+
+		if (state.type == Region_map::State::WRITE_FAULT) {
+			error(_label, ": denied write to ROM at ", Hex(state.addr));
+			return;
+		}
+
+		size_t const block = state.addr / _block_size;
+		if (block >= _num_blocks) {
+			error(_label, ": fault outside of ROM at ", Hex(state.addr));
+			return;
+		}
+
+		size_t const off = block*_block_size;
+		size_t const len = min(_size - off, _block_size);
+
+		try {
+			if (!_verify_block(block)) {
+				error(_label, ": block ", block, " does not match hash tree");
+				return;
+			}
+
+			_attach_block(off, len);
+		}
+		catch (Region_map::Region_conflict) {
+			/* e.g., an execute access to a block mapped already */
+			error(_label, ": denied access to mapped block ", block,
+			      " at ", Hex(state.addr));
+		}
+		catch (...) {
+			error(_label, ": failed to map block ", block);
+		}
+	}
+
+	Paged_rom(Env &env, Session_label const &label,
+	          Dataspace_capability backing, Session_policy const &policy)
+	:
+		_env(env), _label(label), _backing(backing),
+		_block_size(_checked_block_size(
+			policy.attribute_value("merkle_block", (size_t)MIN_BLOCK_SIZE))),
+		_tree(env, policy.attribute_value("merkle_tree", Tree_label()).string())
+	{
+		Xml_attribute const attr = policy.attribute("merkle_root");
+		std::string const root = decode_hex(attr.value_base(), attr.value_size());
+
+		size_t const tree_size = _num_blocks*DIGEST_SIZE;
+		if (root.size() != DIGEST_SIZE || _tree.size() < tree_size
+		 || !CryptoPP::SHA256().VerifyDigest((CryptoPP::byte const *)root.data(),
+		                                     _tree.local_addr<CryptoPP::byte const>(),
+		                                     tree_size)) {
+			error(label, ": hash tree does not match merkle_root");
+			throw Service_denied();
+		}
+
+		log(label, " ", _num_blocks, " blocks verified on demand");
+
+		_rm.fault_handler(_fault_handler);
+		_env.ep().manage(*this);
+	}
+
+	~Paged_rom() { _env.ep().dissolve(*this); }
+
+	/***************************
+	 ** ROM session interface **
+	 ***************************/
+
+	Rom_dataspace_capability dataspace() override
+	{
+		return static_cap_cast<Rom_dataspace>(_rm.dataspace());
+	}
+
+	void sigh(Signal_context_capability) override { }
+};
+
+
 struct Rom_hash::Session :
 	Genode::Parent::Server,
 	Genode::Connection<Rom_session>
@@ -45,14 +297,28 @@ struct Rom_hash::Session :
 	Id_space<Parent::Client>::Element client_id;
 	Id_space<Parent::Server>::Element server_id;
 
+	/* on-demand verification if the policy names a hash tree */
+	Constructible<Paged_rom> paged { };
+
+	/**
+	 * Return ROM session handed out to the client
+	 */
+	Capability<Rom_session> rom_cap()
+	{
+		return paged.constructed() ? paged->cap() : cap();
+	}
+
 	void verify(Session_label const &label,
-	            CryptoPP::HashTransformation &hash,
-	            Genode::Xml_attribute &attr);
+	            Hasher &hasher,
+	            Genode::Xml_attribute &attr,
+	            Verified_cache &cache);
 
 	Session(Id_space<Parent::Client> &client_space,
 	        Id_space<Parent::Server> &server_space,
 	        Parent::Server::Id server_id,
 	        Genode::Env &env,
+	        Allocator &alloc,
+	        Verified_cache &cache,
 	        Session_label  const &label,
 	        Session_policy const &policy,
 	        Args           const &args);
@@ -60,34 +326,37 @@ struct Rom_hash::Session :
 
 
 void Rom_hash::Session::verify(Session_label const &label,
-                               CryptoPP::HashTransformation &hash,
-                               Genode::Xml_attribute &attr)
+                               Hasher &hasher,
+                               Genode::Xml_attribute &attr,
+                               Verified_cache &cache)
 {
 	using namespace CryptoPP;
 
-	std::string const hex_target(attr.value_base(), attr.value_size());
-	std::string bin_target;
-	{
-		HexDecoder decoder;
+	Rom_session_client rom(cap());
+	Dataspace_capability const ds_cap = rom.dataspace();
+	size_t const ds_size = Dataspace_client(ds_cap).size();
 
-		decoder.Put((byte*)hex_target.data(), hex_target.size());
-		decoder.MessageEnd();
+	Verified_rom::Digest const policy_digest(
+		attr.name(), "=", Cstring(attr.value_base(), attr.value_size()));
 
-		bin_target.resize(decoder.MaxRetrievable());
-		decoder.Get((byte*)bin_target.data(), bin_target.size());
-	}
-	log(label, " ", hex_target.c_str());
+	if (cache.contains(label, ds_cap, ds_size, policy_digest))
+		return;
 
-	unsigned const digest_size = hash.DigestSize();
-	uint8_t digest[digest_size];
+	std::string const hex_target(attr.value_base(), attr.value_size());
+	std::string const bin_target = decode_hex(attr.value_base(), attr.value_size());
 
-	/* read the connection dataspace */
-	Rom_session_client rom(cap());
-	Attached_dataspace ds(_env.rm(), rom.dataspace());
+	log(label, " ", hex_target.c_str());
 
-	Genode::log("'", ds.local_addr<const char>(), "'");
+	size_t const digest_size = hasher.digest_size();
+	uint8_t digest[Hasher::MAX_DIGEST_SIZE];
 
-	hash.CalculateDigest(digest, ds.local_addr<const byte>(), ds.size());
+	hasher.hash(ds_cap, ds_size, digest);
+
+	if (bin_target.size() != digest_size) {
+		error(label, " digest has ", bin_target.size(), " bytes, expected ",
+		      digest_size);
+		throw Service_denied();
+	}
 
 	for (unsigned i = 0; i < bin_target.size(); ++i) {
 		if ((uint8_t)digest[i] != (uint8_t)bin_target[i]) {
@@ -102,6 +371,8 @@ void Rom_hash::Session::verify(Session_label const &label,
 			throw Service_denied();
 		}
 	}
+
+	cache.insert(label, ds_cap, ds_size, policy_digest);
 }
 
 
@@ -109,6 +380,8 @@ Rom_hash::Session::Session(Id_space<Parent::Client> &client_space,
                            Id_space<Parent::Server> &server_space,
                            Parent::Server::Id server_id,
                            Genode::Env &env,
+                           Allocator &alloc,
+                           Verified_cache &cache,
                            Session_label  const &label,
                            Session_policy const &policy,
                            Args           const &args)
@@ -117,33 +390,39 @@ Rom_hash::Session::Session(Id_space<Parent::Client> &client_space,
 	client_id(parent_client, client_space),
 	server_id(*this, server_space, server_id)
 {
-	try {
-		Xml_attribute attr = policy.attribute("sha3");
-		CryptoPP::SHA3 hash(attr.value_size()/2);
-		verify(label, hash, attr);
+	if (policy.has_attribute("merkle_root")) {
+		paged.construct(env, label, Rom_session_client(cap()).dataspace(), policy);
 		return;
-	} catch (Xml_node::Nonexistent_attribute) { }
+	}
 
-	try {
-		Xml_attribute attr = policy.attribute("sha512");
-		CryptoPP::SHA512 hash;
-		verify(label, hash, attr);
-		return;
-	} catch (Xml_node::Nonexistent_attribute) { }
+	Backend const backend = policy.attribute_value("backend", Backend("cryptopp"));
+	unsigned const threads = policy.attribute_value("threads", 1U);
 
-	try {
-		Xml_attribute attr = policy.attribute("sha256");
-		CryptoPP::SHA256 hash;
-		verify(label, hash, attr);
-		return;
-	} catch (Xml_node::Nonexistent_attribute) { }
+	static char const * const algorithms[] = {
+		"sha3", "sha512", "sha256", "sha1", "blake2b", "blake2b_tree" };
+
+	for (char const *algorithm : algorithms) {
+		if (!policy.has_attribute(algorithm))
+			continue;
+
+		Xml_attribute attr = policy.attribute(algorithm);
 
-	try {
-		Xml_attribute attr = policy.attribute("sha1");
-		CryptoPP::SHA1 hash;
-		verify(label, hash, attr);
+		Hasher *hasher = create_hasher(alloc, env, backend, algorithm,
+		                               attr.value_size()/2, threads);
+		if (!hasher) {
+			error(algorithm, " not supported by backend '", backend, "'");
+			throw Service_denied();
+		}
+
+		try { verify(label, *hasher, attr, cache); }
+		catch (...) {
+			destroy(alloc, hasher);
+			throw;
+		}
+
+		destroy(alloc, hasher);
 		return;
-	} catch (Xml_node::Nonexistent_attribute) { }
+	}
 
 	error("no hash policy found");
 	throw Service_denied();
@@ -162,6 +441,8 @@ struct Rom_hash::Main
 
 	Sliced_heap alloc { env.ram(), env.rm() };
 
+	Verified_cache verified_cache { };
+
 	bool config_stale = false;
 
 	void handle_config() {
@@ -223,9 +504,10 @@ void Rom_hash::Main::handle_session_request(Xml_node request)
 			Session_policy const policy(label, config_rom.xml());
 
 			Session *session = new (alloc)
-				Session(env.id_space(), server_id_space, server_id, env, label, policy, args);
+				Session(env.id_space(), server_id_space, server_id, env,
+				        alloc, verified_cache, label, policy, args);
 			if (session) {
-				env.parent().deliver_session_cap(server_id, session->cap());
+				env.parent().deliver_session_cap(server_id, session->rom_cap());
 				return;
 			}
 			return;
@@ -0,0 +1,66 @@
+/*
+ * \brief  Hashing backend based on nettle
+ * \author agent
+ * \date   2026-10-19
+ */
+
+/*
+ * Copyright (C) 2026 agent
+ *
+ * This file is part of the Genode OS framework, which is distributed
+ * under the terms of the GNU General Public License version 2.
+ */
+
+/* nettle includes */
+#include <nettle/nettle-meta.h>
+
+/* local includes */
+#include <hasher.h>
+
+namespace Rom_hash { struct Nettle_hasher; }
+
+
+/**
+ * Hasher for any algorithm described by nettle's generic hash interface
+ */
+struct Rom_hash::Nettle_hasher : Stream_hasher
+{
+	nettle_hash const &_hash;
+
+	alignas(16) uint8_t _ctx[NETTLE_MAX_HASH_CONTEXT_SIZE];
+
+	Nettle_hasher(Env &env, nettle_hash const &hash)
+	: Stream_hasher(env), _hash(hash) { _hash.init(_ctx); }
+
+	size_t digest_size() const override { return _hash.digest_size; }
+
+	void update(uint8_t const *data, size_t len) override {
+		_hash.update(_ctx, len, data); }
+
+	void finish(uint8_t *digest) override {
+		_hash.digest(_ctx, _hash.digest_size, digest); }
+};
+
+
+Rom_hash::Hasher *Rom_hash::create_nettle_hasher(Allocator       &alloc,
+                                                 Env             &env,
+                                                 Algorithm const &algorithm,
+                                                 size_t           digest_size)
+{
+	nettle_hash const *hash = nullptr;
+
+	if (algorithm == "sha1")   hash = &nettle_sha1;
+	if (algorithm == "sha256") hash = &nettle_sha256;
+	if (algorithm == "sha512") hash = &nettle_sha512;
+
+	if (algorithm == "sha3") {
+		switch (digest_size) {
+		case 28: hash = &nettle_sha3_224; break;
+		case 32: hash = &nettle_sha3_256; break;
+		case 48: hash = &nettle_sha3_384; break;
+		case 64: hash = &nettle_sha3_512; break;
+		}
+	}
+
+	return hash ? new (alloc) Nettle_hasher(env, *hash) : nullptr;
+}
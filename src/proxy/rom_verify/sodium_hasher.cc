@@ -0,0 +1,215 @@
+/*
+ * \brief  Hashing backends based on libsodium
+ * \author agent
+ * \date   2026-10-19
+ */
+
+/*
+ * Copyright (C) 2026 agent
+ *
+ * This file is part of the Genode OS framework, which is distributed
+ * under the terms of the GNU General Public License version 2.
+ */
+
+/* libsodium includes */
+#include <sodium.h>
+
+/* Genode includes */
+#include <base/thread.h>
+#include <util/reconstructible.h>
+
+/* local includes */
+#include <hasher.h>
+
+namespace Rom_hash {
+	struct Sodium_sha256_hasher;
+	struct Sodium_sha512_hasher;
+	struct Sodium_blake2b_hasher;
+	struct Tree_hasher;
+}
+
+
+struct Rom_hash::Sodium_sha256_hasher : Stream_hasher
+{
+	crypto_hash_sha256_state _state { };
+
+	Sodium_sha256_hasher(Env &env) : Stream_hasher(env) {
+		crypto_hash_sha256_init(&_state); }
+
+	size_t digest_size() const override { return crypto_hash_sha256_BYTES; }
+
+	void update(uint8_t const *data, size_t len) override {
+		crypto_hash_sha256_update(&_state, data, len); }
+
+	void finish(uint8_t *digest) override {
+		crypto_hash_sha256_final(&_state, digest); }
+};
+
+
+struct Rom_hash::Sodium_sha512_hasher : Stream_hasher
+{
+	crypto_hash_sha512_state _state { };
+
+	Sodium_sha512_hasher(Env &env) : Stream_hasher(env) {
+		crypto_hash_sha512_init(&_state); }
+
+	size_t digest_size() const override { return crypto_hash_sha512_BYTES; }
+
+	void update(uint8_t const *data, size_t len) override {
+		crypto_hash_sha512_update(&_state, data, len); }
+
+	void finish(uint8_t *digest) override {
+		crypto_hash_sha512_final(&_state, digest); }
+};
+
+
+struct Rom_hash::Sodium_blake2b_hasher : Stream_hasher
+{
+	size_t const _digest_size;
+
+	crypto_generichash_state _state { };
+
+	Sodium_blake2b_hasher(Env &env, size_t digest_size)
+	: Stream_hasher(env), _digest_size(digest_size)
+	{
+		crypto_generichash_init(&_state, nullptr, 0, _digest_size);
+	}
+
+	size_t digest_size() const override { return _digest_size; }
+
+	void update(uint8_t const *data, size_t len) override {
+		crypto_generichash_update(&_state, data, len); }
+
+	void finish(uint8_t *digest) override {
+		crypto_generichash_final(&_state, digest, _digest_size); }
+};
+
+
+/**
+ * BLAKE2b tree hashing
+ *
+ * The dataspace is split into chunks of 'CHUNK_SIZE' bytes that are hashed
+ * independently by a number of worker threads. The digest is the BLAKE2b
+ * digest over the concatenated chunk digests. With 'b2sum' it can be
+ * computed on the host by splitting the file via 'split -b 1M' and hashing
+ * the concatenation of the binary chunk digests.
+ */
+struct Rom_hash::Tree_hasher : Hasher
+{
+	enum {
+		CHUNK_SIZE  = 1 << 20,
+		MAX_THREADS = 16,
+		STACK_SIZE  = 16*1024*sizeof(long),
+	};
+
+	struct Worker : Thread
+	{
+		Env                 &_env;
+		Dataspace_capability _ds;
+		size_t         const _size;
+		size_t         const _digest_size;
+		uint8_t       *const _leaves;
+		size_t         const _first;
+		size_t         const _stride;
+
+		Worker(Env &env, Dataspace_capability ds, size_t size,
+		       size_t digest_size, uint8_t *leaves,
+		       size_t first, size_t stride)
+		:
+			Thread(env, "tree_hasher", STACK_SIZE),
+			_env(env), _ds(ds), _size(size), _digest_size(digest_size),
+			_leaves(leaves), _first(first), _stride(stride)
+		{ }
+
+		void entry() override
+		{
+			for (size_t off = _first*CHUNK_SIZE; off < _size;
+			     off += _stride*CHUNK_SIZE) {
+
+				size_t const len = min(_size - off, (size_t)CHUNK_SIZE);
+
+				uint8_t const *chunk = _env.rm().attach(_ds, len, off);
+				crypto_generichash(_leaves + (off / CHUNK_SIZE)*_digest_size,
+				                   _digest_size, chunk, len, nullptr, 0);
+				_env.rm().detach(chunk);
+			}
+		}
+	};
+
+	Env       &_env;
+	Allocator &_alloc;
+	size_t     const _digest_size;
+	unsigned   const _threads;
+
+	Tree_hasher(Env &env, Allocator &alloc, size_t digest_size, unsigned threads)
+	:
+		_env(env), _alloc(alloc), _digest_size(digest_size),
+		_threads(max(1U, min(threads, (unsigned)MAX_THREADS)))
+	{ }
+
+	size_t digest_size() const override { return _digest_size; }
+
+	void hash(Dataspace_capability ds, size_t size, uint8_t *digest) override
+	{
+		size_t const chunks = max((size_t)1, (size + CHUNK_SIZE - 1) / CHUNK_SIZE);
+		size_t const leaves_size = chunks*_digest_size;
+
+		uint8_t *leaves = (uint8_t *)_alloc.alloc(leaves_size);
+
+		Constructible<Worker> workers[MAX_THREADS];
+
+		unsigned const threads = min((size_t)_threads, chunks);
+		for (unsigned i = 0; i < threads; i++) {
+			workers[i].construct(_env, ds, size, _digest_size, leaves, i, threads);
+			workers[i]->start();
+		}
+
+		for (unsigned i = 0; i < threads; i++) {
+			workers[i]->join();
+			workers[i].destruct();
+		}
+
+		/* an empty dataspace consists of a single empty chunk */
+		if (!size)
+			crypto_generichash(leaves, _digest_size, nullptr, 0, nullptr, 0);
+
+		crypto_generichash(digest, _digest_size, leaves, leaves_size, nullptr, 0);
+
+		_alloc.free(leaves, leaves_size);
+	}
+};
+
+
+Rom_hash::Hasher *Rom_hash::create_sodium_hasher(Allocator       &alloc,
+                                                 Env             &env,
+                                                 Algorithm const &algorithm,
+                                                 size_t           digest_size)
+{
+	if (sodium_init() < 0)
+		return nullptr;
+
+	if (algorithm == "sha256")
+		return new (alloc) Sodium_sha256_hasher(env);
+	if (algorithm == "sha512")
+		return new (alloc) Sodium_sha512_hasher(env);
+	if (algorithm == "blake2b"
+	 && digest_size >= crypto_generichash_BYTES_MIN
+	 && digest_size <= crypto_generichash_BYTES_MAX)
+		return new (alloc) Sodium_blake2b_hasher(env, digest_size);
+
+	return nullptr;
+}
+
+
+Rom_hash::Hasher *Rom_hash::create_tree_hasher(Allocator &alloc,
+                                               Env       &env,
+                                               size_t     digest_size,
+                                               unsigned   threads)
+{
+	if (sodium_init() < 0
+	 || digest_size < crypto_generichash_BYTES_MIN
+	 || digest_size > crypto_generichash_BYTES_MAX)
+		return nullptr;
+
+	return new (alloc) Tree_hasher(env, alloc, digest_size, threads);
+}
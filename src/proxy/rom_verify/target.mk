@@ -1,5 +1,6 @@
 TARGET   = rom_verify
-SRC_CC   = main.cc
-LIBS     = base cryptopp stdcxx
+SRC_CC   = main.cc hasher.cc cryptopp_hasher.cc nettle_hasher.cc sodium_hasher.cc
+LIBS     = base cryptopp nettle libsodium libc stdcxx
+INC_DIR += $(PRG_DIR)
 
 CC_CXX_WARN_STRICT =
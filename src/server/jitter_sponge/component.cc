@@ -13,11 +13,19 @@
 
 /* local includes */
 #include "session_requests.h"
+#include "health_test.h"
 
 #include <terminal_session/connection.h>
+#include <timer_session/connection.h>
+#include <os/reporter.h>
+#include <trace/timestamp.h>
 #include <base/attached_ram_dataspace.h>
+#include <base/attached_rom_dataspace.h>
 #include <base/heap.h>
 #include <base/component.h>
+#include <base/thread.h>
+#include <base/blockade.h>
+#include <base/mutex.h>
 
 #include <world/rdrand.h>
 
@@ -33,6 +41,10 @@ extern "C" {
 namespace Jitter_sponge {
 	using namespace Genode;
 
+	struct Entropy_source;
+	class  Reserve;
+	struct Collector;
+	class  Sponge;
 	struct Generator;
 	class  Session_component;
 	struct Main;
@@ -43,60 +55,390 @@ namespace Jitter_sponge {
 }
 
 
+/**
+ * Source of entropy, either RDRAND or jitter measurements
+ *
+ * Both sources deliver conditioned output only, see 'Health_test'.
+ */
+struct Jitter_sponge::Entropy_source
+{
+	struct rand_data *jitter = nullptr;
+
+	Health_test _health { };
+
+	static char const *name() {
+		return Genode::Rdrand::supported() ? "rdrand" : "jitter"; }
+
+	Entropy_source(Allocator &alloc)
+	{
+		jitterentropy_init(alloc);
+		if (jent_entropy_init()) {
+			error("jitterentropy library could not be initialized!");
+			throw Collection_failure();
+		}
+
+		jitter = jent_entropy_collector_alloc(0, 0);
+		if (!jitter) {
+			error("failed to allocate jitter entropy collector");
+			throw Collection_failure();
+		}
+	}
+
+	/**
+	 * Fill 'buf' with 'n' bytes of conditioned entropy source output
+	 *
+	 * \throw Collection_failure  collection or health test failed
+	 */
+	void collect(unsigned char *buf, size_t n)
+	{
+		if (Genode::Rdrand::supported()) {
+			for (size_t i = 0; i < n; i += sizeof(uint64_t)) {
+				uint64_t const v = Genode::Rdrand::random64();
+				memcpy(buf + i, &v, min(n - i, sizeof(v)));
+			}
+		} else {
+			long const got = jent_read_entropy(jitter, (char *)buf, n);
+			if (got < 0 || (size_t)got != n)
+				throw Collection_failure();
+		}
+
+		if (!_health.test(buf, n)) {
+			error(name(), " entropy source failed health test");
+			throw Collection_failure();
+		}
+	}
+};
+
+
+/**
+ * Reserve of collected entropy waiting to be mixed into the sponge
+ *
+ * The reserve is refilled by the collector thread up to the high watermark
+ * whenever it drops below the low watermark, which keeps the latency of
+ * the entropy collection off the entrypoint.
+ */
+class Jitter_sponge::Reserve
+{
+	public:
+
+		struct Statistics
+		{
+			size_t   level;
+			uint64_t collections;
+			uint64_t bytes_collected;
+			uint64_t cycles_total;       /* time spent collecting */
+			uint64_t cycles_max;         /* slowest collection */
+			bool     failed;
+		};
+
+	private:
+
+		Reserve(Reserve const &);
+		Reserve &operator = (Reserve const &);
+
+		Allocator      &_alloc;
+		size_t    const _high;
+		size_t    const _low;
+		unsigned char  *_buf;
+		size_t          _level      = 0;
+		bool            _collecting = false;
+		bool            _failed     = false;
+
+		uint64_t _collections     = 0;
+		uint64_t _bytes_collected = 0;
+		uint64_t _cycles_total    = 0;
+		uint64_t _cycles_max      = 0;
+
+		Mutex    _mutex    { };
+		Blockade _blockade { };
+
+	public:
+
+		Reserve(Allocator &alloc, size_t high, size_t low)
+		:
+			_alloc(alloc), _high(max(high, (size_t)1)), _low(min(low, _high - 1)),
+			_buf((unsigned char *)_alloc.alloc(_high))
+		{ }
+
+		~Reserve() { _alloc.free(_buf, _high); }
+
+		size_t high() const { return _high; }
+
+		/**
+		 * Take up to 'n' bytes from the reserve
+		 *
+		 * \return number of bytes taken
+		 * \throw  Collection_failure
+		 */
+		size_t take(unsigned char *dst, size_t n)
+		{
+			Mutex::Guard guard(_mutex);
+
+			if (_failed)
+				throw Collection_failure();
+
+			n = min(n, _level);
+			_level -= n;
+			memcpy(dst, _buf + _level, n);
+			memset(_buf + _level, 0, n);
+
+			if (_level <= _low && !_collecting) {
+				_collecting = true;
+				_blockade.wakeup();
+			}
+
+			return n;
+		}
+
+		/**
+		 * Append collected entropy
+		 *
+		 * \param cycles  time taken by the collection
+		 * \return true if the reserve is full
+		 */
+		bool put(unsigned char const *src, size_t n, uint64_t cycles)
+		{
+			Mutex::Guard guard(_mutex);
+
+			_collections++;
+			_bytes_collected += n;
+			_cycles_total    += cycles;
+			_cycles_max       = max(_cycles_max, cycles);
+
+			n = min(n, _high - _level);
+			memcpy(_buf + _level, src, n);
+			_level += n;
+
+			if (_level < _high)
+				return false;
+
+			_collecting = false;
+			return true;
+		}
+
+		void fail()
+		{
+			Mutex::Guard guard(_mutex);
+			_failed = true;
+		}
+
+		bool failed()
+		{
+			Mutex::Guard guard(_mutex);
+			return _failed;
+		}
+
+		Statistics statistics()
+		{
+			Mutex::Guard guard(_mutex);
+			return Statistics { _level, _collections, _bytes_collected,
+			                    _cycles_total, _cycles_max, _failed };
+		}
+
+		/**
+		 * Wait until the reserve dropped to the low watermark
+		 */
+		void wait_for_demand() { _blockade.block(); }
+};
+
+
+/**
+ * Thread that refills the reserve
+ */
+struct Jitter_sponge::Collector : Thread
+{
+	enum { CHUNK_SIZE = 64, STACK_SIZE = 16*1024*sizeof(long) };
+
+	Entropy_source &_source;
+	Reserve        &_reserve;
+
+	Collector(Env &env, Entropy_source &source, Reserve &reserve)
+	:
+		Thread(env, "collector", STACK_SIZE),
+		_source(source), _reserve(reserve)
+	{ }
+
+	void entry() override
+	{
+		unsigned char buf[CHUNK_SIZE];
+
+		for (;;) {
+			_reserve.wait_for_demand();
+
+			try {
+				bool full = false;
+				while (!full) {
+					Trace::Timestamp const start = Trace::timestamp();
+					_source.collect(buf, sizeof(buf));
+					full = _reserve.put(buf, sizeof(buf),
+					                    Trace::timestamp() - start);
+				}
+			} catch (Collection_failure) {
+				error("jitter collection failed");
+				_reserve.fail();
+				return;
+			}
+		}
+	}
+};
+
+
+/**
+ * Keccak sponge-based pseudo-random generator
+ */
+class Jitter_sponge::Sponge
+{
+	private:
+
+		KeccakWidth1600_SpongePRG_Instance _instance { };
+
+		void _die(char const *msg)
+		{
+			/* forget sponge state */
+			KeccakWidth1600_SpongePRG_Forget(&_instance);
+			Genode::error(msg);
+			throw Exception();
+		}
+
+	public:
+
+		Sponge()
+		{
+			if (KeccakWidth1600_SpongePRG_Initialize(&_instance, 254))
+				_die("failed to initialize sponge");
+		}
+
+		~Sponge() { KeccakWidth1600_SpongePRG_Forget(&_instance); }
+
+		void feed(unsigned char const *buf, size_t n)
+		{
+			if (KeccakWidth1600_SpongePRG_Feed(&_instance, buf, n))
+				_die("failed to feed sponge");
+		}
+
+		void fetch(unsigned char *buf, size_t n)
+		{
+			if (KeccakWidth1600_SpongePRG_Fetch(&_instance, buf, n))
+				_die("failed to fetch from sponge");
+		}
+
+		/**
+		 * Make the current state irreversible (backtracking resistance)
+		 */
+		void forget()
+		{
+			if (KeccakWidth1600_SpongePRG_Forget(&_instance))
+				_die("failed to forget sponge state");
+		}
+};
+
+
 struct Jitter_sponge::Generator
 {
-	KeccakWidth1600_SpongePRG_Instance sponge { };
+	enum {
+		DEFAULT_RESERVE_HIGH = 4096,
+		DEFAULT_RESERVE_LOW  = 1024,
+		MIX_BYTES            = 32,
+	};
 
-	struct rand_data *jitter = nullptr;
+	Sponge         _sponge { };
+	Entropy_source _source;
+
+	/* statistics of the entrypoint, the collector is accounted by the reserve */
+	uint64_t bytes_served = 0;
+	uint64_t reseeds      = 0;
+
+	Reserve        _reserve;
+	Collector      _collector;
 
 	void die(char const *msg)
 	{
 		/* forget sponge state */
-		KeccakWidth1600_SpongePRG_Forget(&sponge);
+		_sponge.forget();
 		Genode::error(msg);
 		throw Exception();
 	}
 
-	Generator(Allocator &alloc)
+	Generator(Env &env, Allocator &alloc, Xml_node config)
+	:
+		_source(alloc),
+		_reserve(alloc,
+		         config.attribute_value("reserve_high", (size_t)DEFAULT_RESERVE_HIGH),
+		         config.attribute_value("reserve_low",  (size_t)DEFAULT_RESERVE_LOW)),
+		_collector(env, _source, _reserve)
 	{
-		jitterentropy_init(alloc);
-		if (jent_entropy_init())
-			die("jitterentropy library could not be initialized!");
+		/* seed the sponge before serving any request */
+		unsigned char seed[MIX_BYTES];
+		try { _source.collect(seed, sizeof(seed)); }
+		catch (Collection_failure) { die("jitter collection failed"); }
+		_sponge.feed(seed, sizeof(seed));
+		memset(seed, 0, sizeof(seed));
 
-		jitter = jent_entropy_collector_alloc(0, 0);
-		if (!jitter)
-			die("failed to allocate jitter entropy collector");
+		_collector.start();
 
-		if (KeccakWidth1600_SpongePRG_Initialize(&sponge, 254))
-			die("failed to initialize sponge");
+		/* request the initial fill of the reserve */
+		mix();
 	}
 
-	void mix()
+	/**
+	 * Mix entropy from the reserve into the sponge
+	 *
+	 * Besides the initial fill at construction, mixing happens only when a
+	 * session sponge is seeded or reseeded by 'fork', once before and once
+	 * after the seed is fetched from the master sponge. So up to 64 bytes
+	 * are mixed per fork, on session creation and after 'RESEED_BYTES' of
+	 * output or 'RESEED_READS' reads of a session. If the reserve ran dry,
+	 * the sponge is used without mixing until the collector catches up.
+	 *
+	 * \return false if the entropy collection failed
+	 */
+	bool mix()
 	{
-		/* mix at entry and exit of 'read', so 32 bytes are mixed between reads */
+		unsigned char buf[MIX_BYTES];
+		size_t n = 0;
+
+		try { n = _reserve.take(buf, sizeof(buf)); }
+		catch (Collection_failure) {
+			/* forget sponge state */
+			_sponge.forget();
+			return false;
+		}
 
-		if (Genode::Rdrand::supported()) {
-			enum { RDRAND_COUNT = 4 };
-			Genode::uint64_t buf[4];
-			for (unsigned i = 0; i < RDRAND_COUNT; i++)
-				buf[i] = Genode::Rdrand::random64();
-			if (KeccakWidth1600_SpongePRG_Feed(&sponge, (unsigned char *)buf, sizeof(buf)))
-				die("failed to feed sponge");
-		} else {
-			enum { MIX_BYTES = 16};
-			char buf[MIX_BYTES];
-			if (jent_read_entropy(jitter, buf, MIX_BYTES) != MIX_BYTES)
-				die("jitter collection failed");
+		if (n)
+			_sponge.feed(buf, n);
 
-			if (KeccakWidth1600_SpongePRG_Feed(&sponge, (unsigned char *)buf, MIX_BYTES))
-				die("failed to feed sponge");
-		}
+		memset(buf, 0, sizeof(buf));
+		return true;
 	}
 
-	void fetch(unsigned char *buf, size_t n)
+	bool failed() { return _reserve.failed(); }
+
+	void fetch(unsigned char *buf, size_t n) { _sponge.fetch(buf, n); }
+
+	Reserve::Statistics reserve_statistics() { return _reserve.statistics(); }
+
+	/**
+	 * Seed a forked sponge from the master sponge
+	 *
+	 * \return false if the entropy collection failed
+	 */
+	bool fork(Sponge &child)
 	{
-		if (KeccakWidth1600_SpongePRG_Fetch(&sponge, buf, n))
-			die("failed to fetch from sponge");
+		unsigned char seed[2*MIX_BYTES];
+
+		if (!mix())
+			return false;
+
+		fetch(seed, sizeof(seed));
+
+		bool const ok = mix();
+		if (ok) {
+			child.feed(seed, sizeof(seed));
+			reseeds++;
+		}
+
+		memset(seed, 0, sizeof(seed));
+		return ok;
 	}
 };
 
@@ -110,31 +452,70 @@ class Jitter_sponge::Session_component final : public Genode::Rpc_object<Termina
 
 		Session_space::Element _sessions_elem;
 
+		/*
+		 * The session sponge is reseeded after 'RESEED_BYTES' of output or
+		 * 'RESEED_READS' reads, whichever comes first, so that sessions
+		 * with little output obtain fresh entropy too.
+		 */
+		enum { RESEED_BYTES = 1 << 20, RESEED_READS = 16 };
+
 		Genode::Attached_ram_dataspace _io_buffer;
 
 		Generator &_generator;
 
+		/*
+		 * Each session draws from its own sponge forked from the master
+		 * sponge of the generator. Only reseeding touches the master.
+		 */
+		Sponge   _sponge { };
+		size_t   _since_reseed = 0;
+		unsigned _reads        = 0;
+
+		bool _reseed()
+		{
+			_since_reseed = 0;
+			_reads        = 0;
+			return _generator.fork(_sponge);
+		}
+
 	public:
 
 		Session_component(Genode::Env &env,
 		                  Session_space &space,
 		                  Session_space::Id id,
-		                  Generator &generator)
+		                  Generator &generator,
+		                  size_t io_buffer_size)
 		:
 			_sessions_elem(*this, space, id),
-			_io_buffer(env.pd(), env.rm(), 0x1000),
+			_io_buffer(env.pd(), env.rm(), io_buffer_size),
 			_generator(generator)
-		{ }
+		{
+			_reseed();
+		}
 
 		Genode::Dataspace_capability _dataspace() {
 			return _io_buffer.cap(); }
 
 		Genode::size_t _read(Genode::size_t n)
 		{
-			_generator.mix();
+			/* no output is served once the entropy collection failed */
+			bool failed = _generator.failed();
+
+			if (!failed && (_since_reseed >= RESEED_BYTES || _reads >= RESEED_READS))
+				failed = !_reseed();
+
+			if (failed) {
+				_sponge.forget();
+				return 0;
+			}
+
 			n = min(n, _io_buffer.size());
-			_generator.fetch(_io_buffer.local_addr<unsigned char>(), n);
-			_generator.mix();
+			_sponge.fetch(_io_buffer.local_addr<unsigned char>(), n);
+			_sponge.forget();
+
+			_since_reseed += n;
+			_reads++;
+			_generator.bytes_served += n;
 			return n;
 		}
 
@@ -160,11 +541,19 @@ class Jitter_sponge::Session_component final : public Genode::Rpc_object<Termina
 struct Jitter_sponge::Main : Session_request_handler
 {
 	Genode::Env  &_env;
+	Attached_rom_dataspace _config_rom { _env, "config" };
 	Heap          _entropy_heap { _env.pd(), _env.rm() };
 	Sliced_heap   _session_heap { _env.pd(), _env.rm() };
-	Generator     _generator    { _entropy_heap };
+	Generator     _generator    { _env, _entropy_heap, _config_rom.xml() };
 	Session_space _sessions     { };
 
+	enum { DEFAULT_IO_BUFFER_SIZE = 64*1024 };
+
+	/* upper bound of the buffer that limits the amount of data per read */
+	size_t const _max_io_buffer_size = align_addr(max((size_t)4096,
+		_config_rom.xml().attribute_value("io_buffer",
+		                                  (size_t)DEFAULT_IO_BUFFER_SIZE)), 12);
+
 	void handle_session_create(Session_state::Name const &,
 	                           Parent::Server::Id pid,
 	                           Session_state::Args const &args) override
@@ -177,13 +566,17 @@ struct Jitter_sponge::Main : Session_request_handler
 		if (ram_quota < session_size)
 			throw Insufficient_ram_quota();
 
+		/* clients donating more quota obtain larger reads */
+		size_t const io_buffer_size =
+			min(_max_io_buffer_size,
+			    max((size_t)4096, (ram_quota - session_size) & ~0xfffUL));
+
 		Session_space::Id id { pid.value };
 
 		Session_component *session = new (_session_heap)
-			Session_component(_env, _sessions, id, _generator);
+			Session_component(_env, _sessions, id, _generator, io_buffer_size);
 
 		_env.parent().deliver_session_cap(pid, _env.ep().manage(*session));
-		_generator.mix();
 	}
 
 	void handle_session_upgrade(Parent::Server::Id,
@@ -203,8 +596,48 @@ struct Jitter_sponge::Main : Session_request_handler
 
 	Session_requests_rom _session_requests { _env, *this };
 
+	/*
+	 * Periodic report of the entropy statistics
+	 */
+	unsigned const _report_interval_ms =
+		_config_rom.xml().attribute_value("report_interval_ms", 0U);
+
+	Constructible<Timer::Connection> _timer    { };
+	Constructible<Reporter>          _reporter { };
+
+	void _handle_report()
+	{
+		Reserve::Statistics const stats = _generator.reserve_statistics();
+
+		Reporter::Xml_generator xml(*_reporter, [&] () {
+			xml.attribute("source",          Entropy_source::name());
+			xml.attribute("bytes_served",    _generator.bytes_served);
+			xml.attribute("reseeds",         _generator.reseeds);
+			xml.attribute("reserve_level",   stats.level);
+			xml.attribute("collections",     stats.collections);
+			xml.attribute("bytes_collected", stats.bytes_collected);
+			xml.attribute("avg_collection_cycles",
+			              stats.collections ? stats.cycles_total / stats.collections : 0);
+			xml.attribute("max_collection_cycles", stats.cycles_max);
+			if (stats.failed)
+				xml.attribute("failed", "yes");
+		});
+	}
+
+	Signal_handler<Main> _report_handler {
+		_env.ep(), *this, &Main::_handle_report };
+
 	Main(Genode::Env &env) : _env(env)
 	{
+		if (_report_interval_ms) {
+			_reporter.construct(_env, "statistics");
+			_reporter->enabled(true);
+
+			_timer.construct(_env);
+			_timer->sigh(_report_handler);
+			_timer->trigger_periodic(_report_interval_ms*1000UL);
+		}
+
 		env.parent().announce("Terminal");
 
 		/* process any requests that have already queued */
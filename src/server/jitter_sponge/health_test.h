@@ -0,0 +1,94 @@
+/*
+ * \brief  Continuous health tests of the entropy source
+ * \author agent
+ * \date   2026-10-19
+ */
+
+/*
+ * Copyright (C) 2026 agent
+ *
+ * This file is part of the Genode OS framework, which is distributed
+ * under the terms of the GNU Affero General Public License version 3.
+ */
+
+#ifndef __HEALTH_TEST_H_
+#define __HEALTH_TEST_H_
+
+#include <base/stdint.h>
+
+namespace Jitter_sponge { class Health_test; }
+
+
+/**
+ * Repetition count and adaptive proportion tests (NIST SP 800-90B, 4.4)
+ *
+ * Each byte delivered by the entropy source is treated as one sample.
+ * Neither source gives access to its raw noise samples. RDRAND output is
+ * conditioned by the DRBG of the CPU, and the jitterentropy library
+ * exports only 'jent_read_entropy', whose output is conditioned by its
+ * hash. The tests therefore operate on conditioned bytes.
+ *
+ * The cutoff values assume a min-entropy of one bit per sample and a
+ * false-positive probability of 2^-20. For a working source, conditioned
+ * bytes come close to eight bits per sample, so the cutoffs are never
+ * reached in practice. The tests only detect a stuck or failed source,
+ * e.g., RDRAND returning constant values, but do not assess the entropy
+ * rate of the noise.
+ */
+class Jitter_sponge::Health_test
+{
+	public:
+
+		enum {
+			RCT_CUTOFF = 21,    /* 1 + ceil(20 / H) */
+			APT_WINDOW = 512,   /* window size for non-binary samples */
+			APT_CUTOFF = 410,
+		};
+
+	private:
+
+		/* repetition count test */
+		unsigned char _rct_sample = 0;
+		unsigned      _rct_count  = 0;
+
+		/* adaptive proportion test */
+		unsigned char _apt_sample = 0;
+		unsigned      _apt_count  = 0;
+		unsigned      _apt_seen   = APT_WINDOW;
+
+	public:
+
+		/**
+		 * Test samples
+		 *
+		 * \return false if the source is considered to have failed
+		 */
+		bool test(unsigned char const *samples, Genode::size_t n)
+		{
+			for (Genode::size_t i = 0; i < n; i++) {
+				unsigned char const s = samples[i];
+
+				if (_rct_count && s == _rct_sample) {
+					if (++_rct_count >= RCT_CUTOFF)
+						return false;
+				} else {
+					_rct_sample = s;
+					_rct_count  = 1;
+				}
+
+				if (_apt_seen == APT_WINDOW) {
+					_apt_sample = s;
+					_apt_count  = 1;
+					_apt_seen   = 1;
+					continue;
+				}
+
+				_apt_seen++;
+				if (s == _apt_sample && ++_apt_count >= APT_CUTOFF)
+					return false;
+			}
+			return true;
+		}
+};
+
+#endif
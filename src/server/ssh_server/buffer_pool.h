@@ -0,0 +1,196 @@
+/*
+ * \brief  Buffer pools used by the sftp support of the ssh_server
+ * \author agent
+ * \date   2026-10-19
+ */
+
+/*
+ * Copyright (C) 2026 agent
+ *
+ * This file is part of the Genode OS framework, which is distributed
+ * under the terms of the GNU Affero General Public License version 3.
+ */
+
+#ifndef _SSH_TERMINAL_BUFFER_POOL_H_
+#define _SSH_TERMINAL_BUFFER_POOL_H_
+
+/* Genode includes */
+#include <base/mutex.h>
+
+/* libc includes */
+#include <stdlib.h>
+
+/* libssh includes */
+extern "C" {
+#include <libssh/buffer.h>
+}
+
+
+namespace Ssh {
+
+	using namespace Genode;
+
+	struct Block;
+	class  Block_pool;
+	class  Ssh_buffer_pool;
+}
+
+
+/**
+ * Memory block holding the payload of one incoming sftp packet
+ */
+struct Ssh::Block
+{
+	Block  *next     { nullptr };
+	size_t  capacity { 0 };
+	size_t  used     { 0 };
+
+	uint8_t *data() { return reinterpret_cast<uint8_t*>(this + 1); }
+};
+
+
+/**
+ * Cache of payload blocks shared by the channel thread and the sftp workers
+ *
+ * Blocks are released by the worker that processed the packet and reused
+ * for the next packet of sufficient size, so that a steady stream of WRITE
+ * requests does not hit the allocator.
+ */
+class Ssh::Block_pool
+{
+	private:
+
+		/* OpenSSH clients issue WRITE requests of 32 KiB by default */
+		static constexpr size_t   MIN_CAPACITY = 32*1024;
+		static constexpr unsigned MAX_CACHED   = 16;
+
+		Genode::Mutex _mutex  { };
+		Block        *_free   { nullptr };
+		unsigned      _cached { 0 };
+
+		/*
+		 * Noncopyable
+		 */
+		Block_pool(Block_pool const &);
+		Block_pool &operator = (Block_pool const &);
+
+	public:
+
+		Block_pool() { }
+
+		~Block_pool()
+		{
+			while (_free) {
+				Block *b = _free;
+				_free = b->next;
+				::free(b);
+			}
+		}
+
+		/**
+		 * Get block able to hold 'size' bytes
+		 *
+		 * \return  nullptr if memory is exhausted
+		 */
+		Block *alloc(size_t size)
+		{
+			{
+				Genode::Mutex::Guard guard(_mutex);
+
+				for (Block **b = &_free; *b; b = &(*b)->next) {
+					if ((*b)->capacity < size) continue;
+
+					Block *block = *b;
+					*b = block->next;
+					_cached--;
+
+					block->next = nullptr;
+					block->used = 0;
+					return block;
+				}
+			}
+
+			size_t const capacity = size < MIN_CAPACITY ? MIN_CAPACITY : size;
+			void *mem = ::malloc(sizeof(Block) + capacity);
+			if (!mem) return nullptr;
+
+			Block *block = reinterpret_cast<Block*>(mem);
+			block->next     = nullptr;
+			block->capacity = capacity;
+			block->used     = 0;
+			return block;
+		}
+
+		void release(Block *block)
+		{
+			if (!block) return;
+
+			{
+				Genode::Mutex::Guard guard(_mutex);
+
+				if (_cached < MAX_CACHED) {
+					block->next = _free;
+					_free = block;
+					_cached++;
+					return;
+				}
+			}
+			::free(block);
+		}
+};
+
+
+/**
+ * Cache of 'ssh_buffer' objects used for outgoing sftp packets
+ */
+class Ssh::Ssh_buffer_pool
+{
+	private:
+
+		static constexpr unsigned MAX_CACHED = 64;
+
+		Genode::Mutex _mutex  { };
+		ssh_buffer    _free[MAX_CACHED] { };
+		unsigned      _cached { 0 };
+
+		/*
+		 * Noncopyable
+		 */
+		Ssh_buffer_pool(Ssh_buffer_pool const &);
+		Ssh_buffer_pool &operator = (Ssh_buffer_pool const &);
+
+	public:
+
+		Ssh_buffer_pool() { }
+
+		~Ssh_buffer_pool()
+		{
+			while (_cached) ssh_buffer_free(_free[--_cached]);
+		}
+
+		ssh_buffer alloc()
+		{
+			{
+				Genode::Mutex::Guard guard(_mutex);
+				if (_cached) return _free[--_cached];
+			}
+			return ssh_buffer_new();
+		}
+
+		void release(ssh_buffer buffer)
+		{
+			if (!buffer) return;
+
+			/* keep the allocation, only reset the content */
+			if (ssh_buffer_reinit(buffer) == 0) {
+				Genode::Mutex::Guard guard(_mutex);
+				if (_cached < MAX_CACHED) {
+					_free[_cached++] = buffer;
+					return;
+				}
+			}
+			ssh_buffer_free(buffer);
+		}
+};
+
+#endif /* _SSH_TERMINAL_BUFFER_POOL_H_ */
@@ -22,6 +22,10 @@
 #include <base/heap.h>
 #include <base/registry.h>
 
+/* libc includes */
+#include <fcntl.h>
+#include <unistd.h>
+
 /* libssh includes */
 #include <libssh/libssh.h>
 
@@ -40,16 +44,214 @@ namespace Ssh {
 
 	using Terminal_name = String<64>;
 
+	struct Public_key;
+	struct Public_key_cache;
 	struct Login;
 	struct Login_registry;
+
+	/**
+	 * Return SHA256 fingerprint of key
+	 */
+	static inline Hash fingerprint(ssh_key key)
+	{
+		Hash result { };
+
+		unsigned char *h    = nullptr;
+		size_t         hlen = 0;
+		if (ssh_get_publickey_hash(key, SSH_PUBLICKEY_HASH_SHA256, &h, &hlen))
+			return result;
+
+		char const *p = ssh_get_fingerprint_hash(SSH_PUBLICKEY_HASH_SHA256,
+		                                         h, hlen);
+		if (p) {
+			result = Hash(p);
+		}
+
+		ssh_clean_pubkey_hash(&h);
+
+		/* abuse function to free fingerprint */
+		ssh_clean_pubkey_hash((unsigned char**)&p);
+
+		return result;
+	}
 }
 
 
+/**
+ * Public key parsed from a file
+ *
+ * Parsed keys are kept across config updates as long as the file content
+ * stays unchanged. The whole content is compared because neither the size
+ * nor the modification time reliably reveal a replaced key file.
+ */
+struct Ssh::Public_key : Genode::Registry<Ssh::Public_key>::Element
+{
+	enum { MAX_FILE_SIZE = 16*1024 };
+
+	Genode::Allocator &_alloc;
+
+	Filename const file;
+	size_t   const size;
+	char   * const content;
+
+	ssh_key   key  { nullptr };
+	Ssh::Hash hash { };
+
+	/* set while the key is referenced by a login */
+	bool used { true };
+
+	static bool _space(char c) { return c == ' ' || c == '\t'; }
+
+	/**
+	 * Parse key from the "<type> <base64> [comment]" line of the file
+	 */
+	void _import()
+	{
+		char *p = content;
+		while (_space(*p)) { p++; }
+
+		char const * const type = p;
+		while (*p && !_space(*p)) { p++; }
+		size_t const type_len = p - type;
+
+		while (_space(*p)) { p++; }
+
+		char * const b64 = p;
+		while (*p && !_space(*p) && *p != '\n' && *p != '\r') { p++; }
+
+		if (!type_len || p == b64) { return; }
+
+		/* terminate the base64 string temporarily */
+		char const end = *p;
+		*p = 0;
+
+		enum ssh_keytypes_e const key_type =
+			ssh_key_type_from_name(String<64>(Cstring(type, type_len)).string());
+
+		if (ssh_pki_import_pubkey_base64(b64, key_type, &key) != SSH_OK) {
+			key = nullptr;
+		}
+
+		*p = end;
+	}
+
+	Public_key(Genode::Registry<Public_key> &reg, Genode::Allocator &alloc,
+	           Filename const &file, char const *data, size_t size)
+	:
+		Element(reg, *this), _alloc(alloc), file(file), size(size),
+		content((char *)alloc.alloc(size + 1))
+	{
+		Genode::memcpy(content, data, size);
+		content[size] = 0;
+
+		_import();
+		if (key) { hash = fingerprint(key); }
+	}
+
+	~Public_key()
+	{
+		ssh_key_free(key);
+		_alloc.free(content, size + 1);
+	}
+
+	bool matches(Filename const &f, char const *data, size_t len) const {
+		return file == f && size == len && !Genode::memcmp(content, data, len); }
+};
+
+
+struct Ssh::Public_key_cache : Genode::Registry<Ssh::Public_key>
+{
+	Genode::Allocator &_alloc;
+
+	Public_key_cache(Genode::Allocator &alloc) : _alloc(alloc) { }
+
+	~Public_key_cache()
+	{
+		for_each([&] (Public_key &key) { Genode::destroy(&_alloc, &key); });
+	}
+
+	/**
+	 * Read file into 'buf'
+	 *
+	 * \return  number of bytes read or -1 on error or if the file is too
+	 *          large
+	 */
+	static ssize_t _read(Filename const &file, char *buf, size_t buf_size)
+	{
+		int const fd = open(file.string(), O_RDONLY);
+		if (fd < 0) { return -1; }
+
+		size_t len = 0;
+		for (;;) {
+			ssize_t const n = read(fd, buf + len, buf_size - len);
+			if (n <= 0) {
+				close(fd);
+				return (n < 0 || len == buf_size) ? -1 : (ssize_t)len;
+			}
+			len += n;
+		}
+	}
+
+	/**
+	 * Return parsed key of file, parse it on cache miss
+	 *
+	 * Files that do not contain a valid key are not cached.
+	 *
+	 * Must be called from libc context.
+	 */
+	Public_key const *lookup(Filename const &file)
+	{
+		Public_key *result = nullptr;
+
+		char *buf = nullptr;
+		try { buf = (char *)_alloc.alloc(Public_key::MAX_FILE_SIZE); }
+		catch (...) { return nullptr; }
+
+		ssize_t const len = _read(file, buf, Public_key::MAX_FILE_SIZE);
+
+		if (len > 0) {
+			for_each([&] (Public_key &key) {
+				if (!result && key.matches(file, buf, len)) { result = &key; } });
+
+			if (!result) {
+				try { result = new (&_alloc) Public_key(*this, _alloc, file, buf, len); }
+				catch (...) { }
+			}
+		}
+
+		_alloc.free(buf, Public_key::MAX_FILE_SIZE);
+
+		if (!result) { return nullptr; }
+
+		if (!result->key) {
+			Genode::destroy(&_alloc, result);
+			return nullptr;
+		}
+
+		result->used = true;
+		return result;
+	}
+
+	void mark_unused()
+	{
+		for_each([&] (Public_key &key) { key.used = false; });
+	}
+
+	void remove_unused()
+	{
+		for_each([&] (Public_key &key) {
+			if (!key.used) { Genode::destroy(&_alloc, &key); } });
+	}
+};
+
+
 struct Ssh::Login : Genode::Registry<Ssh::Login>::Element
 {
 	Ssh::User     user         { };
 	Ssh::Password password     { };
 	Ssh::Hash     pub_key_hash { };
+
+	/* owned by the 'Public_key_cache' */
 	ssh_key       pub_key      { nullptr };
 	bool allow_terminal        { false };
 	bool allow_sftp            { false };
@@ -58,13 +260,17 @@ struct Ssh::Login : Genode::Registry<Ssh::Login>::Element
 	bool multi_login           { false };
 	bool request_terminal      { false };
 
+	/* chaining within the lookup tables of the 'Login_registry' */
+	Login *next_by_user        { nullptr };
+	Login *next_by_key         { nullptr };
+
 	/**
 	 * Constructor
 	 */
 	Login(Genode::Registry<Login> &reg,
 	      Ssh::User      const &user,
 	      Ssh::Password  const &pw,
-	      Filename       const &pk_file,
+	      Public_key     const *pk,
 	      bool           const allow_terminal,
 	      bool           const allow_sftp,
 	      Ssh::Terminal_name const &term_name,
@@ -77,35 +283,13 @@ struct Ssh::Login : Genode::Registry<Ssh::Login>::Element
 		terminal_name(term_name),
 		multi_login(multi_login), request_terminal(request_terminal)
 	{
-		Libc::with_libc([&] {
-
-			if (pk_file.valid() &&
-			    ssh_pki_import_pubkey_file(pk_file.string(), &pub_key)) {
-				Genode::error("could not import public key for user '",
-				              user, "'");
-			}
-
-			if (pub_key) {
-				unsigned char *h    = nullptr;
-				size_t         hlen = 0;
-				/* pray and assume both calls never fail */
-				ssh_get_publickey_hash(pub_key, SSH_PUBLICKEY_HASH_SHA256,
-				                       &h, &hlen);
-				char const *p = ssh_get_fingerprint_hash(SSH_PUBLICKEY_HASH_SHA256,
-				                                         h, hlen);
-				if (p) {
-					pub_key_hash = Ssh::Hash(p);
-				}
-
-				ssh_clean_pubkey_hash(&h);
-
-				/* abuse function to free fingerprint */
-				ssh_clean_pubkey_hash((unsigned char**)&p);
-			}
-		}); /* Libc::with_libc */
+		if (pk) {
+			pub_key      = pk->key;
+			pub_key_hash = pk->hash;
+		}
 	}
 
-	virtual ~Login() { ssh_key_free(pub_key); }
+	virtual ~Login() { }
 
 	bool auth_password()  const { return password.valid(); }
 	bool auth_publickey() const { return pub_key != nullptr; }
@@ -124,6 +308,38 @@ struct Ssh::Login_registry : Genode::Registry<Ssh::Login>
 	Genode::Allocator   &_alloc;
 	Util::Pthread_mutex  _mutex { };
 
+	Public_key_cache     _keys  { _alloc };
+
+	/*
+	 * Hash tables for looking up logins by user name and by the
+	 * fingerprint of their public key
+	 */
+	enum { BUCKETS = 64 };
+
+	Login *_by_user[BUCKETS] { };
+	Login *_by_key[BUCKETS]  { };
+
+	static unsigned _bucket(char const *s)
+	{
+		/* FNV-1a */
+		unsigned h = 2166136261u;
+		for (; *s; s++) { h = (h ^ (unsigned char)*s) * 16777619u; }
+		return h % BUCKETS;
+	}
+
+	void _insert(Login &login)
+	{
+		unsigned const u = _bucket(login.user.string());
+		login.next_by_user = _by_user[u];
+		_by_user[u]        = &login;
+
+		if (!login.pub_key_hash.valid()) { return; }
+
+		unsigned const k = _bucket(login.pub_key_hash.string());
+		login.next_by_key = _by_key[k];
+		_by_key[k]        = &login;
+	}
+
 	/**
 	 * Import one login from node
 	 */
@@ -179,11 +395,21 @@ struct Ssh::Login_registry : Genode::Registry<Ssh::Login>
 			}
 		}
 
+		Public_key const *pk = nullptr;
+		if (pub.valid()) {
+			pk = _keys.lookup(pub);
+			if (!pk) {
+				Genode::error("could not import public key for user '",
+				              user, "'");
+			}
+		}
+
 		try {
-			new (&_alloc) Login(*this, user, pw, pub,
-			                    allow_term, allow_sftp,
-			                    terminal,
-			                    multi_login, req_term);
+			Login &login = *new (&_alloc) Login(*this, user, pw, pk,
+			                                    allow_term, allow_sftp,
+			                                    terminal,
+			                                    multi_login, req_term);
+			_insert(login);
 			return true;
 		} catch (...) { return false; }
 	}
@@ -193,6 +419,11 @@ struct Ssh::Login_registry : Genode::Registry<Ssh::Login>
 		for_each([&] (Login &login) {
 			Genode::destroy(&_alloc, &login);
 		});
+
+		for (unsigned i = 0; i < BUCKETS; i++) {
+			_by_user[i] = nullptr;
+			_by_key[i]  = nullptr;
+		}
 	}
 
 	/**
@@ -213,13 +444,18 @@ struct Ssh::Login_registry : Genode::Registry<Ssh::Login>
 	void import(Genode::Xml_node const &node)
 	{
 		_remove_all();
+		_keys.mark_unused();
 
-		try {
-			node.for_each_sub_node("login",
-			[&] (Genode::Xml_node const &login) {
-				_import_single(login, node);
-			});
-		} catch (...) { }
+		Libc::with_libc([&] {
+			try {
+				node.for_each_sub_node("login",
+				[&] (Genode::Xml_node const &login) {
+					_import_single(login, node);
+				});
+			} catch (...) { }
+
+			_keys.remove_unused();
+		});
 	}
 
 	/**
@@ -227,12 +463,23 @@ struct Ssh::Login_registry : Genode::Registry<Ssh::Login>
 	 */
 	Ssh::Login const *lookup(char const *user) const
 	{
-		Login const *p = nullptr;
-		auto lookup_user = [&] (Login const &login) {
-			if (login.user == user) { p = &login; }
-		};
-		for_each(lookup_user);
-		return p;
+		for (Login const *p = _by_user[_bucket(user)]; p; p = p->next_by_user)
+			if (p->user == user) { return p; }
+
+		return nullptr;
+	}
+
+	/**
+	 * Look up login of user by the fingerprint of its public key
+	 */
+	Ssh::Login const *lookup(char const *user, Ssh::Hash const &hash) const
+	{
+		if (!hash.valid()) { return nullptr; }
+
+		for (Login const *p = _by_key[_bucket(hash.string())]; p; p = p->next_by_key)
+			if (p->pub_key_hash == hash && p->user == user) { return p; }
+
+		return nullptr;
 	}
 };
 
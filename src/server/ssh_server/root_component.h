@@ -78,8 +78,13 @@ class Terminal::Root_component : public Genode::Root_component<Session_component
 					= policy.attribute_value("terminal_name", Ssh::Terminal_name());
 				if (!term_name.valid()) { throw -1; }
 
+				/* size of the I/O buffer and of the ring in each direction */
+				Genode::size_t const buffer_size = policy.attribute_value("buffer_size",
+					Genode::Number_of_bytes(Ssh::Terminal::DEFAULT_BUFFER_SIZE));
+
 				Session_component *s = nullptr;
-					s = new (md_alloc()) Session_component(_env, 4096, term_name);
+					s = new (md_alloc()) Session_component(_env, *md_alloc(),
+					                                       buffer_size, term_name);
 
 				try {
 					Libc::with_libc([&] () { _server.attach_terminal(*s); });
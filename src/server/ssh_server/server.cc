@@ -40,16 +40,48 @@ extern int session_auth_pubkey_cb(ssh_session, char const *, struct ssh_key_stru
 extern ssh_channel session_channel_open_request_cb(ssh_session, void *);
 
 /**
- * forward declaration of the write available callback.
+ * forward declaration of the write available callbacks.
  */
 static int write_avail_cb(socket_t fd, int revents, void *userdata);
+static int terminal_avail_cb(socket_t fd, int revents, void *userdata);
+
+
+Ssh::Event_loop::Event_loop(Server &server) : server(server)
+{
+	event = ssh_event_new();
+	if (!event) {
+		Genode::error("could not create event loop");
+		throw Server::Init_failed();
+	}
+
+	/* add pipe to wake up loop on late connecting terminal */
+	if (pipe(wake_fds) ||
+		ssh_event_add_fd(event,
+		                 wake_fds[0],
+		                 POLLIN,
+		                 write_avail_cb,
+		                 this) != SSH_OK ) {
+		Genode::error("Failed to create wakeup pipe");
+		throw Server::Init_failed();
+	}
+}
+
+
+Ssh::Event_loop::~Event_loop()
+{
+	close(wake_fds[0]);
+	close(wake_fds[1]);
+	ssh_event_free(event);
+}
 
 
 Ssh::Terminal_session::Terminal_session(Genode::Registry<Terminal_session> &reg,
                                         Ssh::Terminal &conn,
-                                        ssh_event event_loop)
+                                        ssh_event event_loop,
+                                        Wake_up_signaller &wake_up_signaller)
 :
-	Element(reg, *this), conn(conn), _event_loop(event_loop)
+	Element(reg, *this), conn(conn), _event_loop(event_loop),
+	_wake_up_signaller(wake_up_signaller)
 {
 	if (pipe(_fds)) {
 		Genode::error("Failed to create wakeup pipe");
@@ -66,7 +98,7 @@ void Ssh::Terminal_session::initialize_ssh_event_fds()
 	    ssh_event_add_fd(_event_loop,
 	                     _fds[0],
 	                     POLLIN,
-	                     write_avail_cb,
+	                     terminal_avail_cb,
 	                     this) != SSH_OK) {
 		Genode::error("Failed to initialize ssh event file descriptors");
 		throw -1;
@@ -117,7 +149,10 @@ Ssh::Server::Server(Genode::Env &env,
 			throw Init_failed();
 		}
 
-		_event_loop = ssh_event_new();
+		/* the listener and, if sessions are sharded, one loop per shard */
+		_num_loops = _session_loops > 1 ? _session_loops + 1 : 1;
+		for (unsigned i = 0; i < _num_loops; i++)
+			_loops[i] = new (&_heap) Event_loop(*this);
 
 		if (ssh_bind_listen(_ssh_bind) < 0) {
 			Genode::error("could not listen on port ", _port, ": ",
@@ -126,37 +161,31 @@ Ssh::Server::Server(Genode::Env &env,
 		}
 
 		/* add AFTER(!) ssh_bind_listen call */
-		if (ssh_event_add_bind(_event_loop, _ssh_bind) < 0) {
+		if (ssh_event_add_bind(_listener().event, _ssh_bind) < 0) {
 			Genode::error("unable to add server to event loop: ",
 			              ssh_get_error(_ssh_bind));
 			throw Init_failed();
 		}
 
-		/* add pipe to wake up loop on late connecting terminal */
-		if (pipe(_server_fds) ||
-			ssh_event_add_fd(_event_loop,
-			                 _server_fds[0],
-			                 POLLIN,
-			                 write_avail_cb,
-			                 this) != SSH_OK ) {
-			Genode::error("Failed to create wakeup pipe");
-			throw -1;
-		}
-
-		if (pthread_create(&_event_thread, nullptr, _server_loop, this)) {
-			Genode::error("could not create event thread");
-			throw Init_failed();
+		for (unsigned i = 0; i < _num_loops; i++) {
+			if (pthread_create(&_loops[i]->thread, nullptr, _server_loop,
+			                   _loops[i])) {
+				Genode::error("could not create event thread");
+				throw Init_failed();
+			}
 		}
 
 		Genode::log("Listen on port: ", _port);
+		if (_num_loops > 1)
+			Genode::log("Sessions served by ", _session_loops, " event loops");
 	}); /* Libc::with_libc */
 }
 
 
 Ssh::Server::~Server()
 {
-	close(_server_fds[0]);
-	close(_server_fds[1]);
+	for (unsigned i = 0; i < _num_loops; i++)
+		Genode::destroy(&_heap, _loops[i]);
 }
 
 
@@ -201,7 +230,7 @@ void Ssh::Server::_initialize_bind_callbacks()
 }
 
 
-void Ssh::Server::_cleanup_session(Session &s)
+void Ssh::Server::_cleanup_session(Event_loop &loop, Session &s)
 {
 	if (s.auth_sucessful) {
 		_log_logout(s);
@@ -210,7 +239,7 @@ void Ssh::Server::_cleanup_session(Session &s)
 	ssh_channel_free(s.channel);
 	s.channel = nullptr;
 
-	ssh_event_remove_session(_event_loop, s.session);
+	ssh_event_remove_session(loop.event, s.session);
 	ssh_disconnect(s.session);
 	ssh_free(s.session);
 	s.session = nullptr;
@@ -218,6 +247,7 @@ void Ssh::Server::_cleanup_session(Session &s)
 	if (s.terminal) {
 		s.terminal->detach_channel();
 	}
+	s.terminal_reader.destruct();
 
 	try {
 		if (s.terminal_requested) {
@@ -231,18 +261,20 @@ void Ssh::Server::_cleanup_session(Session &s)
 		Genode::warning("could not enable exit reporting");
 	}
 
+	__atomic_fetch_sub(&loop.load, 1, __ATOMIC_RELAXED);
+
 	Genode::destroy(&_heap, &s);
 }
 
 
-void Ssh::Server::_cleanup_sessions()
+void Ssh::Server::_cleanup_sessions(Event_loop &loop)
 {
 	auto cleanup = [&] (Session &s) {
 		if (!ssh_is_connected(s.session)) {
-			_cleanup_session(s);
+			_cleanup_session(loop, s);
 		}
 	};
-	_sessions.for_each(cleanup);
+	loop.sessions.for_each(cleanup);
 }
 
 
@@ -283,6 +315,13 @@ void Ssh::Server::_parse_config(Genode::Xml_node const &config)
 	_ecdsa_key   = config.attribute_value("ecdsa_key",   Filename());
 	_ed25519_key = config.attribute_value("ed25519_key", Filename());
 
+	_session_loops = config.attribute_value("event_loops", 1u);
+	if (_session_loops < 1)               { _session_loops = 1; }
+	if (_session_loops > MAX_EVENT_LOOPS) { _session_loops = MAX_EVENT_LOOPS; }
+
+	_sftp_workers = config.attribute_value("sftp_workers",
+	                                       (unsigned)Sftp::DEFAULT_WORKERS);
+
 	Genode::log("Allowed auth methods: ",
 	            _allow_password  ? "password "  : "",
 	            _allow_publickey ? "public-key" : "");
@@ -302,8 +341,8 @@ void Ssh::Server::_load_hostkey(Util::Filename const &file)
 
 void *Ssh::Server::_server_loop(void *arg)
 {
-	Ssh::Server *server = reinterpret_cast<Ssh::Server *>(arg);
-	server->loop();
+	Ssh::Event_loop &loop = *reinterpret_cast<Ssh::Event_loop *>(arg);
+	loop.server.loop(loop);
 	return nullptr;
 }
 
@@ -316,7 +355,7 @@ bool Ssh::Server::_allow_multi_login(ssh_session s, Login const &login)
 	auto lookup = [&] (Session const &s) {
 		if (s.user() == login.user) { found = true; }
 	};
-	_sessions.for_each(lookup);
+	_for_each_session(lookup);
 	return !found;
 }
 
@@ -355,8 +394,8 @@ void Ssh::Server::attach_terminal(Ssh::Terminal &conn)
 	Util::Pthread_mutex::Guard guard(_terminals.mutex());
 
 	try {
-		new (&_heap) Terminal_session(_terminals,
-		                              conn, _event_loop);
+		new (&_heap) Terminal_session(_terminals, conn, _listener().event,
+		                              _signaller);
 	} catch (...) {
 		Genode::error("could not attach Terminal ", conn.terminal_name());
 		throw -1;
@@ -374,9 +413,12 @@ void Ssh::Server::attach_terminal(Ssh::Terminal &conn)
 			attached = true;
 		}
 	};
-	_sessions.for_each(lookup);
+	for (unsigned i = 0; i < _num_loops; i++) {
+		Util::Pthread_mutex::Guard loop_guard(_loops[i]->mutex);
+		_loops[i]->sessions.for_each(lookup);
+	}
 
-	_wake_loop();
+	_wake_loops();
 }
 
 
@@ -398,17 +440,25 @@ void Ssh::Server::detach_terminal(Ssh::Terminal &conn)
 		return;
 	}
 
+	p->detached = true;
+
 	auto invalidate_terminal = [&] (Session &sess) {
 		if (sess.terminal != &conn) { return; }
 		sess.terminal_detached = true;
 
 		/* flush before destroying the terminal */
-		try { sess.terminal->send(sess.channel); }
-		catch (...) { }
+		if (sess.terminal_reader.constructed()) {
+			try { sess.terminal->send(sess.channel, *sess.terminal_reader); }
+			catch (...) { }
+			sess.terminal_reader.destruct();
+		}
 	};
-	_sessions.for_each(invalidate_terminal);
+	for (unsigned i = 0; i < _num_loops; i++) {
+		Util::Pthread_mutex::Guard loop_guard(_loops[i]->mutex);
+		_loops[i]->sessions.for_each(invalidate_terminal);
+	}
 
-	_wake_loop();
+	_wake_loops();
 }
 
 
@@ -441,7 +491,7 @@ Ssh::Session *Ssh::Server::lookup_session(ssh_session s)
 	auto lookup = [&] (Session &sess) {
 		if (sess.session == s) { p = &sess; }
 	};
-	_sessions.for_each(lookup);
+	_for_each_session(lookup);
 	return p;
 }
 
@@ -509,8 +559,31 @@ void Ssh::Server::incoming_connection(ssh_session s)
 	 * is taken during _session.for_each(...) and during a 'new' here,
 	 * which would lead to a deadlock.
 	 */
-	new (&_heap) Session(_env, _heap, _new_sessions, _signaller, s,
-	                     &_channel_cb, ++_session_id);
+	Event_loop &loop = _least_loaded_loop();
+
+	new (&_heap) Session(_env, _heap, loop.new_sessions, loop, s,
+	                     &_channel_cb, ++_session_id, _sftp_workers);
+
+	if (&loop != &_listener()) { loop.signal_wake_up(); }
+}
+
+
+Ssh::Event_loop &Ssh::Server::_least_loaded_loop()
+{
+	if (_num_loops == 1) {
+		__atomic_fetch_add(&_listener().load, 1, __ATOMIC_RELAXED);
+		return _listener();
+	}
+
+	Event_loop *result = _loops[1];
+	for (unsigned i = 2; i < _num_loops; i++) {
+		if (__atomic_load_n(&_loops[i]->load, __ATOMIC_RELAXED)
+		    < __atomic_load_n(&result->load, __ATOMIC_RELAXED))
+			result = _loops[i];
+	}
+
+	__atomic_fetch_add(&result->load, 1, __ATOMIC_RELAXED);
+	return *result;
 }
 
 
@@ -571,16 +644,15 @@ bool Ssh::Server::auth_pubkey(ssh_session s, char const *u,
 	Session &session = *p;
 
 	/*
-	 * In this first state the given pubkey is solely probed.
-	 * Ideally we would check here if the given pubkey is in fact to the
-	 * configured one, i.e., reading a 'authorized_keys' like file and
-	 * check its entries.
-	 *
-	 * For now we simple accept all keys and reject them in the later
-	 * state.
+	 * In this first state the given pubkey is solely probed. Only accept
+	 * keys configured for the user so that the client does not compute
+	 * signatures for keys we will reject anyway.
 	 */
 	if (signature_state == SSH_PUBLICKEY_STATE_NONE) {
-		return true;
+		Ssh::Hash const hash = Ssh::fingerprint(pubkey);
+
+		Util::Pthread_mutex::Guard guard(_logins.mutex());
+		return _logins.lookup(u, hash) != nullptr;
 	}
 
 	/*
@@ -606,50 +678,56 @@ bool Ssh::Server::auth_pubkey(ssh_session s, char const *u,
 }
 
 
-void Ssh::Server::loop()
+void Ssh::Server::_handle_terminals()
+{
+	Util::Pthread_mutex::Guard guard(_terminals.mutex());
+
+	/* finish pending initialization of terminal sessions */
+	auto initialize = [&] (Terminal_session &t) {
+		try {
+			if (t._state == Terminal_session::PIPE_INITIALIZED) {
+				t.initialize_ssh_event_fds();
+			}
+		} catch (...) {
+			/* Not sure what to do here - terminal is "almost" attached.
+			   Previously service was denied in that case but as
+			   descriptor handling must be performed in ssh loop thread
+			   it is too late for that. */
+		}
+	};
+	_terminals.for_each(initialize);
+
+	/* remove terminals detached by the front end */
+	auto cleanup = [&] (Terminal_session &t) {
+		if (t.detached) { Genode::destroy(&_heap, &t); }
+	};
+	_terminals.for_each(cleanup);
+}
+
+
+void Ssh::Server::loop(Event_loop &loop)
 {
 	while (true) {
 
-		ssh_event_set_dopoll_immediate(_event_loop, 0);
-		int const events = ssh_event_dopoll(_event_loop, -1);
-		ssh_event_set_dopoll_immediate(_event_loop, 1);
+		ssh_event_set_dopoll_immediate(loop.event, 0);
+		int const events = ssh_event_dopoll(loop.event, -1);
+		ssh_event_set_dopoll_immediate(loop.event, 1);
 
 		if (events == SSH_ERROR) {
-			_cleanup_sessions();
+			Util::Pthread_mutex::Guard guard(loop.mutex);
+			_cleanup_sessions(loop);
 		}
 
-		{
-			Util::Pthread_mutex::Guard guard(_terminals.mutex());
+		/* the terminal descriptors are polled by the listener */
+		if (&loop == &_listener()) { _handle_terminals(); }
 
-			/* finish pending initialization of terminal sessions */
-			auto initialize = [&] (Terminal_session &t) {
-				try {
-					if (t._state == Terminal_session::PIPE_INITIALIZED) {
-						t.initialize_ssh_event_fds();
-					}
-				} catch (...) {
-					/* Not sure what to do here - terminal is "almost" attached.
-					   Previously service was denied in that case but as
-					   descriptor handling must be performed in ssh loop thread
-					   it is too late for that. */
-				}
-			};
-			_terminals.for_each(initialize);
+		{
+			Util::Pthread_mutex::Guard guard(loop.mutex);
 
 			/* remove all stale sessions */
 			auto cleanup = [&] (Session &s) {
 				if (s.terminal_detached) {
-					Terminal_session *p = nullptr;
-					auto lookup = [&] (Terminal_session &t) {
-						if (&t.conn == s.terminal) {
-							p = &t;
-							s.terminal = nullptr;
-						}
-					};
-					_terminals.for_each(lookup);
-
-					if (p)
-						Genode::destroy(&_heap, p);
+					s.terminal = nullptr;
 				}
 
 				if ((s.sftp._state == Sftp::WORKER_FINISHED) ||
@@ -666,46 +744,46 @@ void Ssh::Server::loop()
 				/* perform check using ssh_blocking_flush with 0 timeout */
 				if (ssh_blocking_flush(s.session, 0) == SSH_AGAIN) { return; }
 
-				_cleanup_session(s);
+				_cleanup_session(loop, s);
 			};
-			_sessions.for_each(cleanup);
-
-			/* second reset all active terminals */
-			auto reset_pending = [&] (Terminal_session &t) {
-				if (!t.conn.attached_channels()) { return; }
-				t.conn.reset_pending();
-			};
-			_terminals.for_each(reset_pending);
+			loop.sessions.for_each(cleanup);
 
 			/*
-			 * third send data on all sessions being attached
+			 * second send data on all sessions being attached
 			 * to a terminal.
 			 */
 			auto send = [&] (Session &s) {
 				if (!s.terminal) { return; }
 
-				try { s.terminal->send(s.channel); }
-				catch (...) { _cleanup_session(s); }
+				if (!s.terminal_reader.constructed()) {
+					s.terminal_reader.construct(s.terminal->readers());
+				}
+
+				try { s.terminal->send(s.channel, *s.terminal_reader); }
+				catch (...) { _cleanup_session(loop, s); }
 			};
-			_sessions.for_each(send);
+			loop.sessions.for_each(send);
 
 			/*
-			 * fourth send pending sftp data on sessions with enabled sftp
-			 * subsystem
+			 * third resume held-back requests and send pending sftp data
+			 * on sessions with enabled sftp subsystem
 			 */
 			auto send_sftp = [&] (Session &s) {
 				if (s.sftp.uninitialized()) { return; }
 
-				try { s.sftp.send_queued_packets(s.channel); }
-				catch (...) { _cleanup_session(s); }
+				try {
+					s.sftp.resume_incoming_data(s.channel);
+					s.sftp.send_queued_packets(s.channel);
+				}
+				catch (...) { _cleanup_session(loop, s); }
 			};
-			_sessions.for_each(send_sftp);
+			loop.sessions.for_each(send_sftp);
 
-			/* fifth flush ssh sessions data */
+			/* fourth flush ssh sessions data */
 			auto flush_output = [&] (Session &s) {
 				ssh_blocking_flush(s.session, 0);
 			};
-			_sessions.for_each(flush_output);
+			loop.sessions.for_each(flush_output);
 		}
 
 		/* enable all new sessions that got added by ssh callbacks */
@@ -713,11 +791,12 @@ void Ssh::Server::loop()
 			/* re-queue session object */
 			new (&_heap) Session(_env,
 			                     _heap,
-			                     _sessions,
-			                     _signaller,
+			                     loop.sessions,
+			                     loop,
 			                     inactive_session.session,
 			                     inactive_session.channel_cb,
-			                     inactive_session.id());
+			                     inactive_session.id(),
+			                     _sftp_workers);
 
 			ssh_session s = inactive_session.session;
 
@@ -739,19 +818,26 @@ void Ssh::Server::loop()
 				Genode::warning("key exchange returned ", key_exchange_result);
 			}
 
-			ssh_event_add_session(_event_loop, s);
+			ssh_event_add_session(loop.event, s);
 		};
-		_new_sessions.for_each(activate);
+		loop.new_sessions.for_each(activate);
 
 	}
 }
 
 
-void Ssh::Server::_wake_loop()
+void Ssh::Server::_wake_loops()
 {
-	/* wake the event loop up */
-	char c = 1;
-	::write(_server_fds[1], &c, sizeof(c));
+	for (unsigned i = 0; i < _num_loops; i++)
+		_loops[i]->signal_wake_up();
+}
+
+
+void Ssh::Server::_wake_session_loops()
+{
+	/* the listener is awake already when handling terminal output */
+	for (unsigned i = 1; i < _num_loops; i++)
+		_loops[i]->signal_wake_up();
 }
 
 
@@ -760,3 +846,15 @@ static int write_avail_cb(socket_t fd, int revents, void *userdata)
 	char c;
 	return ::read(fd, &c, sizeof(char));
 }
+
+
+static int terminal_avail_cb(socket_t fd, int revents, void *userdata)
+{
+	Ssh::Terminal_session &t = *reinterpret_cast<Ssh::Terminal_session*>(userdata);
+
+	char c;
+	int const ret = ::read(fd, &c, sizeof(char));
+
+	t._wake_up_signaller.signal_wake_up();
+	return ret;
+}
@@ -21,6 +21,7 @@
 #include <base/log.h>
 #include <base/registry.h>
 #include <os/reporter.h>
+#include <util/reconstructible.h>
 
 /* libc includes */
 #include <poll.h>
@@ -44,6 +45,7 @@ namespace Ssh {
 
 	struct Server;
 	struct Session;
+	struct Event_loop;
 	struct Terminal_session;
 	struct Terminal_registry;
 }
@@ -66,6 +68,9 @@ struct Ssh::Session : Genode::Registry<Session>::Element
 	bool           terminal_detached { false };
 	bool           terminal_requested{ false };
 
+	/* send position within the terminal output */
+	Constructible<Ssh::Terminal::Reader> terminal_reader { };
+
 	Ssh::Sftp      sftp;
 
 	Session(Genode::Env &env,
@@ -74,9 +79,10 @@ struct Ssh::Session : Genode::Registry<Session>::Element
 	        Wake_up_signaller &wake_up_signaller,
 	        ssh_session s,
 	        ssh_channel_callbacks ccb,
-	        uint32_t id)
+	        uint32_t id,
+	        unsigned sftp_workers)
 	: Element(reg, *this), _heap(heap), _id(id), session(s), channel_cb(ccb),
-	  sftp(heap, wake_up_signaller)
+	  sftp(heap, wake_up_signaller, sftp_workers)
 	{
 		ssh_set_blocking(s, false);
 	}
@@ -99,21 +105,65 @@ struct Ssh::Session : Genode::Registry<Session>::Element
 };
 
 
+/**
+ * Thread running an 'ssh_event' loop
+ *
+ * The first loop accepts new connections and watches the attached
+ * terminals. Unless sessions are sharded across further loops (see
+ * 'event_loops' config attribute), it also serves all sessions.
+ */
+struct Ssh::Event_loop : Wake_up_signaller
+{
+	using Session_registry = Genode::Registry<Session>;
+
+	Server &server;
+
+	ssh_event event       { nullptr };
+	int       wake_fds[2] { -1, -1 };
+	pthread_t thread      { };
+
+	/* protects the sessions against the Terminal front end */
+	Util::Pthread_mutex mutex { };
+
+	Session_registry sessions     { };
+	Session_registry new_sessions { };
+
+	/* number of sessions assigned to the loop */
+	unsigned load { 0 };
+
+	Event_loop(Server &server);
+	~Event_loop();
+
+	void signal_wake_up() override
+	{
+		char c = 1;
+		::write(wake_fds[1], &c, sizeof(c));
+	}
+};
+
+
 struct Ssh::Terminal_session : Genode::Registry<Terminal_session>::Element
 {
 	Ssh::Terminal &conn;
 
 	ssh_event _event_loop;
 
+	/* wakes the loops serving the sessions on new terminal output */
+	Wake_up_signaller &_wake_up_signaller;
+
 	int _fds[2] { -1, -1 };
 
+	/* set by the front end, the listener loop destroys the object */
+	bool detached { false };
+
 	enum State { UNINITIALIZED,
 	             PIPE_INITIALIZED,
 	             SSH_INITIALIZED } _state = UNINITIALIZED;
 
 	Terminal_session(Genode::Registry<Terminal_session> &reg,
 	                 Ssh::Terminal &conn,
-	                 ssh_event event_loop);
+	                 ssh_event event_loop,
+	                 Wake_up_signaller &wake_up_signaller);
 
 	~Terminal_session()
 	{
@@ -152,6 +202,8 @@ class Ssh::Server
 
 		using Session_registry = Genode::Registry<Session>;
 
+		enum { MAX_EVENT_LOOPS = 8 };
+
 		Genode::Env   &_env;
 		Genode::Heap   _heap;
 
@@ -162,12 +214,12 @@ class Ssh::Server
 		int            _max_auth_attempts { 3 };
 		unsigned       _port              { 0u };
 		unsigned       _log_level         { 0u };
-		int            _server_fds[2]     { -1, -1 };
+		unsigned       _sftp_workers      { Sftp::DEFAULT_WORKERS };
+		unsigned       _session_loops     { 1u };
 
 		bool           _config_once { false };
 
 		ssh_bind       _ssh_bind;
-		ssh_event      _event_loop;
 
 		Util::Filename _rsa_key      { };
 		Util::Filename _ecdsa_key    { };
@@ -179,7 +231,15 @@ class Ssh::Server
 
 		Terminal_registry   _terminals { };
 		Login_registry     &_logins;
-		pthread_t           _event_thread;
+
+		/*
+		 * Loop 0 is the listener, sessions are served by loop 0 only or
+		 * sharded across the loops 1..'_session_loops'
+		 */
+		Event_loop         *_loops[MAX_EVENT_LOOPS + 1] { };
+		unsigned            _num_loops { 0 };
+
+		Event_loop &_listener() { return *_loops[0]; }
 
 		/*
 		 * Since we always pass ourself as userdata pointer, we may
@@ -189,16 +249,23 @@ class Ssh::Server
 		ssh_server_callbacks_struct  _session_cb { };
 		ssh_bind_callbacks_struct    _bind_cb    { };
 
-		Session_registry _sessions     { };
-		Session_registry _new_sessions { };
 		uint32_t         _session_id   { 0 };
 
+		template <typename FN>
+		void _for_each_session(FN const &fn)
+		{
+			for (unsigned i = 0; i < _num_loops; i++)
+				_loops[i]->sessions.for_each(fn);
+		}
+
 		void _initialize_channel_callbacks();
 		void _initialize_session_callbacks();
 		void _initialize_bind_callbacks();
-		void _cleanup_session(Session &s);
+		void _cleanup_session(Event_loop &loop, Session &s);
 
-		void _cleanup_sessions();
+		void _cleanup_sessions(Event_loop &loop);
+		void _handle_terminals();
+		Event_loop &_least_loaded_loop();
 		void _parse_config(Genode::Xml_node const &config);
 		void _load_hostkey(Util::Filename const &file);
 
@@ -218,7 +285,8 @@ class Ssh::Server
 		void _log_logout(Session const &s);
 		void _log_login(User const &user, Session const &s, bool pubkey);
 
-		void _wake_loop();
+		void _wake_loops();
+		void _wake_session_loops();
 
 	public:
 
@@ -228,7 +296,7 @@ class Ssh::Server
 
 		virtual ~Server();
 
-		void loop();
+		void loop(Event_loop &loop);
 
 		/***************************************************************
 		 ** Methods below are only used by Terminal session front end **
@@ -299,7 +367,7 @@ class Ssh::Server
 
 			void signal_wake_up() override
 			{
-				_server._wake_loop();
+				_server._wake_session_loops();
 			}
 		};
 		Signaller _signaller { *this };
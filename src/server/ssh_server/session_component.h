@@ -39,10 +39,11 @@ class Terminal::Session_component : public Genode::Rpc_object<Session, Session_c
 	public:
 
 		Session_component(Genode::Env &env,
+		                  Genode::Allocator &alloc,
 		                  Genode::size_t io_buffer_size,
 		                  Ssh::Terminal_name const &term_name)
 		:
-			Ssh::Terminal(term_name),
+			Ssh::Terminal(alloc, io_buffer_size, term_name),
 			_io_buffer(env.ram(), env.rm(), io_buffer_size)
 		{ }
 
@@ -20,6 +20,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <fcntl.h>
+#include <unistd.h>
 
 extern "C" {
 #include <libssh/buffer.h>
@@ -53,22 +54,29 @@ void Genode::print(Output &out, Ssh::Sftp::State state)
 
 void * Ssh::Sftp::sftp_worker_loop(void *arg)
 {
-	Ssh::Sftp &server = *reinterpret_cast<Ssh::Sftp*>(arg);
+	Worker    &worker = *reinterpret_cast<Worker*>(arg);
+	Ssh::Sftp &server = *worker.sftp;
 
 	bool signal_sent = false;
 	while (true) {
-		sftp_client_message msg = server._client_requests.get();
+		Request request = worker.requests.get();
 
-		/* made some place in _client_requests so signal about it */
+		/* made some place in the request queue so signal about it */
 		if (!signal_sent) {
 			signal_sent = true;
 			server._wake_up_signaller.signal_wake_up();
 		}
 
 		/* exit loop if empty message found */
-		if (msg == NULL) break;
+		if (request.msg == NULL) break;
 
-		server.process_message(msg);
+		server.process_message(request);
+	}
+
+	/* the last worker leaving finishes the subsystem */
+	{
+		Genode::Mutex::Guard guard(server._workers_mutex);
+		if (--server._workers_running > 0) return 0;
 	}
 
 	ssh_channel_request_send_exit_status(server._sftp_server->channel, 0);
@@ -96,13 +104,22 @@ void Ssh::Sftp::cleanup()
 		[[fallthrough]];
 	case WORKER_FINISHED:
 	case WORKER_CLOSING:
+		/* responses cannot be sent anymore, release blocked workers */
 		{
-			auto const ret = pthread_join(_worker_thread, nullptr);
+			Genode::Mutex::Guard guard(_pending_mutex);
+			_pending_discard = true;
+		}
+		for (unsigned i = 0; i < _workers_started; i++)
+			_pending_slots.up();
+
+		for (unsigned i = 0; i < _workers_started; i++) {
+			auto const ret = pthread_join(_workers[i].thread, nullptr);
 			if (0 != ret) {
 				Genode::warning("pthread_joined returned with ", ret,
 				                " (errno=", errno, ")");
 			}
 		}
+		_workers_started = 0;
 		[[fallthrough]];
 	case CREATE_ERROR:
 		sftp_server_free(_sftp_server);
@@ -117,9 +134,23 @@ void Ssh::Sftp::cleanup()
 	};
 	_handles.for_each(destroy_handle);
 
-	while (!_client_requests.empty()) {
-		sftp_client_message_free(_client_requests.get());
+	for (Worker &worker : _workers) {
+		while (!worker.requests.empty()) {
+			Request request = worker.requests.get();
+			sftp_client_message_free(request.msg);
+			_block_pool.release(request.block);
+		}
+	}
+
+	if (_stalled_worker) {
+		sftp_client_message_free(_stalled_request.msg);
+		_block_pool.release(_stalled_request.block);
+		_stalled_worker = nullptr;
 	}
+	_resume_pos = _resume_len = _held_back = 0;
+
+	_block_pool.release(_write_block);
+	_write_block = nullptr;
 
 	while (!_pending_packets.empty()) {
 		ssh_buffer_free(_pending_packets.get());
@@ -185,9 +216,34 @@ void Ssh::Sftp::initialize_subsystem(ssh_session session, ssh_channel channel,
 
 	_user = user;
 
-	int const ret = pthread_create(&_worker_thread, nullptr,
-	                               Ssh::Sftp::sftp_worker_loop, (void*) this);
-	if (ret == -1) {
+	for (unsigned i = 0; i < _num_workers; i++) {
+		{
+			Genode::Mutex::Guard guard(_workers_mutex);
+			_workers_running++;
+		}
+
+		_workers[i].sftp = this;
+
+		int const ret = pthread_create(&_workers[i].thread, nullptr,
+		                               Ssh::Sftp::sftp_worker_loop,
+		                               (void*) &_workers[i]);
+		if (ret == 0) {
+			_workers_started++;
+			continue;
+		}
+
+		{
+			Genode::Mutex::Guard guard(_workers_mutex);
+			_workers_running--;
+		}
+
+		/* a partial pool is still usable */
+		if (_workers_started > 0) {
+			Genode::warning("sftp: only ", _workers_started, " of ",
+			                _num_workers, " workers started");
+			break;
+		}
+
 		Genode::error("sftp: pthread_create failed");
 		set_state(CREATE_ERROR);
 		return;
@@ -198,6 +254,87 @@ void Ssh::Sftp::initialize_subsystem(ssh_session session, ssh_channel channel,
 
 
 int Ssh::Sftp::incoming_sftp_data(void *data, uint32_t len)
+{
+	/* data held back earlier precedes the new data */
+	int const resumed = _resume_input();
+	if (resumed < 0) return -1;
+	if (resumed == 0) {
+		_held_back = len;
+		return 0;
+	}
+
+	int const consumed = _consume_sftp_data(data, len);
+	if (consumed < 0) return -1;
+
+	_held_back = len - consumed;
+	return consumed;
+}
+
+
+/**
+ * Continue with the requests held back by a full request queue
+ *
+ * \return  1 if no data is held back anymore, 0 if the request queue
+ *          is still full, or -1 on a protocol error
+ */
+int Ssh::Sftp::_resume_input()
+{
+	if (_stalled_worker) {
+		/* keep the last slot for the termination message */
+		if (_stalled_worker->requests.avail_capacity() <= 1) return 0;
+
+		_stalled_worker->requests.add(_stalled_request);
+		_stalled_worker = nullptr;
+	}
+
+	while (_resume_pos < _resume_len) {
+		int const consumed = _consume_sftp_data(_resume_buf + _resume_pos,
+		                                        _resume_len - _resume_pos);
+		if (consumed < 0) return -1;
+
+		_resume_pos += consumed;
+		if (_stalled_worker) return 0;
+	}
+	return 1;
+}
+
+
+void Ssh::Sftp::resume_incoming_data(ssh_channel channel)
+{
+	if (_state != INITIALIZED) return;
+	if (!channel || !ssh_channel_is_open(channel)) return;
+
+	while (true) {
+		int const resumed = _resume_input();
+		if (resumed < 0) {
+			Genode::error("sftp: malformed request");
+			handle_eof();
+			return;
+		}
+		if (resumed == 0 || _held_back == 0) return;
+
+		/*
+		 * Fetch the data held back by libssh. Reading no more than it
+		 * buffers never processes further packets of the session, which
+		 * would invoke the channel callbacks from within the event loop.
+		 */
+		uint32_t const count = _held_back < RESUME_BUF_SIZE ? _held_back
+		                                                    : RESUME_BUF_SIZE;
+		int const n = ssh_channel_read_nonblocking(channel, _resume_buf,
+		                                           count, 0);
+		if (n <= 0) {
+			_held_back = 0;
+			return;
+		}
+
+		_held_back -= n;
+		_resume_pos = 0;
+		_resume_len = n;
+	}
+}
+
+
+int Ssh::Sftp::_consume_sftp_data(void *data, uint32_t len)
 {
 	uint8_t  *data_ptr = reinterpret_cast<uint8_t*>(data);
 	uint32_t  avail    = len;
@@ -235,6 +372,25 @@ int Ssh::Sftp::incoming_sftp_data(void *data, uint32_t len)
 				Genode::error("incoming_sftp_data: ",
 				              "ignoring packet in CREATE_ERROR state");
 				sftp_packet_read(_sftp_server);
+			} else if (_write_block) {
+				Block &block = *_write_block;
+				_write_block = nullptr;
+
+				Request request { };
+				if (parse_write_request(block, request)) {
+					_packet_state = INITIAL;
+					enqueue_request(request);
+				} else {
+					/* let libssh deal with the malformed request */
+					rc = ssh_buffer_add_data(_sftp_server->read_packet->payload,
+					                         block.data(), block.used);
+					_block_pool.release(&block);
+					if (rc != 0) {
+						return -1;
+					}
+					sftp_client_message msg = sftp_get_client_message(_sftp_server);
+					enqueue_sftp_client_message(msg);
+				}
 			} else {
 				sftp_client_message msg = sftp_get_client_message(_sftp_server);
 				enqueue_sftp_client_message(msg);
@@ -243,7 +399,7 @@ int Ssh::Sftp::incoming_sftp_data(void *data, uint32_t len)
 			assert(_packet_state == INITIAL);
 		}
 
-	} while (avail > 0 && _packet_state == INITIAL);
+	} while (avail > 0 && _packet_state == INITIAL && !_stalled_worker);
 
 	return len - avail;
 }
@@ -251,7 +407,10 @@ int Ssh::Sftp::incoming_sftp_data(void *data, uint32_t len)
 void Ssh::Sftp::handle_eof()
 {
 	set_state(WORKER_CLOSING);
-	enqueue_sftp_client_message(0);
+
+	/* every worker terminates on its own empty message */
+	for (unsigned i = 0; i < _workers_started; i++)
+		_workers[i].requests.add(Request { });
 }
 
 /* CHECK */
@@ -271,6 +430,13 @@ static uint32_t sftp_get_u32(const void *vp)
     return v;
 }
 
+static uint64_t sftp_get_u64(const void *vp)
+{
+    const uint8_t *p = (const uint8_t *)vp;
+
+    return ((uint64_t)sftp_get_u32(p) << 32) | sftp_get_u32(p + 4);
+}
+
 int Ssh::Sftp::assemble_sftp_packet(void *data, uint32_t len)
 {
 	uint8_t  *data_ptr = reinterpret_cast<uint8_t*>(data);
@@ -313,7 +479,13 @@ int Ssh::Sftp::assemble_sftp_packet(void *data, uint32_t len)
 		[[fallthrough]];
 
 	case PAYLOAD_INITED:
-		/* read packet size */
+		/* read packet size in place if the header is not split */
+		if (size_filled == 0 && avail >= SIZE_BUFFER_SIZE) {
+			::memcpy(size_buffer, data_ptr, SIZE_BUFFER_SIZE);
+			size_filled = SIZE_BUFFER_SIZE;
+			data_ptr   += SIZE_BUFFER_SIZE;
+			avail      -= SIZE_BUFFER_SIZE;
+		}
 		while (size_filled < SIZE_BUFFER_SIZE && avail > 0) {
 			size_buffer[size_filled] = *data_ptr;
 			++size_filled;
@@ -351,11 +523,20 @@ int Ssh::Sftp::assemble_sftp_packet(void *data, uint32_t len)
 		[[fallthrough]];
 
 	case TYPE_READ:
-		rc = ssh_buffer_allocate_size(packet->payload, packet_size_left);
-		if (rc < 0) {
-			Genode::log("Ssh::Sftp::assemble_sftp_packet: buffer allocate failed: ",
-			            packet_size_left);
-			return -1;
+		/*
+		 * WRITE payloads are collected in a pooled block and handed to the
+		 * workers as is, bypassing the copies into libssh buffers
+		 */
+		if (packet->type == SSH_FXP_WRITE && _state == INITIALIZED)
+			_write_block = _block_pool.alloc(packet_size_left);
+
+		if (!_write_block) {
+			rc = ssh_buffer_allocate_size(packet->payload, packet_size_left);
+			if (rc < 0) {
+				Genode::log("Ssh::Sftp::assemble_sftp_packet: buffer allocate failed: ",
+				            packet_size_left);
+				return -1;
+			}
 		}
 
 		_packet_state = PAYLOAD_ALLOCATED;
@@ -363,7 +544,13 @@ int Ssh::Sftp::assemble_sftp_packet(void *data, uint32_t len)
 
 	case PAYLOAD_ALLOCATED:
 		data_len = (packet_size_left <= avail ? packet_size_left : avail);
-		rc = ssh_buffer_add_data(packet->payload, data_ptr, data_len);
+		if (_write_block) {
+			::memcpy(_write_block->data() + _write_block->used, data_ptr, data_len);
+			_write_block->used += data_len;
+			rc = 0;
+		} else {
+			rc = ssh_buffer_add_data(packet->payload, data_ptr, data_len);
+		}
 		if (rc != 0) {
 			Genode::log("Ssh::Sftp::assemble_sftp_packet: buffer add data failed: ",
 			            data_len);
@@ -400,15 +587,29 @@ sftp_packet Ssh::Sftp::consume_sftp_packet()
 
 int Ssh::Sftp::enqueue_sftp_packet(ssh_buffer payload)
 {
-	ssh_buffer buf = ssh_buffer_new();
+	/* wait until the event loop made room for the response */
+	_pending_slots.down();
+
+	ssh_buffer buf = _ssh_buffer_pool.alloc();
 	if (buf == nullptr) {
+		_pending_slots.up();
 		return SSH_ERROR;
 	}
 
 	/* cannot just take buffer as it is released by caller */
 	ssh_buffer_swap(payload, buf);
 
-	_pending_packets.add(buf);
+	{
+		Genode::Mutex::Guard guard(_pending_mutex);
+
+		if (_pending_discard) {
+			_ssh_buffer_pool.release(buf);
+			_pending_slots.up();
+			return SSH_ERROR;
+		}
+
+		_pending_packets.add(buf);
+	}
 
 	_wake_up_signaller.signal_wake_up();
 
@@ -421,51 +622,165 @@ void Ssh::Sftp::send_queued_packets(ssh_channel channel)
 	if (!channel || !ssh_channel_is_open(channel)) { return; }
 
 	bool signal_sent = false;
+	auto take_pending = [&] () {
+		ssh_buffer payload = _pending_packets.get();
+		_pending_slots.up();
+
+		/* made some place in _pending_packets so signal about it */
+		if (!signal_sent) {
+			signal_sent = true;
+			_wake_up_signaller.signal_wake_up();
+		}
+		return payload;
+	};
+
+	auto send_error = [&] () {
+		Genode::error("ERROR sending sftp data");
+		ssh_buffer_free(_output_payload);
+		_output_payload = nullptr;
+		_output_pos     = 0;
+		if (_state == CREATED || _state == INITIALIZED) {
+			/* simulate end of communcation */
+			handle_eof();
+		}
+	};
+
 	while (_output_payload != nullptr || !_pending_packets.empty()) {
-		ssh_buffer payload = nullptr;
-		uint32_t pos = 0;
-		if (_output_payload != nullptr) {
-			payload = _output_payload;
-			pos = _output_pos;
-			_output_payload = nullptr;
-		} else {
-			payload = _pending_packets.get();
 
-			/* made some place in _pending_packets so signal about it */
-			if (!signal_sent) {
-				signal_sent = true;
-				_wake_up_signaller.signal_wake_up();
-			}
+		if (_output_payload == nullptr) {
+			_output_payload = take_pending();
+			_output_pos     = 0;
 		}
-		void const *data   = ssh_buffer_get(payload);
-		uint32_t const len = ssh_buffer_get_len(payload);
 
-		int const num_bytes = ssh_channel_write(channel, (char*) data + pos,
-		                                        len - pos);
+		/*
+		 * Append further queued responses so that pipelined replies leave
+		 * in as few channel writes as possible
+		 */
+		while (!_pending_packets.empty()
+		       && ssh_buffer_get_len(_output_payload) - _output_pos < COALESCE_MAX) {
 
-		if (num_bytes < 0) {
-			Genode::error("ERROR sending sftp data");
-			ssh_buffer_free(payload);
-			if (_state == CREATED || _state == INITIALIZED) {
-				/* simulate end of communcation */
-				handle_eof();
+			ssh_buffer payload = take_pending();
+			int const rc = ssh_buffer_add_data(_output_payload,
+			                                   ssh_buffer_get(payload),
+			                                   ssh_buffer_get_len(payload));
+			_ssh_buffer_pool.release(payload);
+
+			if (rc != 0) {
+				send_error();
+				return;
 			}
-			return;
 		}
 
-		if ((size_t)num_bytes < len - pos) {
-			_output_payload = payload;
-			_output_pos = pos + num_bytes;
+		char const *data   = (char const*) ssh_buffer_get(_output_payload);
+		uint32_t const len = ssh_buffer_get_len(_output_payload);
+
+		int const num_bytes = ssh_channel_write(channel, data + _output_pos,
+		                                        len - _output_pos);
+
+		if (num_bytes < 0) {
+			send_error();
 			return;
 		}
 
-		ssh_buffer_free(payload);
+		_output_pos += num_bytes;
+
+		/* channel window exhausted, continue on next round */
+		if (_output_pos < len) { return; }
+
+		_ssh_buffer_pool.release(_output_payload);
+		_output_payload = nullptr;
+		_output_pos     = 0;
 	}
 }
 
 void Ssh::Sftp::enqueue_sftp_client_message(sftp_client_message msg)
 {
-	_client_requests.add(msg);
+	enqueue_request(Request { msg, nullptr, nullptr, 0 });
+}
+
+
+Ssh::Sftp::Worker &Ssh::Sftp::_worker_for(sftp_client_message msg)
+{
+	unsigned char const *key = nullptr;
+	size_t               len = 0;
+
+	if (msg->handle != nullptr) {
+		key = (unsigned char const *)ssh_string_data(msg->handle);
+		len = ssh_string_len(msg->handle);
+	} else if (msg->filename != nullptr) {
+		key = (unsigned char const *)msg->filename;
+		len = ::strlen(msg->filename);
+	}
+
+	/* FNV-1a */
+	unsigned h = 2166136261u;
+	for (size_t i = 0; i < len; i++) { h = (h ^ key[i]) * 16777619u; }
+
+	return _workers[_workers_started ? h % _workers_started : 0];
+}
+
+
+void Ssh::Sftp::enqueue_request(Request const &request)
+{
+	/* an empty message would terminate the worker */
+	if (request.msg == nullptr) {
+		Genode::error("sftp: dropping unparsable request");
+		_block_pool.release(request.block);
+		return;
+	}
+
+	Worker &worker = _worker_for(request.msg);
+
+	/* keep the last slot for the termination message */
+	if (worker.requests.avail_capacity() > 1) {
+		worker.requests.add(request);
+		return;
+	}
+
+	/* stop reading from the channel until the worker made room */
+	_stalled_request = request;
+	_stalled_worker  = &worker;
+}
+
+
+bool Ssh::Sftp::parse_write_request(Block &block, Request &request)
+{
+	/* id, handle string, offset, data string */
+	uint8_t const *p    = block.data();
+	size_t         left = block.used;
+
+	if (left < 8) return false;
+	uint32_t const id         = sftp_get_u32(p);
+	uint32_t const handle_len = sftp_get_u32(p + 4);
+	p += 8; left -= 8;
+
+	if (left < (size_t)handle_len + 12) return false;
+	uint8_t const *handle = p;
+	p += handle_len; left -= handle_len;
+
+	uint64_t const offset   = sftp_get_u64(p);
+	uint32_t const data_len = sftp_get_u32(p + 8);
+	p += 12; left -= 12;
+
+	if (left < data_len) return false;
+
+	sftp_client_message msg = reinterpret_cast<sftp_client_message>
+		(calloc(1, sizeof(struct sftp_client_message_struct)));
+	if (msg == nullptr) return false;
+
+	msg->sftp   = _sftp_server;
+	msg->type   = SSH_FXP_WRITE;
+	msg->id     = id;
+	msg->offset = offset;
+	msg->handle = ssh_string_new(handle_len);
+	if (msg->handle == nullptr
+	    || ssh_string_fill(msg->handle, handle, handle_len) != 0) {
+		sftp_client_message_free(msg);
+		return false;
+	}
+
+	request = Request { msg, &block, p, data_len };
+	return true;
 }
 
 
@@ -484,18 +799,83 @@ int Ssh::Sftp::Handle::close_dir()
 
 int Ssh::Sftp::Handle::close_file()
 {
-	if (_file == nullptr) return -1;
+	if (_fd < 0) return -1;
 
-	int result = fclose(_file);
+	int result = close(_fd);
 	if (result != 0) {
 		Genode::error("close_file(): failed to close file");
 	}
-	_file = nullptr;
+	_fd = -1;
 
 	return result;
 }
 
 
+Ssh::Sftp::Handle *Ssh::Sftp::_acquire_handle(sftp_client_message msg,
+                                              Handle::Type type,
+                                              char const *op)
+{
+	enum { VALID, INVALID, WRONG_TYPE } result = INVALID;
+
+	Handle *handle = nullptr;
+	{
+		Genode::Mutex::Guard guard(_handle_mutex);
+
+		handle = reinterpret_cast<Handle*>(sftp_handle(_sftp_server,
+		                                               msg->handle));
+		if (handle != nullptr && !handle->_closed) {
+			if (handle->_type == type) {
+				handle->_refs++;
+				result = VALID;
+			} else {
+				result = WRONG_TYPE;
+			}
+		}
+	}
+
+	switch (result) {
+	case VALID:
+		return handle;
+	case INVALID:
+		Genode::error(op, "(): received invalid handle");
+		if (sftp_reply_status(msg, SSH_FX_INVALID_HANDLE, "invalid handle") != 0) {
+			Genode::error(op, "(): failed to reply invalid handle status");
+		}
+		break;
+	case WRONG_TYPE:
+		Genode::error(op, "(): wrong handle type");
+		if (sftp_reply_status(msg, SSH_FX_BAD_MESSAGE, "wrong handle type") != 0) {
+			Genode::error(op, "(): failed to reply wrong handle type status");
+		}
+		break;
+	}
+	return nullptr;
+}
+
+
+void Ssh::Sftp::_release_handle(Handle &handle)
+{
+	Genode::Blockade *close_waiter = nullptr;
+	{
+		Genode::Mutex::Guard guard(_handle_mutex);
+		handle._refs--;
+		if (handle._closed && handle._refs == 0)
+			close_waiter = handle._close_waiter;
+	}
+
+	/* handle was closed while we were still using it, resume the CLOSE */
+	if (close_waiter)
+		close_waiter->wakeup();
+}
+
+
+ssh_string Ssh::Sftp::_alloc_handle(Handle &handle)
+{
+	Genode::Mutex::Guard guard(_handle_mutex);
+	return sftp_handle_alloc(_sftp_server, &handle);
+}
+
+
 int Ssh::Sftp::reply_errno_status(sftp_client_message msg)
 {
 	const int MAX_STRERROR = 1024;
@@ -586,8 +966,10 @@ int Ssh::Sftp::get_fs_entry_info(const char* path, Stat_mode mode,
 }
 
 
-void Ssh::Sftp::process_message(sftp_client_message msg)
+void Ssh::Sftp::process_message(Request &request)
 {
+	sftp_client_message msg = request.msg;
+
 	switch(msg->type){
 	case SFTP_REALPATH:
 		Genode::log("received realpath: ", (const char*) msg->filename);
@@ -609,21 +991,17 @@ void Ssh::Sftp::process_message(sftp_client_message msg)
 		Genode::log("received open: ", (const char*) msg->filename);
 		process_open(msg);
 		break;
+	/* do not log requests on the data path */
 	case SFTP_READDIR:
-		Genode::log("received readdir");
 		process_readdir(msg);
 		break;
 	case SFTP_READ:
-		Genode::log("received read: offset=", msg->offset, ", len=", msg->len);
 		process_read(msg);
 		break;
 	case SFTP_WRITE:
-		Genode::log("received write: offset=", msg->offset, ", len=",
-		            ssh_string_len(msg->data));
-		process_write(msg);
+		process_write(request);
 		break;
 	case SFTP_CLOSE:
-		Genode::log("received close");
 		process_close(msg);
 		break;
 	case SFTP_REMOVE:
@@ -650,6 +1028,7 @@ void Ssh::Sftp::process_message(sftp_client_message msg)
 		sftp_reply_status(msg, SSH_FX_OP_UNSUPPORTED, "Unsupported message");
 	}
 	sftp_client_message_free(msg);
+	_block_pool.release(request.block);
 }
 
 bool Ssh::Sftp::process_realpath(sftp_client_message msg, Realpath_mode mode,
@@ -729,7 +1108,7 @@ void Ssh::Sftp::process_opendir(sftp_client_message msg)
 	}
 
 	Handle* handle = new (&_heap) Handle(dir, msg->filename, is_root, _handles);
-	ssh_string sftp_handle = sftp_handle_alloc(_sftp_server, handle);
+	ssh_string sftp_handle = _alloc_handle(*handle);
 	if (sftp_handle == nullptr) {
 		Genode::error("process_opendir(): failed to allocate handle");
 		return;
@@ -758,6 +1137,10 @@ void Ssh::Sftp::process_open(sftp_client_message msg)
 	mode_t mode = (msg->flags & SSH_FILEXFER_ATTR_PERMISSIONS
 	               ? msg->attr->permissions : 0);
 
+	/*
+	 * The file is accessed by positional I/O only so that concurrent
+	 * requests on the same handle do not share a file offset
+	 */
 	int fd = open(msg->filename, flags, mode);
 	if (fd < 0) {
 		if (reply_errno_status(msg) != 0) {
@@ -766,24 +1149,8 @@ void Ssh::Sftp::process_open(sftp_client_message msg)
 		return;
 	}
 
-	const char* fd_mode;
-	if (msg->flags & SSH_FXF_CREAT && msg->flags & SSH_FXF_APPEND)
-		fd_mode = (readwrite ? "a+" : "a");
-	else if (msg->flags & SSH_FXF_CREAT && msg->flags & SSH_FXF_TRUNC)
-		fd_mode = (readwrite ? "w+" : "w");
-	else
-		fd_mode = (readwrite ? "r+" : "r");
-
-	FILE* file = fdopen(fd, fd_mode);
-	if (file == nullptr) {
-		if (reply_errno_status(msg) != 0) {
-			Genode::error("process_open(): failed to reply errno status");
-		}
-		return;
-	}
-
-	Handle* handle = new (&_heap) Handle(file, msg->filename, _handles);
-	ssh_string sftp_handle = sftp_handle_alloc(_sftp_server, handle);
+	Handle* handle = new (&_heap) Handle(fd, msg->filename, _handles);
+	ssh_string sftp_handle = _alloc_handle(*handle);
 	if (sftp_handle == nullptr) {
 		Genode::error("process_open(): failed to allocate handle");
 		return;
@@ -796,24 +1163,11 @@ void Ssh::Sftp::process_open(sftp_client_message msg)
 
 void Ssh::Sftp::process_readdir(sftp_client_message msg)
 {
-	Handle* handle = reinterpret_cast<Handle*>(sftp_handle(_sftp_server,
-	                                                       msg->handle));
-	if (handle == nullptr) {
-		Genode::error("process_readdir(): received invalid handle");
-		if (sftp_reply_status(msg, SSH_FX_INVALID_HANDLE, "invalid handle") != 0) {
-			Genode::error("process_readdir(): ",
-			              "failed to reply invalid handle status");
-		}
-		return;
-	}
-	if (handle->_type != Handle::HDIR) {
-		Genode::error("process_readdir(): wrong handle type");
-		if (sftp_reply_status(msg, SSH_FX_BAD_MESSAGE, "wrong handle type") != 0) {
-			Genode::error("process_readdir(): ",
-			              "failed to reply wrong handle type status");
-		}
-		return;
-	}
+	Handle* handle = _acquire_handle(msg, Handle::HDIR, "process_readdir");
+	if (handle == nullptr) return;
+
+	Handle_guard handle_guard { *this, *handle };
+	Genode::Mutex::Guard dir_guard(handle->_mutex);
 
 	/* process directory entries */
 	bool entry_found = false;
@@ -886,33 +1240,12 @@ void Ssh::Sftp::process_readdir(sftp_client_message msg)
 
 void Ssh::Sftp::process_read(sftp_client_message msg)
 {
-	Handle* handle = reinterpret_cast<Handle*>(sftp_handle(_sftp_server,
-	                                                       msg->handle));
-	if (handle == nullptr) {
-		Genode::error("process_read(): received invalid handle");
-		if (sftp_reply_status(msg, SSH_FX_INVALID_HANDLE, "invalid handle") != 0) {
-			Genode::error("process_read(): failed to reply invalid handle status");
-		}
-		return;
-	}
-	if (handle->_type != Handle::HFILE) {
-		Genode::error("process_read(): wrong handle type");
-		if (sftp_reply_status(msg, SSH_FX_BAD_MESSAGE, "wrong handle type") != 0) {
-			Genode::error("process_read(): ",
-			              "failed to reply wrong handle type status");
-		}
-		return;
-	}
+	Handle* handle = _acquire_handle(msg, Handle::HFILE, "process_read");
+	if (handle == nullptr) return;
 
-	if (fseeko(handle->_file, msg->offset, SEEK_SET) != 0) {
-		if (reply_errno_status(msg) != 0) {
-			Genode::error("process_read(): failed to reply errno status");
-		}
-		return;
-	}
+	Handle_guard handle_guard { *this, *handle };
 
-	constexpr int max_len = 2<<15; /* 32k */
-	uint32_t len = (msg->len > max_len ? max_len : msg->len);
+	uint32_t len = (msg->len > READ_MAX ? READ_MAX : msg->len);
 	void* data = malloc(len);
 	if (data == nullptr) {
 		if (sftp_reply_status(msg, SSH_FX_FAILURE,
@@ -924,61 +1257,53 @@ void Ssh::Sftp::process_read(sftp_client_message msg)
 	}
 	Free_guard data_guard(data);
 
-	size_t read_len = fread(data, 1, len, handle->_file);
-	Genode::log("process_read(): read ", read_len, " bytes");
-	if (read_len == 0) {
-		if (feof(handle->_file)) {
-			if (sftp_reply_status(msg, SSH_FX_EOF, nullptr) != 0) {
-				Genode::error("process_read(): failed to reply eof");
-			}
-			return;
-		}
+	ssize_t const read_len = pread(handle->_fd, data, len, msg->offset);
+	if (read_len < 0) {
 		if (reply_errno_status(msg) != 0) {
 			Genode::error("process_read(): failed to reply errno status");
 		}
 		return;
 	}
+	if (read_len == 0) {
+		if (sftp_reply_status(msg, SSH_FX_EOF, nullptr) != 0) {
+			Genode::error("process_read(): failed to reply eof");
+		}
+		return;
+	}
 
 	if (sftp_reply_data(msg, data, read_len) != 0) {
 		Genode::error("process_read(): failed to reply data");
 	}
 }
 
-void Ssh::Sftp::process_write(sftp_client_message msg)
+void Ssh::Sftp::process_write(Request const &request)
 {
-	Handle* handle = reinterpret_cast<Handle*>(sftp_handle(_sftp_server,
-	                                                       msg->handle));
-	if (handle == nullptr) {
-		Genode::error("process_write(): received invalid handle");
-		if (sftp_reply_status(msg, SSH_FX_INVALID_HANDLE, "invalid handle") != 0) {
-			Genode::error("process_write(): failed to reply invalid handle status");
-		}
-		return;
-	}
-	if (handle->_type != Handle::HFILE) {
-		Genode::error("process_write(): wrong handle type");
-		if (sftp_reply_status(msg, SSH_FX_BAD_MESSAGE, "wrong handle type") != 0) {
-			Genode::error("process_write(): ",
-			              "failed to reply wrong handle type status");
-		}
-		return;
-	}
+	sftp_client_message msg = request.msg;
 
-	if (fseeko(handle->_file, msg->offset, SEEK_SET) != 0) {
-		if (reply_errno_status(msg) != 0) {
-			Genode::error("process_write(): failed to reply errno status");
-		}
-		return;
-	}
+	Handle* handle = _acquire_handle(msg, Handle::HFILE, "process_write");
+	if (handle == nullptr) return;
 
-	size_t data_len = ssh_string_len(msg->data);
-	size_t write_len = fwrite(ssh_string_data(msg->data), 1, data_len,
-	                          handle->_file);
-	if (write_len != data_len) {
-		if (reply_errno_status(msg) != 0) {
-			Genode::error("process_write(): failed to reply errno status");
+	Handle_guard handle_guard { *this, *handle };
+
+	/* write straight from the received packet if it was parsed in place */
+	uint8_t const *data = request.block ? request.data
+	                                    : (uint8_t const*) ssh_string_data(msg->data);
+	size_t         left = request.block ? request.len
+	                                    : ssh_string_len(msg->data);
+	off_t          pos  = msg->offset;
+
+	while (left > 0) {
+		ssize_t const write_len = pwrite(handle->_fd, data, left, pos);
+		if (write_len < 0 && errno == EINTR) continue;
+		if (write_len <= 0) {
+			if (reply_errno_status(msg) != 0) {
+				Genode::error("process_write(): failed to reply errno status");
+			}
+			return;
 		}
-		return;
+		data += write_len;
+		left -= write_len;
+		pos  += write_len;
 	}
 
 	if (sftp_reply_status(msg, SSH_FX_OK, nullptr) != 0) {
@@ -999,8 +1324,25 @@ class Destroyer {
 
 void Ssh::Sftp::process_close(sftp_client_message msg)
 {
-	Handle* handle = reinterpret_cast<Handle*>(sftp_handle(_sftp_server,
-	                                                       msg->handle));
+	Handle*          handle = nullptr;
+	bool             in_use = false;
+	Genode::Blockade released { };
+	{
+		Genode::Mutex::Guard guard(_handle_mutex);
+
+		handle = reinterpret_cast<Handle*>(sftp_handle(_sftp_server,
+		                                               msg->handle));
+		if (handle != nullptr && !handle->_closed) {
+			sftp_handle_remove(_sftp_server, msg->handle);
+			handle->_closed = true;
+			in_use = handle->_refs > 0;
+			if (in_use)
+				handle->_close_waiter = &released;
+		} else {
+			handle = nullptr;
+		}
+	}
+
 	if (handle == nullptr) {
 		Genode::error("process_close(): received invalid handle");
 		if (sftp_reply_status(msg, SSH_FX_INVALID_HANDLE, "invalid handle") != 0) {
@@ -1009,7 +1351,14 @@ void Ssh::Sftp::process_close(sftp_client_message msg)
 		return;
 	}
 
-	sftp_handle_remove(_sftp_server, msg->handle);
+	/*
+	 * Requests on the handle are processed by this worker and finished
+	 * already. Still, the status of the file must not be reported before
+	 * the last outstanding request on the handle completed.
+	 */
+	if (in_use)
+		released.block();
+
 	Destroyer handle_destroyer(&_heap, handle);
 
 	if (handle->_type == Handle::HDIR
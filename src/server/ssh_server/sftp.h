@@ -16,9 +16,11 @@
 #define _SSH_TERMINAL_SFTP_H_
 
 /* Genode includes */
+#include <base/blockade.h>
 #include <base/capability.h>
 #include <base/log.h>
 #include <base/mutex.h>
+#include <base/semaphore.h>
 #include <base/signal.h>
 #include <base/thread.h>
 #include <os/ring_buffer.h>
@@ -36,6 +38,7 @@
 #include <stdlib.h>
 
 /* local includes */
+#include "buffer_pool.h"
 #include "login.h"
 #include "wake_up_signaller.h"
 
@@ -57,7 +60,17 @@ class Ssh::Sftp
 	  Wake_up_signaller  &_wake_up_signaller;
 		Ssh::User           _user               { };
 		sftp_session        _sftp_server        { nullptr };
-		pthread_t           _worker_thread      { 0 };
+
+		/*
+		 * Requests are processed by a pool of workers so that a client
+		 * may keep many READ/WRITE requests in flight
+		 */
+		static constexpr unsigned MAX_WORKERS = 8;
+
+		unsigned            _num_workers;
+		unsigned            _workers_started    { 0 };
+		unsigned            _workers_running    { 0 };
+		Genode::Mutex       _workers_mutex      { };
 
 		/* currently assembled packet state */
 		enum Packet_state { INITIAL,
@@ -73,11 +86,85 @@ class Ssh::Sftp
 
 		uint32_t packet_size_left;
 
-		static constexpr int CLIENT_REQUESTS_MAX = 128;
-		Ring_buffer<sftp_client_message, CLIENT_REQUESTS_MAX> _client_requests;
+		/* payload of a WRITE request assembled outside of libssh */
+		Block   *_write_block { nullptr };
+
+		Block_pool      _block_pool      { };
+		Ssh_buffer_pool _ssh_buffer_pool { };
+
+		/*
+		 * Client request as processed by the workers
+		 *
+		 * For WRITE requests parsed in place, 'block' holds the packet and
+		 * 'data'/'len' refer to the data to be written.
+		 */
+		struct Request
+		{
+			sftp_client_message  msg;
+			Block               *block;
+			uint8_t const       *data;
+			size_t               len;
+		};
+
+		/*
+		 * OpenSSH clients keep up to 64 requests outstanding, leave room
+		 * for the termination message of the worker
+		 */
+		static constexpr int CLIENT_REQUESTS_MAX = 256;
+
+		/*
+		 * Each worker has its own request queue. All requests on one
+		 * handle or path go to the same worker and are thereby processed
+		 * in the order of their arrival, as required by the protocol for
+		 * requests on the same file.
+		 */
+		struct Worker
+		{
+			Sftp      *sftp   { nullptr };
+			pthread_t  thread { };
+
+			Ring_buffer<Request, CLIENT_REQUESTS_MAX> requests { };
+		};
 
-		static constexpr int PENDING_PACKETS_MAX = 128;
+		Worker _workers[MAX_WORKERS] { };
+
+		Worker &_worker_for(sftp_client_message msg);
+
+		/*
+		 * Reading from the channel stops while the request queue of the
+		 * target worker is full. The request is held back together with
+		 * the channel data that follows it, the remainder stays buffered
+		 * by libssh.
+		 */
+		static constexpr uint32_t RESUME_BUF_SIZE = 16*1024;
+
+		Request   _stalled_request { };
+		Worker   *_stalled_worker  { nullptr };
+		uint8_t   _resume_buf[RESUME_BUF_SIZE];
+		uint32_t  _resume_pos      { 0 };
+		uint32_t  _resume_len      { 0 };
+		uint32_t  _held_back       { 0 };    /* bytes left to libssh */
+
+		int _consume_sftp_data(void *data, uint32_t len);
+		int _resume_input();
+
+		/*
+		 * Responses of all workers are sent by the event loop. The ring
+		 * buffer supports a single producer only, hence the workers add
+		 * their responses under '_pending_mutex'. A worker blocks on
+		 * '_pending_slots' while the ring is full.
+		 */
+		static constexpr int PENDING_PACKETS_MAX = 256;
 		Ring_buffer<ssh_buffer, PENDING_PACKETS_MAX> _pending_packets;
+		Genode::Mutex     _pending_mutex   { };
+		Genode::Semaphore _pending_slots   { PENDING_PACKETS_MAX - 1 };
+		bool              _pending_discard { false };
+
+		/* responses are coalesced into one channel write up to this size */
+		static constexpr uint32_t COALESCE_MAX = 256*1024;
+
+		/* OpenSSH rejects messages larger than 256 KiB */
+		static constexpr uint32_t READ_MAX = 255*1024;
 
 		ssh_buffer _output_payload;
 		uint32_t   _output_pos;
@@ -95,8 +182,13 @@ class Ssh::Sftp
 		             CREATE_ERROR,
 		             CLEAN } _state = UNINITIALIZED;
 
-		Sftp(Genode::Heap &heap, Wake_up_signaller &wake_up_signaller)
+		static constexpr unsigned DEFAULT_WORKERS = 4;
+
+		Sftp(Genode::Heap &heap, Wake_up_signaller &wake_up_signaller,
+		     unsigned workers = DEFAULT_WORKERS)
 			: _heap(heap), _wake_up_signaller(wake_up_signaller),
+			  _num_workers(workers < 1 ? 1 : workers > MAX_WORKERS ? MAX_WORKERS
+			                                                      : workers),
 			  _output_payload(nullptr), _output_pos(0) {}
 		~Sftp();
 
@@ -113,11 +205,14 @@ class Ssh::Sftp
 
 
 		int incoming_sftp_data(void *data, uint32_t len);
+		void resume_incoming_data(ssh_channel channel);
 		void handle_eof();
 
 		int assemble_sftp_packet(void *data, uint32_t len);
 		sftp_packet consume_sftp_packet();
 		void enqueue_sftp_client_message(sftp_client_message msg);
+		void enqueue_request(Request const &request);
+		bool parse_write_request(Block &block, Request &request);
 
 		int enqueue_sftp_packet(ssh_buffer payload);
 		void send_queued_packets(ssh_channel channel);
@@ -126,11 +221,21 @@ class Ssh::Sftp
 		struct Handle	: Genode::Registry<Handle>::Element
 		{
 			enum Type { HDIR, HFILE } _type;
-			char*                     _name = nullptr;
-			DIR*                      _dir  = nullptr;
-			FILE*                     _file = nullptr;
-			bool                      _eof  = false;
-			bool                      _root = false;
+			char*                     _name   = nullptr;
+			DIR*                      _dir    = nullptr;
+			int                       _fd     = -1;
+			bool                      _eof    = false;
+			bool                      _root   = false;
+
+			/* protected by '_handle_mutex' */
+			unsigned                  _refs   = 0;
+			bool                      _closed = false;
+
+			/* CLOSE waiting for the release of the last reference */
+			Genode::Blockade         *_close_waiter = nullptr;
+
+			/* serializes directory reads */
+			Genode::Mutex             _mutex { };
 
 			Handle(DIR* dir, const char* name, bool root,
 			       Genode::Registry<Handle> &reg)
@@ -139,8 +244,8 @@ class Ssh::Sftp
 				_name = strdup(name);
 			}
 
-			Handle(FILE* file, const char* name, Genode::Registry<Handle> &reg)
-				: Element(reg, *this), _type(HFILE), _file(file)
+			Handle(int fd, const char* name, Genode::Registry<Handle> &reg)
+				: Element(reg, *this), _type(HFILE), _fd(fd)
 			{
 				_name = strdup(name);
 			}
@@ -158,6 +263,23 @@ class Ssh::Sftp
 		using Handle_registry = Genode::Registry<Handle>;
 		Handle_registry _handles;
 
+		/* protects the libssh handle table and handle references */
+		Genode::Mutex   _handle_mutex { };
+
+		Handle *_acquire_handle(sftp_client_message msg, Handle::Type type,
+		                        char const *op);
+		void    _release_handle(Handle &handle);
+
+		struct Handle_guard
+		{
+			Sftp   &sftp;
+			Handle &handle;
+
+			~Handle_guard() { sftp._release_handle(handle); }
+		};
+
+		ssh_string _alloc_handle(Handle &handle);
+
 		int reply_errno_status(sftp_client_message msg);
 
 		enum Stat_mode { STAT, LSTAT };
@@ -166,7 +288,7 @@ class Ssh::Sftp
 		                      const char* name = nullptr,
 		                      char* longname = nullptr);
 
-		void process_message(sftp_client_message msg);
+		void process_message(Request &request);
 
 		enum Realpath_mode { VALIDATE, VALIDATE_DIR, PROCESS };
 		bool process_realpath(sftp_client_message msg, Realpath_mode mode,
@@ -175,7 +297,7 @@ class Ssh::Sftp
 		void process_open(sftp_client_message msg);
 		void process_readdir(sftp_client_message msg);
 		void process_read(sftp_client_message msg);
-		void process_write(sftp_client_message msg);
+		void process_write(Request const &request);
 		void process_close(sftp_client_message msg);
 		void process_stat(sftp_client_message msg, Stat_mode mode);
 		void process_remove(sftp_client_message msg);
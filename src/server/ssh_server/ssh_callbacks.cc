@@ -64,21 +64,25 @@ int channel_data_cb(ssh_session session, ssh_channel channel,
 	}
 
 	Ssh::Terminal &conn              { *p->terminal };
-	Util::Pthread_mutex::Guard guard { conn.read_buf.mutex() };
+	Util::Pthread_mutex::Guard guard { conn.receive_mutex() };
 	char const    *src               { reinterpret_cast<char const*>(data) };
 	size_t         num_bytes         { 0 };
 
-	while ((conn.read_buf.write_avail() > 0) && (num_bytes < len)) {
+	/* replace ^? with ^H and let's hope we do not break anything */
+	enum { DEL = 0x7f, BS = 0x08, };
+	static char const bs = BS;
 
-		char c = src[num_bytes];
+	while (num_bytes < len) {
 
-		/* replace ^? with ^H and let's hope we do not break anything */
-		enum { DEL = 0x7f, BS = 0x08, };
-		if (c == DEL) {
-			conn.read_buf.append(BS);
-		} else {
-			conn.read_buf.append(c);
-		}
+		char const *chunk = src + num_bytes;
+		char const *del   = (char const*)memchr(chunk, DEL, len - num_bytes);
+		size_t const n    = del ? (size_t)(del - chunk) : len - num_bytes;
+
+		size_t const written = conn.read_ring.write(chunk, n);
+		num_bytes += written;
+
+		if (written < n || !del) { break; }
+		if (!conn.read_ring.write(&bs, 1)) { break; }
 
 		num_bytes++;
 	}
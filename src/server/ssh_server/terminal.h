@@ -22,6 +22,7 @@
 #include <base/signal.h>
 #include <session/session.h>
 #include <base/log.h>
+#include <base/registry.h>
 #include <terminal_session/terminal_session.h>
 
 /* local includes */
@@ -38,16 +39,23 @@ namespace Ssh
 
 class Ssh::Terminal
 {
-	private:
+	public:
+
+		/**
+		 * Send position of one SSH channel attached to the terminal
+		 */
+		struct Reader : Genode::Registry<Reader>::Element
+		{
+			Genode::uint64_t sent { 0 };
 
-		typedef Util::Buffer<4096u> Buffer;
+			Reader(Genode::Registry<Reader> &registry)
+			: Genode::Registry<Reader>::Element(registry, *this) { }
+		};
 
-		Mutex   _write_buf_swap    { };
+	private:
 
-		Buffer  _write_buf_a       { };
-		Buffer  _write_buf_b       { };
-		Buffer *_write_buf_ep      { &_write_buf_a };
-		Buffer *_write_buf_pthread { &_write_buf_b };
+		/* filled by the EP, drained by the SSH event loop */
+		Util::Ring _write_ring;
 
 		::Terminal::Session::Size _size { 0, 0 };
 
@@ -57,29 +65,71 @@ class Ssh::Terminal
 
 		Ssh::Terminal_name const _term_name { };
 
-		unsigned _attached_channels { 0u };
-		unsigned _pending_channels  { 0u };
+		/*
+		 * Channels are attached and detached by the event loops and the
+		 * EP concurrently
+		 */
+		unsigned            _attached_channels { 0u };
+		Util::Pthread_mutex _channels_mutex    { };
+
+		/*
+		 * Channels of one terminal may be served by different event
+		 * loops, which serialize on sending
+		 */
+		Genode::Registry<Reader> _readers       { };
+		Util::Pthread_mutex      _send_mutex    { };
+		Util::Pthread_mutex      _receive_mutex { };
 
 	public:
 
-		Buffer read_buf { };
+		enum { DEFAULT_BUFFER_SIZE = 16*1024 };
+
+		/* filled by the SSH event loop, drained by the EP */
+		Util::Ring read_ring;
 
 		int write_avail_fd { -1 };
 
 		/**
 		 * Constructor
+		 *
+		 * \param alloc        allocator used for the I/O rings
+		 * \param buffer_size  size of the ring in each direction
 		 */
-		Terminal(Terminal_name const &term_name) : _term_name(term_name) { }
+		Terminal(Genode::Allocator &alloc, size_t buffer_size,
+		         Terminal_name const &term_name)
+		:
+			_write_ring(alloc, buffer_size), _term_name(term_name),
+			read_ring(alloc, buffer_size)
+		{ }
 
 		virtual ~Terminal() = default;
 
 		Ssh::Terminal_name const &terminal_name() const { return _term_name; }
 
-		unsigned attached_channels() const { return _attached_channels; }
+		unsigned attached_channels()
+		{
+			Util::Pthread_mutex::Guard guard(_channels_mutex);
+			return _attached_channels;
+		}
+
+		void attach_channel()
+		{
+			Util::Pthread_mutex::Guard guard(_channels_mutex);
+			++_attached_channels;
+		}
+
+		void detach_channel()
+		{
+			Util::Pthread_mutex::Guard guard(_channels_mutex);
+			--_attached_channels;
+		}
+
+		Genode::Registry<Reader> &readers() { return _readers; }
 
-		void attach_channel() { ++_attached_channels; }
-		void detach_channel() { --_attached_channels; }
-		void reset_pending()  { _pending_channels = 0; }
+		/**
+		 * Mutex serializing the producers of 'read_ring'
+		 */
+		Util::Pthread_mutex &receive_mutex() { return _receive_mutex; }
 
 		/*********************************
 		 ** Terminal::Session interface **
@@ -99,7 +149,7 @@ class Ssh::Terminal
 		{
 			_connected_sigh = sigh;
 
-			if (_attached_channels > 0) {
+			if (attached_channels() > 0) {
 				notify_connected();
 			}
 		}
@@ -162,41 +212,47 @@ class Ssh::Terminal
 
 		/**
 		 * Send internal write buffer content to SSH channel
+		 *
+		 * \param reader  send position of the channel, updated on return
+		 *
+		 * Partially written content remains in the ring and is sent on
+		 * the next invocation. It gets released once all readers received
+		 * it.
 		 */
-		void send(ssh_channel channel)
+		void send(ssh_channel channel, Reader &reader)
 		{
-			{
-				/* swap write buffers if current is empty */
-				Mutex::Guard guard(_write_buf_swap);
-
-				if (!_write_buf_pthread->read_avail()) {
-					auto buffer_tmp    = _write_buf_ep;
-					_write_buf_ep      = _write_buf_pthread;
-					_write_buf_pthread = buffer_tmp;
-				}
-			}
+			Util::Pthread_mutex::Guard guard(_send_mutex);
+
+			Genode::uint64_t &sent = reader.sent;
 
-			/* write buffer for pthread is used w/o mutex, it's not used by EP */
-			Buffer &write_buf = *_write_buf_pthread;
+			if (sent < _write_ring.tail()) { sent = _write_ring.tail(); }
 
-			if (!write_buf.read_avail()) { return; }
+			/* closed channels do not hold back the others */
+			if (!channel || !ssh_channel_is_open(channel)) {
+				sent = _write_ring.head();
+			}
 
-			/* ignore send request */
-			if (!channel || !ssh_channel_is_open(channel)) { return; }
+			int num_bytes = 0;
+			char const *src = nullptr;
+			while (size_t const len = _write_ring.content(sent, src)) {
 
-			char const *src     = write_buf.content();
-			size_t const len    = write_buf.read_avail();
-			/* XXX we do not handle partial writes */
-			int const num_bytes = ssh_channel_write(channel, src, len);
+				num_bytes = ssh_channel_write(channel, src, len);
+				if (num_bytes < 0) { break; }
 
-			if (num_bytes && (size_t)num_bytes < len) {
-				warning("send on channel was truncated");
-			}
+				sent += num_bytes;
 
-			if (++_pending_channels >= _attached_channels) {
-				write_buf.reset();
+				/* channel window exhausted */
+				if ((size_t)num_bytes < len) { break; }
 			}
 
+			/* release content received by all readers */
+			Genode::uint64_t min_sent = sent;
+			_readers.for_each([&] (Reader const &r) {
+				Genode::uint64_t const pos = Genode::max(r.sent, _write_ring.tail());
+				min_sent = Genode::min(min_sent, pos);
+			});
+			_write_ring.consume_to(min_sent);
+
 			/* at this point the client might have disconnected */
 			if (num_bytes < 0) { throw -1; }
 		}
@@ -210,18 +266,11 @@ class Ssh::Terminal
 		 */
 		size_t read(char *dst, size_t dst_len)
 		{
-			Util::Pthread_mutex::Guard guard(read_buf.mutex());
-
-			size_t const num_bytes = min(dst_len, read_buf.read_avail());
-			Genode::memcpy(dst, read_buf.content(), num_bytes);
-			read_buf.consume(num_bytes);
+			size_t const num_bytes = read_ring.read(dst, dst_len);
 
 			/* notify client if there are still bytes available for reading */
-			if (!read_buf.read_avail()) { read_buf.reset(); }
-			else {
-				if (_read_avail_sigh.valid()) {
-					Signal_transmitter(_read_avail_sigh).submit();
-				}
+			if (read_ring.read_avail() && _read_avail_sigh.valid()) {
+				Signal_transmitter(_read_avail_sigh).submit();
 			}
 
 			return num_bytes;
@@ -234,25 +283,22 @@ class Ssh::Terminal
 		{
 			size_t num_bytes = 0;
 
-			{
-				Mutex::Guard guard(_write_buf_swap);
-
-				Buffer &write_buf = *_write_buf_ep;
-
-				size_t i = 0;
+			/* append line by line and expand '\n' to '\r\n' */
+			while (num_bytes < src_len) {
 
-				while (write_buf.write_avail() > 0 && i < src_len) {
+				char const *line = src + num_bytes;
+				char const *nl   = (char const *)::memchr(line, '\n',
+				                                          src_len - num_bytes);
+				size_t const len = nl ? (size_t)(nl - line) : src_len - num_bytes;
 
-					char c = src[i];
-					if (c == '\n') {
-						write_buf.append('\r');
-					}
+				size_t const written = _write_ring.write(line, len);
+				num_bytes += written;
 
-					write_buf.append(c);
-					num_bytes++;
+				if (written < len || !nl) { break; }
+				if (_write_ring.write_avail() < 2) { break; }
 
-					i++;
-				}
+				_write_ring.write("\r\n", 2);
+				num_bytes++;
 			}
 
 			/* wake the event loop up */
@@ -267,17 +313,7 @@ class Ssh::Terminal
 		/**
 		 * Return true if the internal read buffer is ready to receive data
 		 */
-		bool read_buffer_empty()
-		{
-			bool empty = true;
-
-			Libc::with_libc([&] {
-				Util::Pthread_mutex::Guard guard(read_buf.mutex());
-				empty = !read_buf.read_avail();
-			});
-
-			return empty;
-		}
+		bool read_buffer_empty() const { return !read_ring.read_avail(); }
 };
 
 #endif  /* _SSH_TERMINAL_TERMINAL_H_ */
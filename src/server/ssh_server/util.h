@@ -17,11 +17,13 @@
 #define _SSH_TERMINAL_UTIL_H_
 
 /* Genode includes */
+#include <base/allocator.h>
 #include <util/string.h>
 #include <libc/component.h>
 
 /* libc includes */
 #include <pthread.h>
+#include <string.h>
 #include <unistd.h>
 #include <time.h>
 
@@ -30,8 +32,7 @@ namespace Util
 {
 	using Filename = Genode::String<256>;
 
-	template <size_t C>
-	struct Buffer;
+	class Ring;
 
 	/*
 	 * get the current time from the libc backend.
@@ -74,23 +75,133 @@ struct Util::Pthread_mutex
 };
 
 
-template <size_t C>
-struct Util::Buffer
+/**
+ * Lock-free single-producer/single-consumer byte ring
+ *
+ * Positions are absolute stream offsets, which allows the consumer to
+ * hand out the same content to several readers that progress at their
+ * own pace (see 'Ssh::Terminal::send').
+ */
+class Util::Ring
 {
-	Util::Pthread_mutex _mutex   { };
-	char                _data[C] { };
-	size_t              _head    { 0 };
-	size_t              _tail    { 0 };
+	public:
+
+		using uint64_t = Genode::uint64_t;
+		using size_t   = Genode::size_t;
+
+	private:
+
+		Genode::Allocator &_alloc;
+
+		size_t const _size;
+		size_t const _mask { _size - 1 };
+		char * const _data;
+
+		/* written by the producer only */
+		uint64_t _head { 0 };
+
+		/* written by the consumer only */
+		uint64_t _tail { 0 };
+
+		static size_t _power_of_two(size_t size)
+		{
+			size_t result = 4096;
+			while (result < size) result <<= 1;
+			return result;
+		}
+
+		/*
+		 * Noncopyable
+		 */
+		Ring(Ring const &);
+		Ring &operator = (Ring const &);
+
+	public:
+
+		Ring(Genode::Allocator &alloc, size_t size)
+		:
+			_alloc(alloc), _size(_power_of_two(size)),
+			_data((char *)_alloc.alloc(_size))
+		{ }
+
+		~Ring() { _alloc.free(_data, _size); }
+
+		size_t size() const { return _size; }
+
+		uint64_t head() const { return __atomic_load_n(&_head, __ATOMIC_ACQUIRE); }
+		uint64_t tail() const { return __atomic_load_n(&_tail, __ATOMIC_ACQUIRE); }
+
+		size_t read_avail()  const { return (size_t)(head() - tail()); }
+		size_t write_avail() const { return _size - read_avail(); }
+
+		/**
+		 * Append up to 'len' bytes, called by the producer
+		 *
+		 * \return  number of bytes appended
+		 */
+		size_t write(char const *src, size_t len)
+		{
+			uint64_t const head = _head;
+
+			size_t const num    = Genode::min(len, _size - (size_t)(head - tail()));
+			size_t const offset = head & _mask;
+			size_t const first  = Genode::min(num, _size - offset);
+
+			::memcpy(_data + offset, src, first);
+			::memcpy(_data, src + first, num - first);
+
+			__atomic_store_n(&_head, head + num, __ATOMIC_RELEASE);
+			return num;
+		}
+
+		/**
+		 * Return contiguous content starting at stream position 'pos',
+		 * called by the consumer
+		 *
+		 * \return  number of bytes available at 'ptr'
+		 */
+		size_t content(uint64_t pos, char const *&ptr) const
+		{
+			uint64_t const head = this->head();
 
-	size_t read_avail()   const { return _head > _tail ? _head - _tail : 0; }
-	size_t write_avail()  const { return _head <= C ? C - _head : 0; }
-	char const *content() const { return &_data[_tail]; }
+			if (pos < _tail) pos = _tail;
+			if (pos >= head) return 0;
 
-	void append(char c)    { _data[_head++] = c; }
-	void consume(size_t n) { _tail += n; }
-	void reset()           { _head = _tail = 0; }
+			size_t const offset = pos & _mask;
+			ptr = _data + offset;
+			return Genode::min((size_t)(head - pos), _size - offset);
+		}
+
+		/**
+		 * Release content up to stream position 'pos', called by the consumer
+		 */
+		void consume_to(uint64_t pos)
+		{
+			uint64_t const head = this->head();
 
-	Util::Pthread_mutex &mutex() { return _mutex; }
+			if (pos > head)  pos = head;
+			if (pos <= _tail) return;
+
+			__atomic_store_n(&_tail, pos, __ATOMIC_RELEASE);
+		}
+
+		/**
+		 * Copy out and release up to 'len' bytes, called by the consumer
+		 */
+		size_t read(char *dst, size_t len)
+		{
+			size_t num = 0;
+			while (num < len) {
+				char const *src = nullptr;
+				size_t const avail = Genode::min(content(_tail, src), len - num);
+				if (!avail) break;
+
+				::memcpy(dst + num, src, avail);
+				consume_to(_tail + avail);
+				num += avail;
+			}
+			return num;
+		}
 };
 
 #endif /* _SSH_TERMINAL_UTIL_H_ */
@@ -0,0 +1,85 @@
+/*
+ * \brief  Measure the throughput of ROM verification
+ * \author agent
+ * \date   2026-10-19
+ *
+ * The component opens each ROM module listed in its config, touches all
+ * pages of the module, and reports the time taken by both steps. If the ROM
+ * sessions are routed through rom_verify, the time to open a session covers
+ * the verification of the module.
+ */
+
+/*
+ * Copyright (C) 2026 agent
+ *
+ * This file is part of the Genode OS framework, which is distributed
+ * under the terms of the GNU General Public License version 2.
+ */
+
+/* Genode includes */
+#include <base/component.h>
+#include <base/attached_rom_dataspace.h>
+#include <timer_session/connection.h>
+#include <base/log.h>
+
+namespace Rom_verify_bench {
+	using namespace Genode;
+
+	struct Main;
+}
+
+
+struct Rom_verify_bench::Main
+{
+	typedef String<64> Label;
+
+	Env &_env;
+
+	Timer::Connection _timer { _env };
+
+	Attached_rom_dataspace _config { _env, "config" };
+
+	uint64_t _now_us() { return _timer.curr_time().trunc_to_plain_us().value; }
+
+	static uint64_t _mib_per_s(size_t bytes, uint64_t us)
+	{
+		return us ? (bytes*1000000ULL / us) >> 20 : 0;
+	}
+
+	void _measure(Label const &label)
+	{
+		uint64_t const start_us = _now_us();
+
+		Attached_rom_dataspace rom { _env, label.string() };
+
+		uint64_t const open_us = _now_us();
+
+		/* touch each page of the module */
+		uint8_t const *data = rom.local_addr<uint8_t const>();
+		unsigned checksum = 0;
+		for (size_t off = 0; off < rom.size(); off += 4096)
+			checksum += data[off];
+
+		uint64_t const read_us = _now_us();
+
+		log(label, ": ", rom.size() >> 20, " MiB, "
+		    "open ", (open_us - start_us) / 1000, " ms "
+		    "(", _mib_per_s(rom.size(), open_us - start_us), " MiB/s), "
+		    "read ", (read_us - open_us) / 1000, " ms "
+		    "(checksum ", Hex(checksum), ")");
+	}
+
+	Main(Env &env) : _env(env)
+	{
+		_config.xml().for_each_sub_node("rom", [&] (Xml_node rom) {
+			_measure(rom.attribute_value("label", Label())); });
+
+		log("Test done.");
+	}
+};
+
+
+void Component::construct(Genode::Env &env)
+{
+	static Rom_verify_bench::Main main(env);
+}
@@ -0,0 +1,3 @@
+TARGET = test-rom_verify_bench
+SRC_CC = main.cc
+LIBS   = base
@@ -0,0 +1,63 @@
+/*
+ * \brief  Terminal client echoing all input in bulk
+ * \author agent
+ * \date   2026-10-19
+ *
+ * In contrast to 'test-terminal_echo', the input is written back in chunks
+ * as large as the read buffer so that the echo terminal does not limit the
+ * throughput measured by 'test-ssh_server_bench'.
+ */
+
+/*
+ * Copyright (C) 2026 agent
+ *
+ * This file is part of the Genode OS framework, which is distributed
+ * under the terms of the GNU Affero General Public License version 3.
+ */
+
+/* Genode includes */
+#include <base/component.h>
+#include <terminal_session/connection.h>
+
+namespace Ssh_server_bench_echo {
+	using namespace Genode;
+
+	struct Main;
+}
+
+
+struct Ssh_server_bench_echo::Main
+{
+	Env &_env;
+
+	Terminal::Connection _terminal { _env };
+
+	char _buffer[16*1024];
+
+	Signal_handler<Main> _read_avail_handler {
+		_env.ep(), *this, &Main::_handle_read_avail };
+
+	void _handle_read_avail()
+	{
+		while (_terminal.avail()) {
+			size_t const num_bytes = _terminal.read(_buffer, sizeof(_buffer));
+
+			/* the server accepts less than requested if its buffer is full */
+			for (size_t written = 0; written < num_bytes; )
+				written += _terminal.write(_buffer + written,
+				                           num_bytes - written);
+		}
+	}
+
+	Main(Env &env) : _env(env)
+	{
+		_terminal.read_avail_sigh(_read_avail_handler);
+		_handle_read_avail();
+	}
+};
+
+
+void Component::construct(Genode::Env &env)
+{
+	static Ssh_server_bench_echo::Main main(env);
+}
@@ -0,0 +1,3 @@
+TARGET = test-ssh_server_bench_echo
+SRC_CC = main.cc
+LIBS   = base
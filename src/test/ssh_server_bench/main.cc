@@ -0,0 +1,553 @@
+/*
+ * \brief  Throughput and latency benchmark for the ssh_server
+ * \author agent
+ * \date   2026-10-19
+ *
+ * For each cipher/MAC combination listed in the config, the component
+ * measures the handshake latency, the throughput of a terminal channel
+ * connected to an echo terminal, and the SFTP upload and download
+ * throughput. Afterwards, the SFTP upload is repeated with the configured
+ * numbers of concurrent sessions. Each measurement is logged as one
+ * '<result .../>' line.
+ */
+
+/*
+ * Copyright (C) 2026 agent
+ *
+ * This file is part of the Genode OS framework, which is distributed
+ * under the terms of the GNU Affero General Public License version 3.
+ */
+
+/* Genode includes */
+#include <libc/component.h>
+#include <util/reconstructible.h>
+#include <util/xml_node.h>
+#include <base/log.h>
+
+/* libssh includes */
+#include <libssh/libssh.h>
+#include <libssh/sftp.h>
+
+/* libc includes */
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+
+namespace Ssh_server_bench {
+	using namespace Genode;
+
+	typedef String<64> Name;
+
+	struct Account;
+	struct Algorithm;
+	struct Connection;
+	struct Sftp;
+	struct Upload;
+	struct Main;
+
+	/* size of channel writes and SFTP requests */
+	enum { CHUNK = 32*1024 };
+
+	/* SFTP READ requests kept in flight by the download */
+	enum { READ_AHEAD = 16 };
+
+	/* echoed bytes outstanding on the terminal channel */
+	enum { TERMINAL_WINDOW = 64*1024 };
+
+	enum { TIMEOUT_MS = 10*1000 };
+
+	enum { MAX_SESSIONS = 16 };
+
+	static uint64_t now_us()
+	{
+		timespec ts { };
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return (uint64_t)ts.tv_sec*1000000ULL + ts.tv_nsec/1000;
+	}
+
+	static char const *name_or_default(Name const &name) {
+		return name.valid() ? name.string() : "default"; }
+}
+
+
+struct Ssh_server_bench::Account
+{
+	Name user;
+	Name password;
+
+	Account(Xml_node const &node)
+	:
+		user    (node.attribute_value("user",     Name())),
+		password(node.attribute_value("password", Name()))
+	{ }
+};
+
+
+/**
+ * Cipher and MAC negotiated for both directions, libssh defaults if empty
+ */
+struct Ssh_server_bench::Algorithm
+{
+	Name cipher;
+	Name mac;
+
+	Algorithm(Xml_node const &node)
+	:
+		cipher(node.attribute_value("cipher", Name())),
+		mac   (node.attribute_value("mac",    Name()))
+	{ }
+};
+
+
+/**
+ * Authenticated SSH connection
+ */
+struct Ssh_server_bench::Connection
+{
+	ssh_session const session = ssh_new();
+
+	bool established = false;
+
+	/*
+	 * Noncopyable
+	 */
+	Connection(Connection const &);
+	Connection &operator = (Connection const &);
+
+	Connection(Name const &host, Name const &port,
+	           Account const &account, Algorithm const &algorithm,
+	           bool verbose = true)
+	{
+		if (!session) {
+			error("failed to create libssh session");
+			return;
+		}
+
+		ssh_options_set(session, SSH_OPTIONS_HOST,     host.string());
+		ssh_options_set(session, SSH_OPTIONS_PORT_STR, port.string());
+		ssh_options_set(session, SSH_OPTIONS_USER,     account.user.string());
+		ssh_options_set(session, SSH_OPTIONS_SSH_DIR,  "/");
+
+		if (algorithm.cipher.valid()) {
+			ssh_options_set(session, SSH_OPTIONS_CIPHERS_C_S, algorithm.cipher.string());
+			ssh_options_set(session, SSH_OPTIONS_CIPHERS_S_C, algorithm.cipher.string());
+		}
+		if (algorithm.mac.valid()) {
+			ssh_options_set(session, SSH_OPTIONS_HMAC_C_S, algorithm.mac.string());
+			ssh_options_set(session, SSH_OPTIONS_HMAC_S_C, algorithm.mac.string());
+		}
+
+		if (ssh_connect(session) != SSH_OK) {
+			if (verbose)
+				error("connect failed: ", ssh_get_error(session));
+			return;
+		}
+
+		if (ssh_userauth_password(session, nullptr, account.password.string())
+		    != SSH_AUTH_SUCCESS) {
+			error("authentication of '", account.user, "' failed: ",
+			      ssh_get_error(session));
+			return;
+		}
+
+		established = true;
+	}
+
+	~Connection()
+	{
+		if (!session) return;
+
+		ssh_disconnect(session);
+		ssh_free(session);
+	}
+};
+
+
+/**
+ * SFTP subsystem of a connection
+ */
+struct Ssh_server_bench::Sftp
+{
+	sftp_session const sftp;
+
+	bool initialized = false;
+
+	/*
+	 * Noncopyable
+	 */
+	Sftp(Sftp const &);
+	Sftp &operator = (Sftp const &);
+
+	Sftp(Connection &conn) : sftp(sftp_new(conn.session))
+	{
+		if (!sftp || sftp_init(sftp) != SSH_OK) {
+			error("failed to initialize sftp: ", ssh_get_error(conn.session));
+			return;
+		}
+		initialized = true;
+	}
+
+	~Sftp() { if (sftp) sftp_free(sftp); }
+
+	bool upload(char const *path, char const *payload, size_t total)
+	{
+		sftp_file file = sftp_open(sftp, path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (!file) {
+			error("failed to create '", path, "'");
+			return false;
+		}
+
+		bool ok = true;
+		for (size_t done = 0; ok && done < total; ) {
+			size_t const n = min((size_t)CHUNK, total - done);
+			ok = sftp_write(file, payload, n) == (ssize_t)n;
+			done += n;
+		}
+
+		if (!ok)
+			error("failed to write '", path, "'");
+
+		return (sftp_close(file) == SSH_NO_ERROR) && ok;
+	}
+
+	bool download(char const *path, char *buffer, size_t total)
+	{
+		sftp_file file = sftp_open(sftp, path, O_RDONLY, 0);
+		if (!file) {
+			error("failed to open '", path, "'");
+			return false;
+		}
+
+		uint32_t ids[READ_AHEAD];
+		unsigned first = 0, outstanding = 0;
+		size_t   requested = 0, received = 0;
+
+		auto issue = [&] ()
+		{
+			while (requested < total && outstanding < READ_AHEAD) {
+				size_t const n = min((size_t)CHUNK, total - requested);
+				int const id = sftp_async_read_begin(file, (uint32_t)n);
+				if (id < 0) return false;
+
+				ids[(first + outstanding) % READ_AHEAD] = (uint32_t)id;
+				outstanding++;
+				requested += n;
+			}
+			return true;
+		};
+
+		bool ok = issue();
+		while (ok && outstanding) {
+			int const n = sftp_async_read(file, buffer, CHUNK, ids[first]);
+			first = (first + 1) % READ_AHEAD;
+			outstanding--;
+
+			ok = n > 0 && issue();
+			if (n > 0) received += n;
+		}
+
+		if (received != total) {
+			error("read ", received, " of ", total, " bytes from '", path, "'");
+			ok = false;
+		}
+
+		sftp_close(file);
+		return ok;
+	}
+};
+
+
+/**
+ * SFTP upload performed by one of several concurrent sessions
+ */
+struct Ssh_server_bench::Upload
+{
+	Main            &main;
+	Algorithm const &algorithm;
+	unsigned         index;
+
+	pthread_t thread   { };
+	uint64_t  start_us { 0 };
+	uint64_t  end_us   { 0 };
+	bool      ok       { false };
+
+	Upload(Main &main, Algorithm const &algorithm, unsigned index)
+	: main(main), algorithm(algorithm), index(index) { }
+
+	void run();
+
+	static void *entry(void *arg)
+	{
+		static_cast<Upload *>(arg)->run();
+		return nullptr;
+	}
+};
+
+
+struct Ssh_server_bench::Main
+{
+	Libc::Env &_env;
+
+	Name _host { };
+	Name _port { };
+
+	Constructible<Account> _terminal_account { };
+	Constructible<Account> _sftp_account     { };
+
+	unsigned _handshakes   { 10 };
+	size_t   _terminal_kib { 4096 };
+	size_t   _sftp_kib     { 16*1024 };
+
+	char _payload[CHUNK];
+	char _buffer[CHUNK];
+
+	void _report(char const *test, Algorithm const &algorithm,
+	             unsigned sessions, uint64_t bytes, uint64_t us)
+	{
+		uint64_t const kib_s = us ? bytes*1000000ULL/1024/us : 0;
+
+		log("<result test=\"", test, "\""
+		    " cipher=\"",   name_or_default(algorithm.cipher), "\""
+		    " mac=\"",      name_or_default(algorithm.mac),    "\""
+		    " sessions=\"", sessions, "\""
+		    " bytes=\"",    bytes,    "\""
+		    " us=\"",       us,       "\""
+		    " kib_s=\"",    kib_s,    "\"/>");
+	}
+
+	/**
+	 * Wait until the server accepts connections
+	 */
+	bool _await_server(Algorithm const &algorithm)
+	{
+		for (unsigned i = 0; i < 60; i++) {
+			Connection conn { _host, _port, *_terminal_account, algorithm, false };
+			if (conn.established) return true;
+			sleep(1);
+		}
+		error("server at ", _host, ":", _port, " not reachable");
+		return false;
+	}
+
+	void _measure_handshake(Algorithm const &algorithm)
+	{
+		uint64_t min_us = ~(uint64_t)0, max_us = 0, sum_us = 0;
+
+		for (unsigned i = 0; i < _handshakes; i++) {
+			uint64_t const start_us = now_us();
+
+			Connection conn { _host, _port, *_terminal_account, algorithm };
+			if (!conn.established) return;
+
+			uint64_t const us = now_us() - start_us;
+			min_us  = min(min_us, us);
+			max_us  = max(max_us, us);
+			sum_us += us;
+		}
+
+		if (!_handshakes) return;
+
+		log("<result test=\"handshake\""
+		    " cipher=\"",   name_or_default(algorithm.cipher), "\""
+		    " mac=\"",      name_or_default(algorithm.mac),    "\""
+		    " count=\"",    _handshakes,           "\""
+		    " us=\"",       sum_us / _handshakes,  "\""
+		    " min_us=\"",   min_us,                "\""
+		    " max_us=\"",   max_us,                "\"/>");
+	}
+
+	/*
+	 * The terminal is an echo server, so each byte traverses the channel in
+	 * both directions. The reported size is the number of bytes echoed.
+	 */
+	void _measure_terminal(Algorithm const &algorithm)
+	{
+		Connection conn { _host, _port, *_terminal_account, algorithm };
+		if (!conn.established) return;
+
+		ssh_channel const channel = ssh_channel_new(conn.session);
+		if (!channel) return;
+
+		if (ssh_channel_open_session(channel) != SSH_OK
+		 || ssh_channel_request_pty_size(channel, "screen", 80, 24) != SSH_OK
+		 || ssh_channel_request_shell(channel) != SSH_OK) {
+			error("failed to open terminal channel: ", ssh_get_error(conn.session));
+			ssh_channel_free(channel);
+			return;
+		}
+
+		size_t const total = _terminal_kib*1024;
+		size_t sent = 0, received = 0;
+
+		uint64_t const start_us = now_us();
+
+		while (received < total) {
+
+			if (sent < total && sent - received < TERMINAL_WINDOW) {
+				size_t const n = min((size_t)CHUNK, total - sent);
+				if (ssh_channel_write(channel, _payload, (uint32_t)n) != (int)n)
+					break;
+				sent += n;
+
+				int const r = ssh_channel_read_nonblocking(channel, _buffer,
+				                                           sizeof(_buffer), 0);
+				if (r < 0) break;
+				received += r;
+				continue;
+			}
+
+			int const r = ssh_channel_read_timeout(channel, _buffer,
+			                                       sizeof(_buffer), 0,
+			                                       TIMEOUT_MS);
+			if (r <= 0) break;
+			received += r;
+		}
+
+		uint64_t const us = now_us() - start_us;
+
+		ssh_channel_close(channel);
+		ssh_channel_free(channel);
+
+		if (received != total) {
+			error("terminal echoed ", received, " of ", total, " bytes");
+			return;
+		}
+
+		_report("terminal", algorithm, 1, total, us);
+	}
+
+	void _measure_sftp(Algorithm const &algorithm)
+	{
+		Connection conn { _host, _port, *_sftp_account, algorithm };
+		if (!conn.established) return;
+
+		Sftp sftp { conn };
+		if (!sftp.initialized) return;
+
+		size_t const total = _sftp_kib*1024;
+		char const * const path = "/sftp/bench";
+
+		uint64_t const start_us = now_us();
+		if (!sftp.upload(path, _payload, total)) return;
+		uint64_t const upload_us = now_us();
+		if (!sftp.download(path, _buffer, total)) return;
+		uint64_t const download_us = now_us();
+
+		sftp_unlink(sftp.sftp, path);
+
+		_report("sftp_upload",   algorithm, 1, total, upload_us - start_us);
+		_report("sftp_download", algorithm, 1, total, download_us - upload_us);
+	}
+
+	/*
+	 * The aggregated throughput covers the period from the first session
+	 * starting its upload to the last session completing it.
+	 */
+	void _measure_concurrency(Algorithm const &algorithm, unsigned sessions)
+	{
+		Upload *uploads[MAX_SESSIONS];
+		unsigned started = 0;
+
+		for (unsigned i = 0; i < sessions; i++) {
+			uploads[i] = new Upload(*this, algorithm, i);
+			if (pthread_create(&uploads[i]->thread, nullptr,
+			                   Upload::entry, uploads[i]) != 0) {
+				error("failed to create upload thread");
+				delete uploads[i];
+				break;
+			}
+			started++;
+		}
+
+		uint64_t first_us = ~(uint64_t)0, last_us = 0;
+		bool ok = started == sessions;
+
+		for (unsigned i = 0; i < started; i++) {
+			pthread_join(uploads[i]->thread, nullptr);
+
+			ok       = ok && uploads[i]->ok;
+			first_us = min(first_us, uploads[i]->start_us);
+			last_us  = max(last_us,  uploads[i]->end_us);
+
+			delete uploads[i];
+		}
+
+		if (!ok) {
+			error("concurrent upload with ", sessions, " sessions failed");
+			return;
+		}
+
+		_report("sftp_concurrent", algorithm, sessions,
+		        (uint64_t)_sftp_kib*1024*sessions, last_us - first_us);
+	}
+
+	Main(Libc::Env &env) : _env(env)
+	{
+		for (size_t i = 0; i < sizeof(_payload); i++)
+			_payload[i] = 'a' + i % 26;
+
+		_env.config([&] (Xml_node const &config) {
+
+			_host         = config.attribute_value("host", Name("10.0.3.2"));
+			_port         = config.attribute_value("port", Name("22"));
+			_handshakes   = config.attribute_value("handshakes", _handshakes);
+			_terminal_kib = config.attribute_value("terminal_kib", _terminal_kib);
+			_sftp_kib     = config.attribute_value("sftp_kib", _sftp_kib);
+
+			_terminal_account.construct(config.sub_node("terminal"));
+			_sftp_account.construct(config.sub_node("sftp"));
+
+			Algorithm default_algorithm { Xml_node("<algorithm/>") };
+			if (!_await_server(default_algorithm)) return;
+
+			config.for_each_sub_node("algorithm", [&] (Xml_node const &node) {
+				Algorithm const algorithm { node };
+				_measure_handshake(algorithm);
+				_measure_terminal(algorithm);
+				_measure_sftp(algorithm);
+			});
+
+			config.for_each_sub_node("concurrency", [&] (Xml_node const &node) {
+				unsigned const sessions = min(node.attribute_value("sessions", 1U),
+				                              (unsigned)MAX_SESSIONS);
+				if (sessions)
+					_measure_concurrency(default_algorithm, sessions);
+			});
+		});
+
+		log("Test done.");
+	}
+};
+
+
+void Ssh_server_bench::Upload::run()
+{
+	Connection conn { main._host, main._port, *main._sftp_account, algorithm };
+	if (!conn.established) return;
+
+	Sftp sftp { conn };
+	if (!sftp.initialized) return;
+
+	String<32> const path("/sftp/bench_", index);
+
+	start_us = now_us();
+	ok = sftp.upload(path.string(), main._payload, main._sftp_kib*1024);
+	end_us = now_us();
+
+	sftp_unlink(sftp.sftp, path.string());
+}
+
+
+void Libc::Component::construct(Libc::Env &env)
+{
+	with_libc([&] () {
+		ssh_init();
+
+		static Ssh_server_bench::Main main(env);
+
+		ssh_finalize();
+	});
+}
@@ -0,0 +1,5 @@
+TARGET = test-ssh_server_bench
+SRC_CC = main.cc
+LIBS   = base libc libssh
+
+CC_CXX_WARN_STRICT =